@@ -170,6 +170,8 @@ unsigned    mp_msb_normalize(mp_digit *u, mp_size size);
 unsigned    mp_odd_shift(const mp_digit *u, mp_size size);
 /* Return the number of significant bits in u[size]. */
 unsigned    mp_significant_bits(const mp_digit *u, mp_size size);
+/* Return true if u[size] is a power of two. */
+bool	    mp_is_pow2(const mp_digit *u, mp_size size);
 /* Compute the multiplicative inverse of a digit, modulo 2^MP_DIGIT_BITS. A
  * number N does not have a modular inverse mod M if N and M are not coprime.
  * Since the radix we work in is always a power of 2, this is simply the
@@ -179,6 +181,9 @@ mp_digit    mp_digit_invert(mp_digit n);
 mp_digit    mp_digit_sqrt(mp_digit n);
 /* Compute the great common divisor of two digits. */
 mp_digit    mp_digit_gcd(mp_digit u, mp_digit v);
+/* Return true if the digit N is prime. Miller-Rabin to a set of bases known
+ * to be correct for every digit makes this exact. */
+bool	    mp_digit_is_prime(mp_digit n);
 
 /* Set u[size] = u[size] + 1, and return the carry. */
 mp_digit    mp_inc(mp_digit *u, mp_size size);
@@ -261,6 +266,23 @@ mp_digit    mp_ddivi(mp_digit *u, mp_size size, mp_digit v);
 /* Return u[size] % v. */
 mp_digit    mp_dmod(const mp_digit *u, mp_size usize, mp_digit v);
 
+/* Precomputed reciprocal of a single digit divisor D, for repeated division by
+ * the same digit. */
+typedef struct {
+    mp_digit	    d;		/* Divisor. */
+    mp_digit	    dnorm;	/* D << shift, with the high bit set. */
+    mp_digit	    inv;	/* floor((B^2 - 1) / dnorm) - B */
+    unsigned	    shift;
+} mp_dinv_ctx;
+
+/* Initialize CTX for division by D, which must be non-zero. */
+void	    mp_dinv_ctx_init(mp_dinv_ctx *ctx, mp_digit d);
+/* Set u[size] = u[size] / D, and return the remainder. */
+mp_digit    mp_ddivi_preinv(mp_digit *u, mp_size size, const mp_dinv_ctx *ctx);
+/* Return u[size] % D. */
+mp_digit    mp_dmod_preinv(const mp_digit *u, mp_size size,
+			   const mp_dinv_ctx *ctx);
+
 /* Divide the number u[usize] by v[vsize], storing the quotient in
  * q[usize-vsize+1]. The most significant bit of V must be set (V must be
  * normalized). The least significant VLEN digits of U will be set to the
@@ -305,31 +327,213 @@ void	    mp_modsqr(const mp_digit *u, const mp_digit *m, mp_size msize,
  * large as M. */
 void	    mp_modexp_u64(const mp_digit *u, mp_size usize, uint64_t exponent,
 			  const mp_digit *m, mp_size msize, mp_digit *w);
+/* Compute w[i] = (u[i] ^ P) mod M for i < n, as mp_modexp_u64() does but
+ * sharing the setup for M, e.g. to check a batch of RSA signatures. */
+void	    mp_modexp_u64_batch(const mp_digit *const *u, const mp_size *usize,
+				unsigned n, uint64_t exponent,
+				const mp_digit *m, mp_size msize,
+				mp_digit *const *w);
 void	    mp_modexp(const mp_digit *u, mp_size usize,
 		      const mp_digit *p, mp_size psize,
 		      const mp_digit *m, mp_size msize, mp_digit *w);
 void	    mp_mexp(const mp_digit *u, mp_size usize,
 		    const mp_digit *p, mp_size psize,
 		    const mp_digit *m, mp_size msize, mp_digit *w);
+/* Compute (U ^ P) mod M with whichever of the above is fastest for the parity
+ * and size of M, the length of P and the size of U. */
+void	    mp_powm(const mp_digit *u, mp_size usize,
+		    const mp_digit *p, mp_size psize,
+		    const mp_digit *m, mp_size msize, mp_digit *w);
+/* Compute (U ^ P) mod 2^K and put the result in w[ceil(K / MP_DIGIT_BITS)]. */
+void	    mp_modexp_2k(const mp_digit *u, mp_size usize,
+			 const mp_digit *p, mp_size psize,
+			 unsigned k, mp_digit *w);
+/* Compute the inverse of U modulo 2^K and put the result in
+ * w[ceil(K / MP_DIGIT_BITS)]. U must be odd. */
+void	    mp_invert_2k(const mp_digit *u, mp_size usize, unsigned k,
+			 mp_digit *w);
 
+typedef struct {
+    const mp_digit* m;
+    mp_digit*	    r2;		/* R^2 mod M, R = B^k */
+    mp_digit	    m0_inv;	/* -M^-1 mod B */
+    mp_size	    k;
+} mp_mont_ctx;
+
+#define		MP_MONT_CTX_INITIALIZER		{ NULL, NULL, 0, 0 }
+
+/* Montgomery arithmetic modulo an odd M. Values in Montgomery form are stored
+ * as x * R mod M in ctx->k digits. */
+void	    mp_mont_ctx_init(mp_mont_ctx *ctx, const mp_digit *m, mp_size msize);
+void	    mp_mont_ctx_free(mp_mont_ctx *ctx);
+/* w[0 .. ctx->k-1] = t[0 .. 2*ctx->k-1] / R mod M, where T < M * R. T is
+ * overwritten. */
+void	    mp_mont_redc(mp_digit *t, const mp_mont_ctx *ctx, mp_digit *w);
+/* w[0 .. ctx->k-1] = U * R mod M */
+void	    mp_mont_to(const mp_digit *u, mp_size usize, const mp_mont_ctx *ctx,
+		       mp_digit *w);
+/* w[0 .. ctx->k-1] = U / R mod M */
+void	    mp_mont_from(const mp_digit *u, const mp_mont_ctx *ctx, mp_digit *w);
+/* w[0 .. ctx->k-1] = U * V / R mod M */
+void	    mp_mont_mul(const mp_digit *u, const mp_digit *v,
+			const mp_mont_ctx *ctx, mp_digit *w);
+/* w[0 .. ctx->k-1] = U^2 / R mod M */
+void	    mp_mont_sqr(const mp_digit *u, const mp_mont_ctx *ctx, mp_digit *w);
+/* Interleaved Montgomery multiplication kernels for U, V < M, where M is odd,
+ * m0_inv = -M^-1 mod B and R = B^s. Set t[0..s] = U * V / R mod M, plus
+ * possibly M; T must have room for s + 2 digits. */
+void	    mp_mont_mul_cios(const mp_digit *u, const mp_digit *v,
+			     const mp_digit *m, mp_size s, mp_digit m0_inv,
+			     mp_digit *t);
+void	    mp_mont_mul_fios(const mp_digit *u, const mp_digit *v,
+			     const mp_digit *m, mp_size s, mp_digit m0_inv,
+			     mp_digit *t);
+/* w[0 .. ctx->k-1] = U^P / R^(P-1) mod M, i.e. exponentiation of a value in
+ * Montgomery form. */
+void	    mp_mont_exp(const mp_digit *u, const mp_digit *p, mp_size psize,
+			const mp_mont_ctx *ctx, mp_digit *w);
+/* As above for a one-word exponent, by its binary addition chain and without
+ * a table of powers; meant for short exponents such as 65537. */
+void	    mp_mont_exp_u64(const mp_digit *u, uint64_t exponent,
+			    const mp_mont_ctx *ctx, mp_digit *w);
+
+/* w[msize] = prod_{i < n} bases[i]^exps[i] mod M, where base i has bsizes[i]
+ * digits and exponent i has esizes[i] digits, with one shared chain of
+ * squarings. */
+void	    mp_multi_exp(const mp_digit *const *bases, const mp_size *bsizes,
+			 const mp_digit *const *exps, const mp_size *esizes,
+			 unsigned n, const mp_digit *m, mp_size msize,
+			 mp_digit *w);
+
+/* Fixed-base exponentiation G^X mod M, for odd M, with a Lim-Lee comb table
+ * precomputed for exponents of up to max_bits bits. M is referenced, not
+ * copied, and must outlive the context. */
+typedef struct {
+    mp_mont_ctx	    mont;
+    mp_digit*	    table;
+    unsigned	    bits;	/* Exponent bits covered by the table */
+    unsigned	    teeth;	/* H: bits per table index */
+    unsigned	    blocks;	/* V: tables, one per block of columns */
+    unsigned	    rows;	/* A = ceil(bits / H) */
+    unsigned	    cols;	/* B = ceil(A / V) */
+} mp_fixedbase_ctx;
+
+#define		MP_FIXEDBASE_CTX_INITIALIZER \
+		    { MP_MONT_CTX_INITIALIZER, NULL, 0, 0, 0, 0, 0 }
+
+void	    mp_fixedbase_ctx_init(mp_fixedbase_ctx *ctx,
+				  const mp_digit *g, mp_size gsize,
+				  const mp_digit *m, mp_size msize,
+				  unsigned max_bits);
+void	    mp_fixedbase_ctx_free(mp_fixedbase_ctx *ctx);
+/* w[0 .. ctx->mont.k-1] = G^X mod M. Exponents longer than the table allows
+ * are handled by ordinary exponentiation. */
+void	    mp_fixedbase_exp(const mp_digit *x, mp_size xsize,
+			     const mp_fixedbase_ctx *ctx, mp_digit *w);
+
+/* Besides M and MU = floor(B^2k / M), a Barrett context caches the odd powers
+ * U, U^3, ..., U^(2^window - 1) mod M of the last base it exponentiated, which
+ * later calls with the same base reuse. A context is therefore modified by
+ * mp_barrett and must not be shared between threads. */
 typedef struct {
     const mp_digit* m;
     mp_digit*	    mu;
     mp_size	    k;
+    mp_digit*	    powers;
+    unsigned	    window;
 } mp_barrett_ctx;
 
-#define		MP_BARRETT_CTX_INITIALIZER	{ NULL, NULL, 0 }
+#define		MP_BARRETT_CTX_INITIALIZER	{ NULL, NULL, 0, NULL, 0 }
 
 void	    mp_barrett_ctx_init(mp_barrett_ctx *ctx,
 				const mp_digit *m, mp_size msize);
 void	    mp_barrett_ctx_free(mp_barrett_ctx *ctx);
 
+/* r[0 .. ctx->k-1] = x[0 .. 2*ctx->k-1] mod m */
+void	    mp_barrett_reduce(const mp_digit *x, const mp_barrett_ctx *ctx,
+			      mp_digit *r);
+/* r[0 .. ctx->k-1] = u[usize] mod m, for U of any size */
+void	    mp_barrett_mod(const mp_digit *u, mp_size usize,
+			   const mp_barrett_ctx *ctx, mp_digit *r);
 /* w[0 .. ctx->k-1] = (u ** exponent) mod m */
 void	    mp_barrett_u64(const mp_digit *u, mp_size usize, uint64_t exponent,
-			   const mp_barrett_ctx *ctx, mp_digit *w);
+			   mp_barrett_ctx *ctx, mp_digit *w);
 void	    mp_barrett(const mp_digit *u, mp_size usize,
 		       const mp_digit *p, mp_size psize,
-		       const mp_barrett_ctx *ctx, mp_digit *w);
+		       mp_barrett_ctx *ctx, mp_digit *w);
+
+/* Most terms in the signed binary form of C for a special modulus. */
+#define		MP_SPECIAL_MAX_TERMS	8
+
+/* A modulus M = 2^bits - C with C < 2^(bits/2) that fits in a digit (C is in
+ * c, nterms is zero) or is a sum of at most MP_SPECIAL_MAX_TERMS signed powers
+ * of two (+/-2^exps[i]). M is referenced, not copied. */
+typedef struct {
+    const mp_digit* m;
+    mp_size	    k;
+    unsigned	    bits;
+    mp_digit	    c;
+    unsigned	    nterms;
+    unsigned	    exps[MP_SPECIAL_MAX_TERMS];
+    bool	    neg[MP_SPECIAL_MAX_TERMS];
+} mp_special_mod_ctx;
+
+#define		MP_SPECIAL_MOD_CTX_INITIALIZER \
+		    { NULL, 0, 0, 0, 0, { 0 }, { false } }
+
+/* Return true and fill in CTX if M has the above form, else false. */
+bool	    mp_special_mod_ctx_init(mp_special_mod_ctx *ctx,
+				    const mp_digit *m, mp_size msize);
+void	    mp_special_mod_ctx_free(mp_special_mod_ctx *ctx);
+/* w[0 .. ctx->k-1] = x[xsize] mod m, for any X. W may alias X. */
+void	    mp_special_reduce(const mp_digit *x, mp_size xsize,
+			      const mp_special_mod_ctx *ctx, mp_digit *w);
+/* w[0 .. ctx->k-1] = (u ** p) mod m */
+void	    mp_special_exp(const mp_digit *u, mp_size usize,
+			   const mp_digit *p, mp_size psize,
+			   const mp_special_mod_ctx *ctx, mp_digit *w);
+
+/* Kinds of mp_mod_ctx. */
+#define		MP_MOD_CTX_BARRETT	0
+#define		MP_MOD_CTX_MONT		1
+#define		MP_MOD_CTX_SPECIAL	2
+
+/* A prepared modulus for loops of modular multiplications: shifted folding for
+ * special moduli, Montgomery arithmetic for other odd M, Barrett reduction
+ * otherwise. Residues are kept in the context's own representation, entered
+ * with mp_mod_ctx_to() and left with mp_mod_ctx_from(); mp_modadd() and
+ * mp_modsub() with ctx->m work on them unchanged. M is referenced, not
+ * copied. */
+typedef struct {
+    const mp_digit*	m;
+    mp_size		k;
+    int			kind;	/* One of MP_MOD_CTX_* */
+    mp_mont_ctx		mont_ctx;
+    mp_barrett_ctx	barrett_ctx;
+    mp_special_mod_ctx	special_ctx;
+} mp_mod_ctx;
+
+#define		MP_MOD_CTX_INITIALIZER \
+		    { NULL, 0, MP_MOD_CTX_BARRETT, MP_MONT_CTX_INITIALIZER, \
+		      MP_BARRETT_CTX_INITIALIZER, \
+		      MP_SPECIAL_MOD_CTX_INITIALIZER }
+
+void	    mp_mod_ctx_init(mp_mod_ctx *ctx, const mp_digit *m, mp_size msize);
+void	    mp_mod_ctx_free(mp_mod_ctx *ctx);
+/* w[0 .. ctx->k-1] = U mod M, in the representation of CTX. */
+void	    mp_mod_ctx_to(const mp_digit *u, mp_size usize,
+			  const mp_mod_ctx *ctx, mp_digit *w);
+/* w[0 .. ctx->k-1] = U, converted back from the representation of CTX. */
+void	    mp_mod_ctx_from(const mp_digit *u, const mp_mod_ctx *ctx,
+			    mp_digit *w);
+/* w[0 .. ctx->k-1] = U * V mod M and U^2 mod M, for U, V in the
+ * representation of CTX. W may alias U or V. */
+void	    mp_modmul_ctx(const mp_digit *u, const mp_digit *v,
+			  const mp_mod_ctx *ctx, mp_digit *w);
+void	    mp_modsqr_ctx(const mp_digit *u, const mp_mod_ctx *ctx, mp_digit *w);
+/* w[0 .. ctx->k-1] = U^P mod M, for U and W in the representation of CTX. */
+void	    mp_modexp_ctx(const mp_digit *u, const mp_digit *p, mp_size psize,
+			  mp_mod_ctx *ctx, mp_digit *w);
 
 void	    mp_modexp_pow2(const mp_digit *u, mp_size usize,
 			   const mp_digit *p, mp_size psize,
@@ -346,14 +550,77 @@ void	    mp_gcd(const mp_digit *u, mp_size usize,
 bool	    mp_coprime(const mp_digit *u, mp_size usize,
 		       const mp_digit *v, mp_size vsize);
 
+/* A product of the quotient matrices (q 1; 1 0) of the Euclidean algorithm,
+ * whose entries are nonnegative and whose determinant is DET = +1 or -1. It
+ * may also record the quotients, modulo 8, in the order they were found. */
+typedef struct {
+    mp_digit*	    m[2][2];	/* Entries, zero above their first SIZE digits */
+    mp_size	    size;
+    mp_size	    alloc;	/* Digits available for each entry */
+    int		    det;
+    unsigned char*  q;		/* Quotients mod 8, or NULL if not recorded */
+    mp_size	    qcount;
+    mp_size	    qalloc;
+} mp_hgcd_matrix;
+
+#define		MP_HGCD_MATRIX_INITIALIZER \
+		    { { { NULL, NULL }, { NULL, NULL } }, 0, 0, 0, NULL, 0, 0 }
+
+/* Initialize M to the identity, with room for entries of ALLOC digits. With
+ * ALLOC 0, M keeps no entries, only its determinant and quotients. */
+void	    mp_hgcd_matrix_init(mp_hgcd_matrix *m, mp_size alloc);
+void	    mp_hgcd_matrix_free(mp_hgcd_matrix *m);
+/* Start recording the quotients multiplied into M. */
+void	    mp_hgcd_matrix_log(mp_hgcd_matrix *m);
+/* Record the quotient Q, if M records them. */
+void	    mp_hgcd_matrix_log_q(mp_hgcd_matrix *m, mp_digit q);
+/* Half-GCD: run the Euclidean algorithm on A > B in place, until A >= B^K > B
+ * (that is, until B has at most K digits), in subquadratic time. Unless M is
+ * NULL, the quotient matrix Q with (A B)' = Q (A' B)' is multiplied into M on
+ * the right; M needs room for entries as large as the original A, unless it
+ * keeps none. */
+void	    mp_hgcd(mp_digit *a, mp_size *asize, mp_digit *b, mp_size *bsize,
+		    mp_size k, mp_hgcd_matrix *m);
+/* One step of Lehmer's algorithm on A > B in place: a matrix of single-digit
+ * quotients found from the leading two digits of A and B is applied to them,
+ * and multiplied into M unless it is NULL, as for mp_hgcd(). Return true on
+ * success, with A >= B^K still; otherwise leave A and B alone and return
+ * false, after which a division step should be taken. */
+bool	    mp_lehmer_step(mp_digit *a, mp_size *asize,
+			   mp_digit *b, mp_size *bsize,
+			   mp_size k, mp_hgcd_matrix *m);
+/* Compute the GCD of U and V with Lehmer's algorithm, and store the result at
+ * W, which must be at least as large as the smaller of U or V. mp_gcd() calls
+ * this for medium-sized operands. */
+void	    mp_lehmer(const mp_digit *u, mp_size usize,
+		      const mp_digit *v, mp_size vsize, mp_digit *w);
+
 /* Compute the Jacobi symbol A over P. Returns -1, 0, or +1. */
 int	    mp_jacobi(const mp_digit *a, mp_size asize,
 		      const mp_digit *p, mp_size psize);
+/* Compute a square root of A modulo the odd prime P and store it in w[psize].
+ * Return true if A is a quadratic residue modulo P, false otherwise, in which
+ * case W is left undefined. */
+bool	    mp_modsqrt(const mp_digit *a, mp_size asize,
+		       const mp_digit *p, mp_size psize, mp_digit *w);
+/* As above, for P the modulus of CTX, storing the root in w[ctx->k]; for many
+ * roots modulo one prime. */
+bool	    mp_modsqrt_ctx(const mp_digit *a, mp_size asize,
+			   const mp_mont_ctx *ctx, mp_digit *w);
 
 mp_digit    mp_sieve(const mp_digit *u, mp_size size);
-/* Run NROUNDS rounds of the Miller-Rabin primality test on U. Return true if
- * composite, false if "probably" prime. */
-bool	    mp_composite(const mp_digit *u, mp_size size, unsigned nrounds);
+/* Run NROUNDS rounds of the Miller-Rabin primality test on U, with bases drawn
+ * from RAND_CTX. Return true if composite, false if "probably" prime. Below
+ * 3.3 * 10^24 the answer is exact, whatever NROUNDS. With a RAND_CTX of its
+ * own, each call is independent of any other, so that the rounds for a large
+ * U may be split among threads. */
+bool	    mp_composite_ctx(const mp_digit *u, mp_size size, unsigned nrounds,
+			     mt64_context *rand_ctx);
+#define	    mp_composite(u,size,nrounds) \
+		mp_composite_ctx((u), (size), (nrounds), NULL)
+/* Return true if U passes the Baillie-PSW probable prime test, false if it is
+ * composite, 0 or 1. No composite is known to pass. */
+bool	    mp_bpsw(const mp_digit *u, mp_size size);
 
 /* Compute the integer portion of the square root of u[size] and store it in
  * v[(size+1)/2], and remainder in r[size]. Either V or R may be NULL. */
@@ -362,6 +629,15 @@ void	    mp_sqrtrem(const mp_digit *u, mp_size size,
 #define	    mp_sqrt(u, size, v)	mp_sqrtrem((u), (size), (v), NULL)
 /* Return true if u[usize] is a perfect square, false otherwise. */
 bool	    mp_perfsqr(const mp_digit *u, mp_size usize);
+/* Compute the integer portion of the K-th root of u[size], K >= 1, and store it
+ * in v[(size+K-1)/K], and remainder in r[size]. Either V or R may be NULL. */
+void	    mp_rootrem(const mp_digit *u, mp_size size, unsigned k,
+		       mp_digit *v, mp_digit *r);
+#define	    mp_root(u, size, k, v)	mp_rootrem((u), (size), (k), (v), NULL)
+/* Return the largest K > 1 such that u[usize] is a perfect K-th power, and if
+ * ROOT is not NULL store the K-th root in root[(usize+1)/2]. Return 0 if U is
+ * not a perfect power, including when U is 0 or 1. */
+unsigned    mp_perfect_power(const mp_digit *u, mp_size usize, mp_digit *root);
 
 /* Multiply or divide by a power of two, with power taken modulo MP_DIGIT_BITS,
  * and return the carry (left shift) or remainder (right shift). */
@@ -39,6 +39,13 @@
 # define MP_XCHG_ASM
 #endif
 
+/* The Montgomery kernels take their arguments in System V registers. */
+#if MP_DIGIT_SIZE == 8 && (defined(__x86_64__) || defined(__amd64__)) && \
+    !defined(_WIN64)
+# define MP_MONT_MUL_CIOS_ASM
+# define MP_MONT_MUL_FIOS_ASM
+#endif
+
 #if defined(__APPLE__)
 # define MP_ASM_NAME(fn)	_ ## fn
 #else
@@ -55,6 +62,59 @@
 # define KARATSUBA_SQR_THRESHOLD 64
 #endif
 
+/* Tunable parameter - Barrett contexts for moduli of at least this many digits
+ * find their reciprocal by Newton's iteration rather than long division. */
+#ifndef BARRETT_NEWTON_THRESHOLD
+# define BARRETT_NEWTON_THRESHOLD	40
+#endif
+
+/* Tunable parameter - mp_mul_mod_powb() computes the full product rather than
+ * the low half alone once both factors have this many digits. */
+#ifndef MUL_MOD_POWB_FULL_THRESHOLD
+# define MUL_MOD_POWB_FULL_THRESHOLD	192
+#endif
+
+/* Tunable parameters - mp_powm() crossovers, as printed by bin/tune_powm.
+ * Entry i applies to moduli of 2^i to 2^(i+1) - 1 digits, and the last entry
+ * to all larger moduli. Exponents with fewer bits than the entry are computed
+ * by binary exponentiation with division, and longer ones by windowed
+ * Montgomery exponentiation. The second table applies to one-digit bases. */
+#ifndef POWM_EXP_BITS_TABLE
+# define POWM_EXP_BITS_TABLE		{ 6, 4, 6, 6, 9, 19, 19, 13 }
+#endif
+#ifndef POWM_SMALL_BASE_EXP_BITS_TABLE
+# define POWM_SMALL_BASE_EXP_BITS_TABLE	{ 6, 9, 9, 28, 211, 2398, 3597, 3597 }
+#endif
+
+/* Tunable parameter - moduli close to a power of two (see mp_special.c) are
+ * reduced by folding in mp_mod_ctx_init() and mp_powm() if they are even or
+ * have at least this many digits. Smaller odd ones are left to Montgomery
+ * reduction, whose fused multiply-and-reduce wins on short operands. */
+#ifndef SPECIAL_MOD_THRESHOLD
+# define SPECIAL_MOD_THRESHOLD	8
+#endif
+
+/* Tunable parameters - GCD (see mp_lehmer.c and mp_hgcd.c). mp_gcd() uses the
+ * binary algorithm when the smaller operand has fewer than GCD_LEHMER_THRESHOLD
+ * digits, Lehmer's algorithm below GCD_HGCD_THRESHOLD digits, and the half-GCD
+ * beyond. mpi_gcdext() uses Euclid below GCDEXT_LEHMER_THRESHOLD digits, and
+ * above it reduces the operands with the half-GCD first. The half-GCD recursion
+ * stops at HGCD_THRESHOLD digits, below which it takes Lehmer steps.
+ * GCD_HGCD_THRESHOLD must exceed HGCD_THRESHOLD, and GCDEXT_LEHMER_THRESHOLD
+ * must be at least 2. */
+#ifndef HGCD_THRESHOLD
+# define HGCD_THRESHOLD		120
+#endif
+#ifndef GCD_LEHMER_THRESHOLD
+# define GCD_LEHMER_THRESHOLD	2
+#endif
+#ifndef GCD_HGCD_THRESHOLD
+# define GCD_HGCD_THRESHOLD	2000
+#endif
+#ifndef GCDEXT_LEHMER_THRESHOLD
+# define GCDEXT_LEHMER_THRESHOLD	2
+#endif
+
 /* Define this if routines should use alloca() to allocate temporaries on the
  * stack instead of using malloc() and friends. Allocating using alloca() may
  * be faster than allocating using malloc(). */
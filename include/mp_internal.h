@@ -114,6 +114,16 @@ void mp_digit_sqr(mp_digit u, mp_digit *hi, mp_digit *lo);
 void mp_digit_div(mp_digit n1, mp_digit n0, mp_digit d,
 		  mp_digit *q, mp_digit *r);
 
+/* Sliding window exponentiation; see mp_window.c. */
+unsigned mp_window_size(unsigned nbits, unsigned max_window);
+unsigned mp_window_scan(const mp_digit *p, mp_size psize, unsigned i,
+			unsigned window, unsigned *val);
+
+/* Set w[wsize] = X < 2^K N, for odd N, with X = A (mod N) and X = C
+ * (mod 2^K); see mp_mod2k.c. */
+void mp_crt_2k(const mp_digit *a, const mp_digit *n, mp_size nsize,
+	       const mp_digit *c, unsigned k, mp_digit *w, mp_size wsize);
+
 #ifdef __cplusplus
 }
 #endif
@@ -182,6 +192,15 @@ void mp_digit_div(mp_digit n1, mp_digit n0, mp_digit d,
     } while (0)
 #endif
 
+/* Return bit B of p[psize], or zero if B is beyond its end. */
+static inline unsigned
+mp_exp_bit(const mp_digit *p, mp_size psize, unsigned b)
+{
+    if (b / MP_DIGIT_BITS >= psize)
+	return 0;
+    return (unsigned)(p[b / MP_DIGIT_BITS] >> (b % MP_DIGIT_BITS)) & 1;
+}
+
 #if defined(__GNUC__)
 # define GCC_PURE	__attribute__((__pure__))
 # define GCC_CONST	__attribute__((__const__))
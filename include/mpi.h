@@ -129,16 +129,71 @@ void	mpi_sqrt(const mpi *a, mpi *b);
 void	mpi_gcd(const mpi *a, const mpi *b, mpi *c);
 /* Return 1 if A & B are coprime, 0 otherwise. */
 bool	mpi_coprime(const mpi *a, const mpi *b);
+/* Set gcds[i] = GCD(moduli[i], product of the other moduli) for each of the N
+ * positive MODULI, with a product tree and a remainder tree of squares. This
+ * finds the RSA moduli that share a prime with any other, far faster than
+ * pairwise GCDs would. The trees take O(log N) times the total size of the
+ * moduli in memory.
+ * GCDS must not alias MODULI. */
+void	mpi_batch_gcd(const mpi *const *moduli, unsigned n,
+		      mpi *const *gcds);
+/* As above, with the moduli taken BATCH at a time, for sets whose trees would
+ * not fit in memory. Besides the moduli, it keeps the product of each batch,
+ * together as large as the moduli, and the trees of one batch at a time, O(log
+ * BATCH) times the size of a batch. The time grows with the square of the
+ * number of batches. */
+void	mpi_batch_gcd_chunked(const mpi *const *moduli, unsigned n,
+			      unsigned batch, mpi *const *gcds);
 /* Extended GCD */
 void	mpi_gcdext(const mpi *a, const mpi *b, mpi *u, mpi *v, mpi *d);
 /* Modular inverse */
 int	mpi_modinv(const mpi *m, const mpi *b, mpi *inv);
+/* Invert each of in[0 .. n-1] modulo M into out[0 .. n-1] with a single
+ * modular inversion and 3(n-1) multiplications. Each input must be in [0, M);
+ * OUT may alias IN. Returns 1 if every input is invertible; otherwise returns 0
+ * and sets the outputs that have no inverse to zero. */
+int	mpi_modinv_batch(const mpi *m, const mpi *const *in, mpi *const *out,
+			 unsigned n);
 /* Modular exponentiation: R = (A ^ P) mod M */
 void	mpi_modexp_u32(const mpi *a, uint32_t p, const mpi *m, mpi *r);
 void	mpi_modexp(const mpi *a, const mpi *p, const mpi *m, mpi *r);
+/* Modular square root: R^2 = A (mod P) for the odd prime P. Returns 1 if A is
+ * a quadratic residue modulo P, 0 otherwise. */
+int	mpi_modsqrt(const mpi *a, const mpi *p, mpi *r);
 
 /* Compute Nth fibonacci number, where F_0 = 0 and F_1 = 1. */
 void	mpi_fibonacci(uint64_t n, mpi *fib);
+/* OUT = the product of the N integers IN, or 1 if N is 0, multiplied out as a
+ * balanced tree. OUT may alias an input. */
+void	mpi_product(const mpi *const *in, unsigned n, mpi *out);
+/* OUT = the product of the N words IN, or 1 if N is 0. */
+void	mpi_product_u64(const uint64_t *in, unsigned n, mpi *out);
+/* OUT = LO x (LO+1) x ... x HI, or 1 if LO > HI. */
+void	mpi_product_range(uint64_t lo, uint64_t hi, mpi *out);
+
+/* Product tree over N >= 1 positive integers. Level 0 holds copies of the
+ * leaves and each level above the products of pairs of nodes of the one below,
+ * an odd one out being carried up as it is, up to the product of all of them
+ * at the root. The first mpi_remtree() gives the larger nodes Barrett contexts,
+ * which are kept for later calls. */
+typedef struct {
+    mpi**	    node;	/* node[l][0 .. count[l]-1] */
+    mp_barrett_ctx** ctx;	/* ctx[l][0 .. count[l]-1], or NULL */
+    unsigned*	    count;
+    unsigned	    levels;
+} mpi_prodtree;
+
+#define MPI_PRODTREE_INITIALIZER	{ NULL, NULL, NULL, 0 }
+
+void	mpi_prodtree_init(mpi_prodtree *tree, const mpi *const *leaves,
+			  unsigned n);
+void	mpi_prodtree_free(mpi_prodtree *tree);
+#define mpi_prodtree_root(tree)	(&(tree)->node[(tree)->levels - 1][0])
+/* Set rems[i] = X mod leaf i, for X >= 0. */
+void	mpi_remtree(mpi_prodtree *tree, const mpi *x, mpi *const *rems);
+/* Set rems[i] = X mod (leaf i)^2, for X >= 0. */
+void	mpi_remtree_sqr(mpi_prodtree *tree, const mpi *x, mpi *const *rems);
+
 /* Compute factorial of N. */
 void	mpi_factorial(uint64_t n, mpi *fact);
 /* Compute binomial coefficient N choose K. */
@@ -154,6 +209,25 @@ void	mpi_crt_init(mpi_crt_ctx *ctx);
 int	mpi_crt_step(mpi_crt_ctx *ctx, const mpi *a_i, const mpi *m_i);
 int	mpi_crt_finish(mpi_crt_ctx *ctx, mpi *a);
 
+/* Chinese remaindering for a fixed set of pairwise coprime moduli m_i, with
+ * product M. The plan keeps their product tree and c_i = (M / m_i)^-1 mod m_i,
+ * so that each reconstruction only takes a pass up the tree. */
+typedef struct {
+    mpi_prodtree    tree;
+    mpi*	    inv;	/* c_i */
+} mpi_crt_plan;
+
+#define MPI_CRT_PLAN_INITIALIZER	{ MPI_PRODTREE_INITIALIZER, NULL }
+
+/* Return 0 on success, or -1 if the N positive MODULI are not pairwise
+ * coprime, in which case PLAN is left uninitialized. */
+int	mpi_crt_plan_init(mpi_crt_plan *plan, const mpi *const *moduli,
+			  unsigned n);
+void	mpi_crt_plan_free(mpi_crt_plan *plan);
+/* Set X to the 0 <= X < M congruent to residues[i] modulo each m_i. */
+void	mpi_crt_plan_solve(const mpi_crt_plan *plan,
+			   const mpi *const *residues, mpi *x);
+
 void	mpi_fprint(const mpi *n, unsigned base, FILE *fp);
 #define mpi_fprint_bin(n,fp)	mpi_fprint((n),  2, (fp))
 #define mpi_fprint_oct(n,fp)	mpi_fprint((n),  8, (fp))
@@ -4,6 +4,8 @@
 #ifndef _MPI_INTERNAL_H_
 #define _MPI_INTERNAL_H_
 
+#include "mpi.h"
+
 #define MPI_MIN_ALLOC(n,s) \
     do { \
 	mpi *const __n = (n); \
@@ -31,4 +33,9 @@
 	    --__n->size; \
     } while (0)
 
+/* R = A mod M, through CTX unless its reciprocal is NULL; see
+ * mpi_prodtree.c. */
+void mpi_barrett_mod(const mpi *a, const mpi *m, const mp_barrett_ctx *ctx,
+		     mpi *r);
+
 #endif /* !_MPI_INTERNAL_H_ */
@@ -59,6 +59,20 @@ factorize(mp_digit *n, mp_size len)
     printf("\n");
 
     if (!(len == 1 && n[0] <= 2)) {
+	/* If the remainder is a perfect power, go on with its root instead. */
+	mp_digit *root = mp_new((len + 1) / 2);
+	unsigned k = mp_perfect_power(n, len, root);
+	if (k) {
+	    printf("Remainder ");
+	    mp_print_dec(n, len);
+	    printf(" = ");
+	    len = mp_rsize(root, (len + 1) / 2);
+	    mp_copy(root, len, n);
+	    mp_print_dec(n, len);
+	    printf("^%u\n", k);
+	}
+	mp_free(root);
+
 	/* Now run 10 rounds of the Rabin-Miller test. */
 	printf("Remainder ");
 	mp_print_dec(n, len);
@@ -4,8 +4,84 @@
 #include "mp.h"
 #include "mp_internal.h"
 
-static void barrett_reduce(const mp_digit *x,
-			   const mp_barrett_ctx *ctx, mp_digit *r);
+#if BARRETT_NEWTON_THRESHOLD < 6
+# error "BARRETT_NEWTON_THRESHOLD must be at least 6"
+#endif
+
+/* Largest sliding window used by mp_barrett(). */
+#ifndef BARRETT_MAX_WINDOW
+# define BARRETT_MAX_WINDOW	6
+#endif /* !BARRETT_MAX_WINDOW */
+
+/* Set x[k + 2] = floor(B^2k / M), for m[k] with a nonzero top digit.
+ *
+ * Newton's iteration X' = X + X (B^2k - M X) / B^2k doubles the number of
+ * correct digits of X. So from the reciprocal Xh of the top h = k/2 + 2
+ * digits of M, one step gives X to within a few units, which the remainder
+ * B^2k - M X then corrects. That is a handful of multiplications of k digits
+ * at each of the log k levels, against O(k^2) for long division. */
+static void
+reciprocal(const mp_digit *m, mp_size k, mp_digit *x)
+{
+    mp_zero(x, k + 2);
+    if (k < BARRETT_NEWTON_THRESHOLD) {
+	mp_digit *s = mp_new0(k * 2 + 1);
+	s[k * 2] = 1;
+	mp_div(s, k * 2 + 1, m, k, x);
+	mp_free(s);
+	return;
+    }
+
+    /* X = Xh B^l + Xh E / B^2h, with E = B^(k+h) - M Xh. The two guard digits
+     * in h make up for the top digit of M being as small as 1. */
+    const mp_size h = k / 2 + 2, l = k - h;
+    mp_digit *xh = mp_new(h + 2);
+    reciprocal(m + l, h, xh);
+    const mp_size xhsize = mp_rsize(xh, h + 2);
+    mp_copy(xh, xhsize, x + l);
+
+    const mp_size en = k + h + 2;
+    mp_digit *e = mp_new0(en * 2 + h + 2);
+    mp_digit *p = e + en;
+    mp_mul(m, k, xh, xhsize, p);
+    e[k + h] = 1;
+    const int esign = mp_diff_n(e, p, en, e);
+    const mp_size esize = mp_rsize(e, en);
+    if (esize != 0 && xhsize + esize > h * 2) {
+	mp_mul(xh, xhsize, e, esize, p);
+	const mp_digit *d = p + h * 2;
+	const mp_size dsize = mp_rsize(d, xhsize + esize - h * 2);
+	if (esign > 0)
+	    ASSERT(mp_addi(x, k + 2, d, dsize) == 0);
+	else
+	    ASSERT(mp_subi(x, k + 2, d, dsize) == 0);
+    }
+    mp_free(e);
+    mp_free(xh);
+
+    /* Bring R = B^2k - M X into [0, M). */
+    const mp_size rn = k * 2 + 3;
+    mp_digit *r = mp_new0(rn * 2);
+    mp_digit *t = r + rn;
+    mp_mul(x, k + 2, m, k, t);
+    r[k * 2] = 1;
+    bool neg = mp_diff_n(r, t, rn, r) < 0;
+    while (neg) {
+	/* X is too large: X = X - 1, R = R + M. */
+	ASSERT(mp_dsubi(x, k + 2, 1) == 0);
+	if (mp_cmp(r, rn, m, k) <= 0) {
+	    mp_diff_n(m, r, k, r);
+	    neg = false;
+	} else {
+	    ASSERT(mp_subi(r, rn, m, k) == 0);
+	}
+    }
+    while (mp_cmp(r, rn, m, k) >= 0) {
+	ASSERT(mp_daddi(x, k + 2, 1) == 0);
+	ASSERT(mp_subi(r, rn, m, k) == 0);
+    }
+    mp_free(r);
+}
 
 /* Compute MU = floor(B^2K / M) where K = MLEN. */
 void
@@ -15,20 +91,16 @@ mp_barrett_ctx_init(mp_barrett_ctx *ctx, const mp_digit *m, mp_size msize)
     ASSERT(ctx->m == NULL);
     ASSERT(ctx->mu == NULL);
     ASSERT(ctx->k == 0);
+    ASSERT(ctx->powers == NULL);
 
     MP_NORMALIZE(m, msize);
     ASSERT(msize != 0);
 
-    mp_digit *s = MP_TMP_ALLOC0(msize * 2 + 1);
-    s[msize * 2] = 1;
-
     ctx->m = m;
     ctx->k = msize;
     ctx->mu = mp_new(msize + 2);
-    mp_div(s, msize * 2 + 1, m, msize, ctx->mu);
+    reciprocal(m, msize, ctx->mu);
     ASSERT(mp_rsize(ctx->mu, msize + 2) == msize + 1);
-
-    MP_TMP_FREE(s);
 }
 
 void
@@ -43,13 +115,129 @@ mp_barrett_ctx_free(mp_barrett_ctx *ctx)
     mp_free(ctx->mu);
     ctx->mu = NULL;
     ctx->k = 0;
+    if (ctx->powers != NULL) {
+	mp_free(ctx->powers);
+	ctx->powers = NULL;
+    }
+    ctx->window = 0;
+}
+
+/* Return the window width for an exponent P of NBITS bits. An exponent with
+ * few one bits, such as 65537, gets width 1: its plain binary addition chain
+ * costs fewer multiplications than building the table of odd powers. */
+static unsigned
+exp_window(const mp_digit *p, mp_size psize, unsigned nbits)
+{
+    const unsigned w = mp_window_size(nbits, BARRETT_MAX_WINDOW);
+    unsigned weight = 0;
+    for (mp_size i = 0; i < psize; i++) {
+	for (mp_digit d = p[i]; d != 0; d &= d - 1)
+	    weight++;
+    }
+    /* About NBITS / (W + 1) multiplications with the window, plus 2^(W-1) for
+     * the table, against WEIGHT - 1 without. */
+    if (w > 1 && weight - 1 <= nbits / (w + 1) + (1U << (w - 1)))
+	return 1;
+    return w;
+}
+
+/* Make ctx->powers hold U, U^3, ..., U^(2^W - 1) mod M for a window of at least
+ * WINDOW bits, where UMOD = U mod M. Powers already cached for the same base
+ * are reused, and extended if the window is too small. T must have room for
+ * 2 * ctx->k digits. */
+static void
+barrett_powers(const mp_digit *umod, unsigned window,
+	       mp_barrett_ctx *ctx, mp_digit *t)
+{
+    const mp_size k = ctx->k;
+    mp_size have = 0;
+    if (ctx->window != 0 && mp_cmp_n(ctx->powers, umod, k) == 0) {
+	if (ctx->window >= window)
+	    return;
+	have = (mp_size)1 << (ctx->window - 1);
+    }
+
+    const mp_size count = (mp_size)1 << (window - 1);
+    ctx->powers = mp_resize(ctx->powers, count * k);
+    ctx->window = window;
+    if (have == 0) {
+	mp_copy(umod, k, ctx->powers);
+	have = 1;
+    }
+    if (have < count) {
+	mp_digit *u2 = MP_TMP_ALLOC(k);
+	mp_sqr(ctx->powers, k, t);
+	mp_barrett_reduce(t, ctx, u2);
+	for (; have < count; have++) {
+	    mp_mul_n(ctx->powers + (have - 1) * k, u2, k, t);
+	    mp_barrett_reduce(t, ctx, ctx->powers + have * k);
+	}
+	MP_TMP_FREE(u2);
+    }
+}
+
+/* Set W = UMOD^P mod M by sliding window exponentiation; see mp_window.c.
+ * UMOD has ctx->k digits and P is nonzero. */
+static void
+barrett_exp(const mp_digit *umod, const mp_digit *p, mp_size psize,
+	    mp_barrett_ctx *ctx, mp_digit *w)
+{
+    const mp_size k = ctx->k;
+    unsigned i = mp_significant_bits(p, psize);
+    ASSERT(i != 0);
+
+    mp_digit *t = MP_TMP_ALLOC(2 * k);
+    const mp_size usize = mp_rsize(umod, k);
+    if (usize == 1) {
+	/* Multiplying by a single digit is cheaper than any table lookup. */
+	mp_copy(umod, k, w);
+	while (--i != 0) {
+	    mp_sqr(w, k, t);
+	    mp_barrett_reduce(t, ctx, w);
+	    if (mp_exp_bit(p, psize, i - 1)) {
+		t[k] = mp_dmul(w, k, umod[0], t);
+		mp_zero(t + k + 1, k - 1);
+		mp_barrett_reduce(t, ctx, w);
+	    }
+	}
+	MP_TMP_FREE(t);
+	return;
+    }
+
+    barrett_powers(umod, exp_window(p, psize, i), ctx, t);
+    const unsigned window = ctx->window;
+    bool first = true;
+    while (i != 0) {
+	if (!mp_exp_bit(p, psize, i - 1)) {
+	    mp_sqr(w, k, t);
+	    mp_barrett_reduce(t, ctx, w);
+	    i--;
+	    continue;
+	}
+	unsigned val;
+	const unsigned l = mp_window_scan(p, psize, i, window, &val);
+	const mp_digit *pw = ctx->powers + (val >> 1) * k;
+	if (first) {
+	    mp_copy(pw, k, w);
+	    first = false;
+	} else {
+	    for (unsigned j = i - l; j != 0; j--) {
+		mp_sqr(w, k, t);
+		mp_barrett_reduce(t, ctx, w);
+	    }
+	    mp_mul_n(w, pw, k, t);
+	    mp_barrett_reduce(t, ctx, w);
+	}
+	i = l;
+    }
+    MP_TMP_FREE(t);
 }
 
 /* Compute W = (U ** P) mod M using Barrett modular reduction. */
 void
 mp_barrett(const mp_digit *u, mp_size usize,
 	   const mp_digit *p, mp_size psize,
-	   const mp_barrett_ctx *ctx, mp_digit *w)
+	   mp_barrett_ctx *ctx, mp_digit *w)
 {
     ASSERT(u != NULL);
     ASSERT(p != NULL);
@@ -70,7 +258,7 @@ mp_barrett(const mp_digit *u, mp_size usize,
     MP_NORMALIZE(u, usize);
     MP_NORMALIZE(p, psize);
     if (usize == 0 || psize == 0) {
-	w[0] = (psize != 0);
+	w[0] = (usize != 0);
 	return;
     }
 
@@ -89,141 +277,39 @@ mp_barrett(const mp_digit *u, mp_size usize,
 	}
     }
 
-    /* Precompute W = U mod M */
-    mp_mod(u, usize, ctx->m, msize, w);
-    const mp_size umod_size = mp_rsize(w, msize);
-    if (umod_size == 0) {
-	/* If U is congruent to 0 mod M, the final answer is zero. */
-	return;
-    }
-
-    mp_size tsize = msize * 2;
-    mp_digit *t = MP_TMP_ALLOC(tsize + umod_size);
-    mp_digit *umod = t + tsize;
-    mp_copy(w, umod_size, umod);
-
-    mp_digit k = p[psize - 1];
-    mp_size i = 0;
-    for (; k != 1; i++)
-	k >>= 1;
-    k <<= i;
-    i = psize - 1;
-
-    for (;;) {
-	if ((k >>= 1) == 0) {
-	    if (i == 0)
-		break;
-	    --i;
-	    k = MP_DIGIT_MSB;
-	}
-	mp_sqr(w, msize, t);
-	barrett_reduce(t, ctx, w);
-	if (p[i] & k) {
-	    mp_mul(w, msize, umod, umod_size, t);
-	    /* Barrett reduction requires T be twice as large as M, so clear
-	     * high digits if needed. */
-	    if (msize - umod_size)
-		mp_zero(t + msize + umod_size, msize - umod_size);
-	    barrett_reduce(t, ctx, w);
-	}
-    }
-
-    MP_TMP_FREE(t);
+    /* Precompute U mod M */
+    mp_digit *umod = MP_TMP_ALLOC(msize);
+    mp_mod(u, usize, ctx->m, msize, umod);
+    /* If U is congruent to 0 mod M, the final answer is zero. */
+    if (!mp_is_zero(umod, msize))
+	barrett_exp(umod, p, psize, ctx, w);
+    MP_TMP_FREE(umod);
 }
 
 void
 mp_barrett_u64(const mp_digit *u, mp_size usize, uint64_t exponent,
-			   const mp_barrett_ctx *ctx, mp_digit *w)
+	       mp_barrett_ctx *ctx, mp_digit *w)
 {
-	const mp_digit *m;
-	mp_digit *t, *umod;
-	mp_size msize, tsize, umod_size;
-	unsigned i;
-
-	ASSERT(u != NULL);
-	ASSERT(ctx != NULL);
-	ASSERT(ctx->m != NULL);
-	ASSERT(ctx->mu != NULL);
-	ASSERT(ctx->k != 0);
-	ASSERT(w != NULL);
-
-	m = ctx->m;
-	msize = ctx->k;
-	mp_zero(w, msize);
-	MP_NORMALIZE(m, msize);
-	ASSERT(msize == ctx->k);
-
-	if (msize == 1 && m[0] == 1) /* Anything mod 1 is zero. */
-		return;
-
-	MP_NORMALIZE(u, usize);
-	if (usize == 0 || exponent == 0) {
-		w[0] = (usize != 0);
-		return;
-	}
-
-	if (exponent == 1) {
-		mp_mod(u, usize, m, msize, w);
-		return;
-	}
-
-	if (exponent == 2) {
-		tsize = usize * 2;
-		t = MP_TMP_ALLOC(tsize);
-		mp_sqr(u, usize, t);
-		mp_mod(t, tsize, m, msize, w);
-		MP_TMP_FREE(t);
-		return;
-	}
-
-	/* Precompute W = U mod M */
-	mp_mod(u, usize, m, msize, w);
-	umod_size = mp_rsize(w, msize);
-	if (umod_size == 0) {
-		/* If U is congruent to 0 mod M, the final answer is zero. */
-		return;
-	}
-
-	/* With exponent of the form 2^K, we never have to multiply by U mod M. */
-	tsize = msize * 2;
-	if (exponent & (exponent - 1)) {
-		t = MP_TMP_ALLOC(tsize + umod_size);
-		umod = t + tsize;
-		mp_copy(w, umod_size, umod);
-	} else {
-		t = MP_TMP_ALLOC(tsize);
-		umod = NULL;
-	}
-
-	uint64_t k = exponent;
-	for (i = 0; k != 1; i++)
-		k >>= 1;
-	k <<= i;		/* exponent mask. */
-
-	while (k >>= 1) {
-		mp_sqr(w, msize, t);
-		barrett_reduce(t, ctx, w);
-		if (exponent & k) {
-			mp_mul(w, msize, umod, umod_size, t);
-			/* Barrett reduction requires T be twice as large as M, so clear
-			 * high digits if needed. */
-			if (msize - umod_size)
-				mp_zero(t + msize + umod_size, msize - umod_size);
-			barrett_reduce(t, ctx, w);
-		}
-	}
-
-	MP_TMP_FREE(t);
+    mp_digit p[(8 + MP_DIGIT_SIZE - 1) / MP_DIGIT_SIZE];
+    mp_size psize = 0;
+#if MP_DIGIT_SIZE >= 8
+    p[psize++] = (mp_digit)exponent;
+#else
+    for (; psize < sizeof(p) / sizeof(p[0]); psize++) {
+	p[psize] = (mp_digit)exponent;
+	exponent >>= MP_DIGIT_BITS;
+    }
+#endif
+    mp_barrett(u, usize, p, psize, ctx, w);
 }
 
-
 /* Barrett modular reduction.  This implementation follows from algorithm 14.42
  * in "Handbook of Applied Cryptography" pp.603-604
  *
  * Input: x[0..2k-1], m[0..k-1], and mu[0..k] = (b^(2k))/m
  * Output: r[0..k-1] = x mod m */
-static void
-barrett_reduce(const mp_digit *x, const mp_barrett_ctx *ctx, mp_digit *r)
+void
+mp_barrett_reduce(const mp_digit *x, const mp_barrett_ctx *ctx, mp_digit *r)
 {
 	const mp_size k = ctx->k;
 	const mp_digit *m = ctx->m;
@@ -249,11 +335,11 @@ barrett_reduce(const mp_digit *x, const mp_barrett_ctx *ctx, mp_digit *r)
 
 	/* Step 4. */
 	/* While r >= m, r -= m (will repeat at most twice) */
-	if (mp_cmp(r2, rsize, m, k) > 0) {
+	if (mp_cmp(r2, rsize, m, k) >= 0) {
 		mp_digit cy = mp_subi(r2, rsize, m, k);
 		ASSERT(cy == 0);
 		MP_NORMALIZE(r2, rsize);
-		if (mp_cmp(r2, rsize, m, k) > 0) {
+		if (mp_cmp(r2, rsize, m, k) >= 0) {
 			cy = mp_subi(r2, rsize, m, k);
 			ASSERT(cy == 0);
 		}
@@ -263,3 +349,33 @@ barrett_reduce(const mp_digit *x, const mp_barrett_ctx *ctx, mp_digit *r)
 	mp_copy(r2, k, r);
 	MP_TMP_FREE(q2);
 }
+
+/* Reduce U from the top: first its leading digits, up to 2k of them, then K
+ * digits at a time. With R < M < B^k, R B^k + the next K digits of U is below
+ * B^2k, as mp_barrett_reduce() requires. */
+void
+mp_barrett_mod(const mp_digit *u, mp_size usize, const mp_barrett_ctx *ctx,
+	       mp_digit *r)
+{
+    ASSERT(u != NULL);
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->mu != NULL);
+    ASSERT(r != NULL);
+
+    const mp_size k = ctx->k;
+    mp_digit *t = mp_new(k * 2);
+    MP_NORMALIZE(u, usize);
+    mp_size top = usize % k;
+    if (top == 0)
+	top = k;
+    top = usize - MIN(usize, top + k);
+    mp_copy(u + top, usize - top, t);
+    mp_zero(t + (usize - top), k * 2 - (usize - top));
+    mp_barrett_reduce(t, ctx, r);
+    for (; top != 0; top -= k) {
+	mp_copy(u + top - k, k, t);
+	mp_copy(r, k, t + k);
+	mp_barrett_reduce(t, ctx, r);
+    }
+    mp_free(t);
+}
@@ -0,0 +1,214 @@
+/* mp_bpsw.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Odd primes tried as divisors first; N is known to be prime if it is less
+ * than the square of the last. */
+static const uint8_t small_primes[] = {
+    3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47
+};
+
+/* Set d[*dsize] = U / 2^S, for the K-digit U with S trailing zero bits, and
+ * return S. */
+static unsigned
+odd_part(const mp_digit *u, mp_size k, mp_digit *d, mp_size *dsize)
+{
+    const unsigned s = mp_odd_shift(u, k);
+    *dsize = k - s / MP_DIGIT_BITS;
+    mp_copy(u + s / MP_DIGIT_BITS, *dsize, d);
+    mp_rshifti(d, *dsize, s % MP_DIGIT_BITS);
+    *dsize = mp_rsize(d, *dsize);
+    return s;
+}
+
+/* The strong test to base 2: with N - 1 = 2^S D, D odd, either 2^D = 1, or
+ * 2^(2^R D) = -1 for some R < S. */
+static bool
+strong_base2(const mp_mont_ctx *ctx, const mp_digit *one,
+	     const mp_digit *minus_one, mp_digit *d, mp_digit *x)
+{
+    const mp_size k = ctx->k;
+    mp_size dsize;
+    mp_copy(ctx->m, k, x);
+    x[0]--;
+    const unsigned s = odd_part(x, k, d, &dsize);
+
+    mp_modadd(one, one, ctx->m, k, x);
+    mp_mont_exp(x, d, dsize, ctx, x);
+    if (mp_cmp_n(x, one, k) == 0 || mp_cmp_n(x, minus_one, k) == 0)
+	return true;
+    for (unsigned r = 1; r < s; r++) {
+	mp_mont_sqr(x, ctx, x);
+	if (mp_cmp_n(x, minus_one, k) == 0)
+	    return true;
+	if (mp_cmp_n(x, one, k) == 0)
+	    return false;
+    }
+    return false;
+}
+
+/* W = U^2 - 2 V, for the doubling of Lucas sequences. T has room for K
+ * digits. */
+static void
+sqr_sub2(const mp_digit *u, const mp_digit *v, const mp_mont_ctx *ctx,
+	 mp_digit *t, mp_digit *w)
+{
+    mp_modadd(v, v, ctx->m, ctx->k, t);
+    mp_mont_sqr(u, ctx, w);
+    mp_modsub(w, t, ctx->m, ctx->k, w);
+}
+
+/* Q is multiplied in by a single-digit product and subtractions of N, rather
+ * than a Montgomery product, if |Q| is at most this. */
+#define SMALL_Q		64
+
+/* W = Q U, with Q = (NEG ? -ABSQ : ABSQ) and MQ its Montgomery form. T has
+ * room for K + 1 digits. */
+static void
+mul_q(const mp_digit *u, mp_digit absq, bool neg, const mp_digit *mq,
+      const mp_mont_ctx *ctx, mp_digit *t, mp_digit *w)
+{
+    const mp_size k = ctx->k;
+    if (absq > SMALL_Q) {
+	mp_mont_mul(u, mq, ctx, w);
+	return;
+    }
+    t[k] = mp_dmul(u, k, absq, t);
+    while (t[k] != 0 || mp_cmp_n(t, ctx->m, k) >= 0)
+	t[k] -= mp_subi_n(t, ctx->m, k);
+    if (neg && !mp_is_zero(t, k))
+	mp_sub_n(ctx->m, t, k, w);
+    else
+	mp_copy(t, k, w);
+}
+
+/* The strong Lucas test with P = 1 and Q = (1 - D) / 4, given as for mul_q().
+ * With N + 1 = 2^S D', either U_D' = 0 or V_(2^R D') = 0 for some R < S,
+ * where TMP has room for 6K + 1 digits. The chain carries V_K, V_(K+1) and
+ * Q^K up the bits of D':
+ *
+ *   V_2K = V_K^2 - 2 Q^K,  V_(2K+1) = V_K V_(K+1) - P Q^K,
+ *
+ * and as D U_K = 2 V_(K+1) - P V_K, U_D' = 0 is checked without U. */
+static bool
+strong_lucas(const mp_mont_ctx *ctx, const mp_digit *one,
+	     const mp_digit *minus_one, mp_digit absq, bool neg,
+	     const mp_digit *mq, mp_digit *tmp)
+{
+    /* For Q = -1, as for D = 5, Q^2K = 1 and Q^(2K+1) = -1. */
+    const bool q_minus_one = neg && absq == 1;
+    const mp_size k = ctx->k;
+    mp_digit *d = tmp, *v = d + k, *v1 = v + k, *qk = v1 + k;
+    mp_digit *u = qk + k, *t = u + k;
+
+    mp_size dsize;
+    mp_copy(ctx->m, k, u);
+    /* N + 1 fits: N = B^K - 1 would be divisible by 3. */
+    ASSERT(mp_inc(u, k) == 0);
+    const unsigned s = odd_part(u, k, d, &dsize);
+
+    mp_modadd(one, one, ctx->m, k, v);
+    mp_copy(one, k, v1);
+    mp_copy(one, k, qk);
+    for (unsigned i = mp_significant_bits(d, dsize); i-- > 0; ) {
+	/* T = V_(2K+1) */
+	mp_mont_mul(v, v1, ctx, t);
+	mp_modsub(t, qk, ctx->m, k, t);
+	if ((d[i / MP_DIGIT_BITS] >> (i % MP_DIGIT_BITS)) & 1) {
+	    mp_copy(t, k, v);
+	    mul_q(qk, absq, neg, mq, ctx, t, u);
+	    sqr_sub2(v1, u, ctx, t, v1);
+	    if (q_minus_one)
+		mp_copy(minus_one, k, qk);
+	    else
+		mp_mont_mul(qk, u, ctx, qk);
+	} else {
+	    sqr_sub2(v, qk, ctx, u, v);
+	    mp_copy(t, k, v1);
+	    if (q_minus_one)
+		mp_copy(one, k, qk);
+	    else
+		mp_mont_sqr(qk, ctx, qk);
+	}
+    }
+
+    mp_modadd(v1, v1, ctx->m, k, t);
+    if (mp_cmp_n(t, v, k) == 0 || mp_is_zero(v, k))
+	return true;
+    for (unsigned r = 1; r < s; r++) {
+	sqr_sub2(v, qk, ctx, t, v);
+	if (mp_is_zero(v, k))
+	    return true;
+	mp_mont_sqr(qk, ctx, qk);
+    }
+    return false;
+}
+
+/* Baillie-PSW: a strong probable prime test to base 2, then a strong Lucas
+ * test with parameters chosen by Selfridge's method A, the first D in 5, -7,
+ * 9, -11, ... with (D/N) = -1. The two tests fail on largely different
+ * composites, and none is known to pass both. The Lucas chain takes two or
+ * three Montgomery products per bit, so that the whole test costs three to
+ * four modular exponentiations. See Baillie & Wagstaff, "Lucas
+ * Pseudoprimes," Math. Comp. 35 (1980). */
+bool
+mp_bpsw(const mp_digit *n, mp_size nsize)
+{
+    ASSERT(n != NULL);
+
+    MP_NORMALIZE(n, nsize);
+    if (nsize == 0 || (nsize == 1 && n[0] < 2))
+	return false;
+    if ((n[0] & 1) == 0)
+	return nsize == 1 && n[0] == 2;
+    for (unsigned i = 0; i < sizeof(small_primes); i++) {
+	if (nsize == 1 && n[0] < (mp_digit)small_primes[i] * small_primes[i])
+	    return true;
+	if (mp_dmod(n, nsize, small_primes[i]) == 0)
+	    return nsize == 1 && n[0] == small_primes[i];
+    }
+    if (nsize == 1)
+	return mp_digit_is_prime(n[0]);
+
+    const mp_size k = nsize;
+    mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+    mp_mont_ctx_init(&ctx, n, k);
+    mp_digit *one = MP_TMP_ALLOC(k * 9 + 1);
+    mp_digit *minus_one = one + k, *mq = minus_one + k, *tmp = mq + k;
+    const mp_digit d1 = 1;
+    mp_mont_to(&d1, 1, &ctx, one);
+    ASSERT(mp_sub_n(n, one, k, minus_one) == 0);
+
+    bool prime = strong_base2(&ctx, one, minus_one, tmp, tmp + k);
+    if (prime) {
+	/* Selfridge's D; none exists for squares, which are rare enough to
+	 * be looked for only after a few tries. */
+	mp_digit absd = 5;
+	bool neg = false;
+	for (;; absd += 2, neg = !neg) {
+	    int j = mp_jacobi(&absd, 1, n, k);
+	    if (neg && (n[0] & 3) == 3)
+		j = -j;
+	    if (j < 0)
+		break;
+	    if (j == 0 || (absd == 13 && mp_perfsqr(n, k))) {
+		prime = false;
+		break;
+	    }
+	}
+	if (prime) {
+	    /* Q = (1 - D) / 4 */
+	    const mp_digit absq = neg ? (absd + 1) / 4 : (absd - 1) / 4;
+	    mp_mont_to(&absq, 1, &ctx, mq);
+	    if (!neg)
+		ASSERT(mp_sub_n(n, mq, k, mq) == 0);
+	    prime = strong_lucas(&ctx, one, minus_one, absq, !neg, mq, tmp);
+	}
+    }
+
+    MP_TMP_FREE(one);
+    mp_mont_ctx_free(&ctx);
+    return prime;
+}
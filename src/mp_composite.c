@@ -4,6 +4,162 @@
 #include "mp.h"
 #include "mp_internal.h"
 
+/* Bases for which Miller-Rabin is known to be correct: {2, 3} below 1373653,
+ * Jaeschke's {2, 7, 61} below 4759123141, and Sinclair's seven bases for all
+ * of 2^64. */
+#if MP_DIGIT_SIZE == 8
+static const mp_digit sinclair_bases[] = {
+    2, 325, 9375, 28178, 450775, 9780504, 1795265022
+};
+#endif
+#if MP_DIGIT_SIZE >= 4
+static const mp_digit jaeschke_bases[] = { 2, 7, 61 };
+#else
+static const mp_digit small_bases[] = { 2, 3 };
+#endif
+
+/* Return U V / B mod N, for the odd N with ninv = -N^-1 mod B. */
+static inline mp_digit
+digit_mont_mul(mp_digit u, mp_digit v, mp_digit n, mp_digit ninv)
+{
+    mp_digit hi, lo, mh, ml;
+    digit_mul(u, v, hi, lo);
+    digit_mul((mp_digit)(lo * ninv), n, mh, ml);
+    (void)ml;
+    /* LO + ML = 0 (mod B), with a carry unless LO is 0. The sum below is less
+     * than 2N; it wraps around at most once, when it is at least B. */
+    const mp_digit t = hi + mh + (lo != 0);
+    return (t < hi || t >= n) ? t - n : t;
+}
+
+bool
+mp_digit_is_prime(mp_digit n)
+{
+    if (n < 2)
+	return false;
+    if ((n & 1) == 0)
+	return n == 2;
+    if (n < 9)
+	return true;
+
+    /* N - 1 = 2^S D, D odd. */
+    const unsigned s = mp_digit_lsb_shift(n - 1);
+    const mp_digit d = (n - 1) >> s;
+    const mp_digit ninv = -mp_digit_invert(n);
+    const mp_digit one = (mp_digit)-n % n;	/* B mod N */
+    const mp_digit minus_one = n - one;
+
+#if MP_DIGIT_SIZE == 8
+    const bool large = n >= 4759123141ULL;
+    const mp_digit *bases = large ? sinclair_bases : jaeschke_bases;
+    const unsigned nbases = large ? 7 : 3;
+#elif MP_DIGIT_SIZE == 4
+    const mp_digit *bases = jaeschke_bases;
+    const unsigned nbases = 3;
+#else
+    const mp_digit *bases = small_bases;
+    const unsigned nbases = 2;
+#endif
+    for (unsigned i = 0; i < nbases; i++) {
+	const mp_digit a = bases[i] % n;
+	if (a == 0)
+	    continue;
+
+	/* X = A B mod N, and Y = X^D in Montgomery form. */
+	mp_digit x, y = one, q;
+	digit_div(a, 0, n, q, x);
+	(void)q;
+	for (unsigned b = mp_digit_log2(d) + 1; b-- > 0; ) {
+	    y = digit_mont_mul(y, y, n, ninv);
+	    if ((d >> b) & 1)
+		y = digit_mont_mul(y, x, n, ninv);
+	}
+	if (y == one || y == minus_one)
+	    continue;
+	unsigned r = 1;
+	for (; r < s; r++) {
+	    y = digit_mont_mul(y, y, n, ninv);
+	    if (y == minus_one)
+		break;
+	}
+	if (r == s)
+	    return false;
+    }
+    return true;
+}
+
+/* Miller-Rabin to the first K prime bases is correct for all N below psi_K,
+ * per Jaeschke, "On strong pseudoprimes to several bases," Math. Comp. 61
+ * (1993), and Sorenson & Webster, Math. Comp. 86 (2017). */
+static const uint8_t prime_bases[] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41
+};
+static const struct {
+    uint64_t	hi, lo;
+} psi[] = {
+    { 0, 2047ULL },
+    { 0, 1373653ULL },
+    { 0, 25326001ULL },
+    { 0, 3215031751ULL },
+    { 0, 2152302898747ULL },
+    { 0, 3474749660383ULL },
+    { 0, 341550071728321ULL },
+    { 0, 341550071728321ULL },
+    { 0, 3825123056546413051ULL },
+    { 0, 3825123056546413051ULL },
+    { 0, 3825123056546413051ULL },
+    { 0x437aULL, 0xe92817f9fc85b7e5ULL },	/* 318665857834031151167461 */
+    { 0x2be69ULL, 0x51adc5b22410a5fdULL },	/* 3317044064679887385961981 */
+};
+
+/* Return how many of the prime bases make Miller-Rabin deterministic for
+ * u[size], or 0 if it is too large for that. */
+static unsigned
+deterministic_bases(const mp_digit *u, mp_size size)
+{
+    if (mp_significant_bits(u, size) > 128)
+	return 0;
+
+    uint64_t hi = 0, lo = 0;
+    for (mp_size i = 0; i < size; i++) {
+	const unsigned pos = i * MP_DIGIT_BITS;
+	if (pos < 64)
+	    lo |= (uint64_t)u[i] << pos;
+	else
+	    hi |= (uint64_t)u[i] << (pos - 64);
+    }
+    for (unsigned k = 0; k < sizeof(psi) / sizeof(psi[0]); k++) {
+	if (hi < psi[k].hi || (hi == psi[k].hi && lo < psi[k].lo))
+	    return k + 1;
+    }
+    return 0;
+}
+
+/* Return true if X is a witness to the compositeness of N, the modulus of
+ * CTX, where N - 1 = 2^S Q. Y has room for K digits. */
+static bool
+witness(const mp_digit *x, mp_size xsize, const mp_mont_ctx *ctx,
+	const mp_digit *one, const mp_digit *minus_one,
+	const mp_digit *q, mp_size qsize, unsigned s, mp_digit *y)
+{
+    const mp_size k = ctx->k;
+
+    /* Y = X^Q mod N */
+    mp_mont_to(x, xsize, ctx, y);
+    mp_mont_exp(y, q, qsize, ctx, y);
+    if (mp_cmp_n(y, one, k) == 0 || mp_cmp_n(y, minus_one, k) == 0)
+	return false;
+
+    for (unsigned j = 1; j < s; j++) {
+	mp_mont_sqr(y, ctx, y);
+	if (mp_cmp_n(y, minus_one, k) == 0)
+	    return false;
+	if (mp_cmp_n(y, one, k) == 0)
+	    return true;
+    }
+    return true;
+}
+
 /* Knuth 4.5.4P: use a variant of the Miller-Rabin probabilistic procedure to
  * test the integer N for compositeness. It will never incorrectly identify a
  * prime as composite, but it may incorrectly identify a composite as prime.
@@ -13,9 +169,14 @@
  * more minute. It usually makes sense to first test N for divisibility by
  * small primes using mp_sieve() before calling this function.
  *
+ * Below 3.3 * 10^24, the rounds are instead taken to the bases above that
+ * make the answer exact, and single digits take the path above. All rounds
+ * share one Montgomery context for N.
+ *
  * Return true if N is composite, otherwise false if N is "probably" prime. */
 bool
-mp_composite(const mp_digit *n, mp_size nsize, unsigned rounds)
+mp_composite_ctx(const mp_digit *n, mp_size nsize, unsigned rounds,
+		 mt64_context *rand_ctx)
 {
     MP_NORMALIZE(n, nsize);
     if (!nsize)				/* Call 0 prime. */
@@ -23,69 +184,56 @@ mp_composite(const mp_digit *n, mp_size nsize, unsigned rounds)
     if (nsize == 1) {
 	if (n[0] <= 3)
 	    return false;	/* Call 0, 1, 2, and 3 prime. */
+	return !mp_digit_is_prime(n[0]);
     }
     if ((n[0] & 1) == 0) {
 	return true;		/* Call even numbers composite. */
     }
+    const unsigned bases = deterministic_bases(n, nsize);
+    if (bases != 0)
+	rounds = bases;
     if (rounds == 0)		/* Nuthin' doin' */
 	return true;
 
-    /* Find K and Q such that N = (2^K) * Q + 1, Q odd.
-     * Assumes that it is safe to modify N. */
-    --*(mp_digit *)n; /* Can't underflow: N odd. */
-    const unsigned odd_shift = mp_odd_shift(n, nsize);
+    mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+    mp_mont_ctx_init(&ctx, n, nsize);
+    mp_digit *one = MP_TMP_ALLOC(nsize * 5);
+    mp_digit *minus_one = one + nsize, *q = minus_one + nsize;
+    mp_digit *x = q + nsize, *y = x + nsize;
+    const mp_digit d1 = 1;
+    mp_mont_to(&d1, 1, &ctx, one);
+    ASSERT(mp_sub_n(n, one, nsize, minus_one) == 0);
+
+    /* Find K and Q such that N = (2^K) * Q + 1, Q odd. */
+    mp_copy(n, nsize, x);
+    --x[0]; /* Can't underflow: N odd. */
+    const unsigned odd_shift = mp_odd_shift(x, nsize);
     const mp_size qsize = nsize - odd_shift / MP_DIGIT_BITS;
-    mp_digit *q = MP_TMP_ALLOC(qsize);
-    if (odd_shift % MP_DIGIT_BITS) {
-	ASSERT(mp_rshift(n + odd_shift / MP_DIGIT_BITS, qsize,
-			 odd_shift % MP_DIGIT_BITS, q) == 0);
-    } else {
-	mp_copy(n + odd_shift / MP_DIGIT_BITS, qsize, q);
-    }
-    ++*(mp_digit *)n;
-
-    mp_digit *y = MP_TMP_ALLOC(nsize * 3); /* x will store y^2 */
-    mp_digit *x = y + nsize;
-    for (unsigned r = 0; r < rounds; r++) {
-	/* Generate X so 1 < X < N */
-	unsigned xsize = nsize - (rand() % nsize);
-	ASSERT(xsize);
-	mp_rand(x, xsize);
-	if (xsize == nsize && x[xsize - 1] >= n[xsize - 1])
-	    xsize -= ((x[xsize - 1] -= n[xsize - 1]) == 0);
-
-	/* Y = X^Q mod N */
-	mp_mexp(x, xsize, q, qsize, n, nsize, y);
-
-	for (unsigned j = odd_shift; j; --j) {
-	    mp_size ysize = mp_rsize(y, nsize);
-	    /* If J = 0 and Y = 1, prime. */
-	    if (j == 0 && ysize == 1 && y[0] == 1) {
-		MP_TMP_FREE(y);
-		MP_TMP_FREE(q);
-		return false;
-	    }
+    mp_copy(x + odd_shift / MP_DIGIT_BITS, qsize, q);
+    mp_rshifti(q, qsize, odd_shift % MP_DIGIT_BITS);
 
-	    /* If Y = N - 1 (Y + 1 == N), prime. */
-	    if (mp_inc(y, ysize))
-		y[ysize++] = 1;
-	    if (ysize == nsize && mp_cmp_n(y, n, ysize) == 0) {
-		MP_TMP_FREE(y);
-		MP_TMP_FREE(q);
-		return false;
+    bool composite = false;
+    for (unsigned r = 0; r < rounds && !composite; r++) {
+	mp_size xsize = nsize;
+	if (bases != 0) {
+	    x[0] = prime_bases[r];
+	    xsize = 1;
+	} else {
+	    /* Generate X so 1 < X < N */
+	    mp_rand_digits(rand_ctx, x, nsize);
+	    x[nsize - 1] %= n[nsize - 1];
+	    xsize = mp_rsize(x, nsize);
+	    if (xsize == 0 || (xsize == 1 && x[0] == 1)) {
+		x[0] = 2;
+		xsize = 1;
 	    }
-	    mp_dec(y, ysize);
-	    ysize -= (y[ysize - 1] == 0);
-
-	    /* Y = Y^2 mod N. */
-	    mp_sqr(y, ysize, x);
-	    mp_modi(x, ysize * 2, n, nsize);
-	    mp_copy(x, nsize, y);
 	}
+	composite = witness(x, xsize, &ctx, one, minus_one, q, qsize,
+			    odd_shift, y);
     }
 
-    MP_TMP_FREE(y);
-    MP_TMP_FREE(q);
+    MP_TMP_FREE(one);
+    mp_mont_ctx_free(&ctx);
 
-    return true;
+    return composite;
 }
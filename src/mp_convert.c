@@ -402,11 +402,13 @@ mp_get_str(const mp_digit *u, mp_size size, unsigned radix, char *out)
     } else {
 	mp_digit *tmp = MP_TMP_COPY(u, size);
 	mp_size tsize = size;
+	mp_dinv_ctx ctx;
+	mp_dinv_ctx_init(&ctx, max_radix);
 
 	do {
 	    /* Multi-precision: divide U by largest power of RADIX to fit in
 	     * one mp_digit and extract remainder. */
-	    mp_digit r = mp_ddivi(tmp, tsize, max_radix);
+	    mp_digit r = mp_ddivi_preinv(tmp, tsize, &ctx);
 	    tsize -= (tmp[tsize - 1] == 0);
 	    /* Single-precision: extract K remainders from that remainder,
 	     * where K is the largest integer such that RADIX^K < 2^BITS. */
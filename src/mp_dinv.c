@@ -0,0 +1,125 @@
+/* mp_dinv.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Division by a single digit using a precomputed reciprocal, from Möller &
+ * Granlund, "Improved division by invariant integers," IEEE Transactions on
+ * Computers 60(2), 2011. For a normalized divisor D (most significant bit set),
+ * the reciprocal is V = floor((B^2 - 1) / D) - B, and each two-by-one digit
+ * division costs one digit multiplication, one low-half multiplication and a
+ * couple of adjustments instead of a hardware divide. */
+
+void
+mp_dinv_ctx_init(mp_dinv_ctx *ctx, mp_digit d)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(d != 0);
+
+    ctx->d = d;
+    ctx->shift = mp_digit_msb_shift(d);
+    ctx->dnorm = d << ctx->shift;
+    /* B^2 - 1 - B*D = (B - 1 - D)*B + (B - 1), and B - 1 - D < D. */
+    mp_digit v, r;
+    digit_div((mp_digit)~ctx->dnorm, MP_DIGIT_MAX, ctx->dnorm, v, r);
+    (void)r;
+    ctx->inv = v;
+}
+
+/* Divide U1*B + U0 by the normalized divisor D with reciprocal V; U1 < D.
+ * Store the quotient in Q and return the remainder. */
+static inline mp_digit
+div_2by1(mp_digit u1, mp_digit u0, mp_digit d, mp_digit v, mp_digit *q)
+{
+    mp_digit q1, q0;
+    digit_mul(v, u1, q1, q0);
+    q0 += u0;
+    q1 += u1 + 1 + (q0 < u0);
+    mp_digit r = u0 - q1 * d;
+    /* This adjustment is needed about half the time, so avoid a branch. */
+    const mp_digit mask = -(mp_digit)(r > q0);
+    q1 += mask;
+    r += mask & d;
+    if (r >= d) {	/* Very unlikely. */
+	q1++;
+	r -= d;
+    }
+    *q = q1;
+    return r;
+}
+
+/* Set u[size] = u[size] / D and return the remainder. The dividend is
+ * shifted left on the fly by the same amount as D, so the partial remainder
+ * is always less than the normalized divisor. */
+mp_digit
+mp_ddivi_preinv(mp_digit *u, mp_size size, const mp_dinv_ctx *ctx)
+{
+    ASSERT(u != NULL);
+    ASSERT(ctx != NULL);
+
+    MP_NORMALIZE(u, size);
+    if (!size)
+	return 0;
+
+    const unsigned shift = ctx->shift;
+    const mp_digit d = ctx->dnorm, v = ctx->inv;
+    mp_digit r, q;
+    if (shift == 0) {
+	r = 0;
+	do {
+	    --size;
+	    r = div_2by1(r, u[size], d, v, &q);
+	    u[size] = q;
+	} while (size);
+	return r;
+    }
+
+    const unsigned rshift = MP_DIGIT_BITS - shift;
+    r = u[size - 1] >> rshift;
+    mp_digit hi = u[size - 1];
+    while (--size) {
+	const mp_digit lo = u[size - 1];
+	r = div_2by1(r, (hi << shift) | (lo >> rshift), d, v, &q);
+	u[size] = q;
+	hi = lo;
+    }
+    r = div_2by1(r, hi << shift, d, v, &q);
+    u[0] = q;
+    return r >> shift;
+}
+
+/* Return u[size] mod D, as above but without storing the quotient digits. */
+mp_digit
+mp_dmod_preinv(const mp_digit *u, mp_size size, const mp_dinv_ctx *ctx)
+{
+    ASSERT(u != NULL);
+    ASSERT(ctx != NULL);
+
+    MP_NORMALIZE(u, size);
+    if (!size)
+	return 0;
+
+    const unsigned shift = ctx->shift;
+    const mp_digit d = ctx->dnorm, v = ctx->inv;
+    mp_digit r, q;
+    if (shift == 0) {
+	r = 0;
+	do {
+	    r = div_2by1(r, u[--size], d, v, &q);
+	} while (size);
+	return r;
+    }
+
+    const unsigned rshift = MP_DIGIT_BITS - shift;
+    r = u[size - 1] >> rshift;
+    mp_digit hi = u[size - 1];
+    while (--size) {
+	const mp_digit lo = u[size - 1];
+	r = div_2by1(r, (hi << shift) | (lo >> rshift), d, v, &q);
+	hi = lo;
+    }
+    r = div_2by1(r, hi << shift, d, v, &q);
+    (void)q;
+    return r >> shift;
+}
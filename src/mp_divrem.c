@@ -53,7 +53,8 @@ mp_norm_div(mp_digit *u, mp_size usize,
 }
 
 /* Divide u[usize] by v[vsize], storing the result in q[usize - vsize + 1], and
- * remainder in r[vsize]. v[vsize - 1] must NOT be zero if q != NULL. */
+ * remainder in r[vsize]. v[vsize - 1] must NOT be zero if q != NULL. If only
+ * the remainder is wanted, U may be shorter than V. */
 void
 mp_divrem(const mp_digit *u, mp_size usize,
 		  const mp_digit *v, mp_size vsize, mp_digit *q, mp_digit *r)
@@ -63,7 +64,7 @@ mp_divrem(const mp_digit *u, mp_size usize,
     ASSERT(v != NULL);
     ASSERT(vsize > 0);
     ASSERT(v[vsize - 1] != 0);
-    ASSERT(usize >= vsize);
+    ASSERT(q == NULL || usize >= vsize);
 
     if (!q && !r) /* Nothing to do. */
 	return;
@@ -75,12 +76,6 @@ mp_divrem(const mp_digit *u, mp_size usize,
 	mp_zero(q, usize - vsize + 1);
     MP_NORMALIZE(u, usize);
 
-    if (usize < vsize) {
-	ASSERT(q == NULL);
-	if (r != NULL)
-	    mp_copy(u, usize, r);
-    }
-
     /* Compare numbers. */
     const int cmp = mp_cmp(u, usize, v, vsize);
     if (cmp == 0) {
@@ -95,6 +90,23 @@ mp_divrem(const mp_digit *u, mp_size usize,
 	return;
     }
 
+    if (mp_is_pow2(v, vsize)) {
+	/* Dividing by 2^K is a shift; the remainder is the low K bits. */
+	const mp_digit vtop = v[vsize - 1];
+	if (q != NULL) {
+	    const unsigned shift = mp_digit_log2(vtop);
+	    if (shift)
+		mp_rshift(u + vsize - 1, usize - vsize + 1, shift, q);
+	    else
+		mp_copy(u + vsize - 1, usize - vsize + 1, q);
+	}
+	if (r != NULL) {
+	    mp_copy(u, vsize, r);
+	    r[vsize - 1] &= vtop - 1;
+	}
+	return;
+    }
+
     if (vsize == 1) {
 	/* If VLEN == 1 we can divide in linear time (see exercise 16). */
 	if (q != NULL) {
@@ -0,0 +1,181 @@
+/* mp_fixedbase.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Upper bounds on the comb parameters: H teeth, V blocks, and the total number
+ * of table entries V * (2^H - 1), each of which takes ctx->mont.k digits. */
+#ifndef FIXEDBASE_MAX_TEETH
+# define FIXEDBASE_MAX_TEETH	8
+#endif /* !FIXEDBASE_MAX_TEETH */
+#ifndef FIXEDBASE_MAX_BLOCKS
+# define FIXEDBASE_MAX_BLOCKS	4
+#endif /* !FIXEDBASE_MAX_BLOCKS */
+#ifndef FIXEDBASE_MAX_ENTRIES
+# define FIXEDBASE_MAX_ENTRIES	128
+#endif /* !FIXEDBASE_MAX_ENTRIES */
+
+/* Fixed-base comb exponentiation, from Lim & Lee, "More flexible exponentiation
+ * with precomputation," CRYPTO '94 (algorithm 14.117 in "Handbook of Applied
+ * Cryptography").
+ *
+ * An exponent X of at most L bits is written as an H x A bit matrix, A =
+ * ceil(L/H), whose row t holds bits t*A .. t*A + A-1 of X. The A columns are
+ * split into V blocks of B = ceil(A/V) columns. With
+ *
+ *   G[j][i] = prod { G^(2^(t*A + j*B)) : bit t of i is set },  0 < i < 2^H,
+ *
+ * column c of block j selects the entry G[j][i] whose index i is made up of
+ * the bits of X in that column. So
+ *
+ *   G^X = prod_{c = B-1 .. 0} (prod_{j < V} G[j][I(j, c)])^(2^c),
+ *
+ * which takes B - 1 squarings and at most A multiplications, against roughly
+ * L squarings and L / (w + 1) multiplications for a w-bit sliding window. */
+
+/* Number of multiplications (counting a squaring as one) per exponent. */
+static unsigned
+comb_cost(unsigned bits, unsigned h, unsigned v)
+{
+    const unsigned a = (bits + h - 1) / h;
+    const unsigned b = (a + v - 1) / v;
+    /* Each of the A lookups is nontrivial with probability 1 - 2^-H. */
+    return (b - 1) + (unsigned)(((uint64_t)a * ((1U << h) - 1)) >> h);
+}
+
+/* Choose the teeth and blocks with the lowest cost that fit in the table. */
+static void
+comb_params(unsigned bits, unsigned *hp, unsigned *vp)
+{
+    unsigned best_h = 1, best_v = 1, best = comb_cost(bits, 1, 1);
+    for (unsigned h = 1; h <= FIXEDBASE_MAX_TEETH; h++) {
+	for (unsigned v = 1; v <= FIXEDBASE_MAX_BLOCKS; v++) {
+	    if (v * ((1U << h) - 1) > FIXEDBASE_MAX_ENTRIES)
+		break;
+	    if (h > bits || v > (bits + h - 1) / h)
+		break;
+	    const unsigned cost = comb_cost(bits, h, v);
+	    if (cost < best) {
+		best = cost;
+		best_h = h;
+		best_v = v;
+	    }
+	}
+    }
+    *hp = best_h;
+    *vp = best_v;
+}
+
+void
+mp_fixedbase_ctx_init(mp_fixedbase_ctx *ctx,
+		      const mp_digit *g, mp_size gsize,
+		      const mp_digit *m, mp_size msize, unsigned max_bits)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->table == NULL);
+    ASSERT(g != NULL);
+    ASSERT(max_bits != 0);
+
+    mp_mont_ctx_init(&ctx->mont, m, msize);
+    const mp_size k = ctx->mont.k;
+
+    unsigned h, v;
+    comb_params(max_bits, &h, &v);
+    const unsigned a = (max_bits + h - 1) / h;
+    const unsigned b = (a + v - 1) / v;
+    const mp_size entries = (mp_size)1 << h;	/* Per block, minus one. */
+    ctx->bits = max_bits;
+    ctx->teeth = h;
+    ctx->blocks = v;
+    ctx->rows = a;
+    ctx->cols = b;
+    ctx->table = mp_new(v * (entries - 1) * k);
+
+#define ENTRY(j, i)	(ctx->table + ((j) * (entries - 1) + (i) - 1) * k)
+    /* G[0][2^t] = G^(2^(t*A)), in Montgomery form. */
+    mp_mont_to(g, gsize, &ctx->mont, ENTRY(0, 1));
+    for (unsigned t = 1; t < h; t++) {
+	mp_digit *e = ENTRY(0, (mp_size)1 << t);
+	mp_mont_sqr(ENTRY(0, (mp_size)1 << (t - 1)), &ctx->mont, e);
+	for (unsigned s = a - 1; s != 0; s--)
+	    mp_mont_sqr(e, &ctx->mont, e);
+    }
+    /* G[0][i] = G[0][i - 2^t] * G[0][2^t], 2^t the highest bit of I. */
+    for (mp_size i = 3; i < entries; i++) {
+	const mp_size top = (mp_size)1 << mp_digit_log2((mp_digit)i);
+	if (i != top)
+	    mp_mont_mul(ENTRY(0, i - top), ENTRY(0, top), &ctx->mont,
+			ENTRY(0, i));
+    }
+    /* G[j][i] = G[j-1][i]^(2^B). */
+    for (unsigned j = 1; j < v; j++) {
+	for (mp_size i = 1; i < entries; i++) {
+	    mp_digit *e = ENTRY(j, i);
+	    mp_mont_sqr(ENTRY(j - 1, i), &ctx->mont, e);
+	    for (unsigned s = b - 1; s != 0; s--)
+		mp_mont_sqr(e, &ctx->mont, e);
+	}
+    }
+#undef ENTRY
+}
+
+void
+mp_fixedbase_ctx_free(mp_fixedbase_ctx *ctx)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->table != NULL);
+
+    mp_mont_ctx_free(&ctx->mont);
+    mp_free(ctx->table);
+    ctx->table = NULL;
+    ctx->bits = ctx->teeth = ctx->blocks = ctx->rows = ctx->cols = 0;
+}
+
+void
+mp_fixedbase_exp(const mp_digit *x, mp_size xsize,
+		 const mp_fixedbase_ctx *ctx, mp_digit *w)
+{
+    ASSERT(x != NULL);
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->table != NULL);
+    ASSERT(w != NULL);
+
+    const mp_size k = ctx->mont.k;
+    const unsigned h = ctx->teeth, a = ctx->rows, b = ctx->cols;
+    const mp_size entries = (mp_size)1 << h;
+    const mp_digit *g = ctx->table;	/* G[0][1] = G, in Montgomery form. */
+
+    MP_NORMALIZE(x, xsize);
+    if (xsize == 0 || mp_significant_bits(x, xsize) > ctx->bits) {
+	/* Too large for the table (or zero); fall back on a plain power. */
+	mp_mont_exp(g, x, xsize, &ctx->mont, w);
+	mp_mont_from(w, &ctx->mont, w);
+	return;
+    }
+
+    bool first = true;
+    for (unsigned c = b; c-- > 0; ) {
+	if (!first)
+	    mp_mont_sqr(w, &ctx->mont, w);
+	for (unsigned j = ctx->blocks; j-- > 0; ) {
+	    const unsigned col = j * b + c;
+	    if (col >= a)
+		continue;
+	    mp_size i = 0;
+	    for (unsigned t = h; t-- > 0; )
+		i = (i << 1) | mp_exp_bit(x, xsize, t * a + col);
+	    if (i == 0)
+		continue;
+	    const mp_digit *e = ctx->table + (j * (entries - 1) + i - 1) * k;
+	    if (first) {
+		mp_copy(e, k, w);
+		first = false;
+	    } else {
+		mp_mont_mul(w, e, &ctx->mont, w);
+	    }
+	}
+    }
+    ASSERT(!first);
+    mp_mont_from(w, &ctx->mont, w);
+}
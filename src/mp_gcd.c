@@ -27,8 +27,38 @@ mp_digit_gcd(mp_digit u, mp_digit v)
     return u << shift;
 }
 
+/* Large operands are first reduced by the half-GCD algorithm (see mp_hgcd.c)
+ * to fewer than HGCD_THRESHOLD digits. */
+static void
+gcd_hgcd(const mp_digit *u, mp_size usize,
+	 const mp_digit *v, mp_size vsize, mp_digit *w)
+{
+    const int cmp = mp_cmp(u, usize, v, vsize);
+    if (cmp == 0) {
+	mp_copy(u, usize, w);
+	return;
+    }
+    if (cmp < 0) {
+	SWAP(u, v, const mp_digit *);
+	SWAP(usize, vsize, mp_size);
+    }
+
+    mp_digit *a = mp_dup(u, usize);
+    mp_digit *b = mp_dup(v, vsize);
+    mp_hgcd(a, &usize, b, &vsize, HGCD_THRESHOLD, NULL);
+    if (vsize == 0) {
+	mp_copy(a, usize, w);
+    } else {
+	mp_modi(a, usize, b, vsize);
+	mp_gcd(b, vsize, a, vsize, w);
+    }
+    mp_free(a);
+    mp_free(b);
+}
+
 /* Adapted from the binary GCD algorithm 4.5.2B by Knuth in The Art of Computer
- * Programming Vol.2 3rd ed. p.338.
+ * Programming Vol.2 3rd ed. p.338. Larger operands go to mp_lehmer() and
+ * gcd_hgcd() instead.
  *
  * The advantage of this algorithm is that it operates entirely without
  * division; it uses only the elementary operations of parity testing, shifting
@@ -59,6 +89,15 @@ mp_gcd(const mp_digit *u, mp_size usize,
 	return;
     }
 
+    if (MIN(usize, vsize) >= GCD_HGCD_THRESHOLD) {
+	gcd_hgcd(u, usize, v, vsize, w);
+	return;
+    }
+    if (MIN(usize, vsize) >= GCD_LEHMER_THRESHOLD) {
+	mp_lehmer(u, usize, v, vsize, w);
+	return;
+    }
+
     if (usize == 1 || vsize == 1) {
 	if (usize == 1 && vsize == 1) {
 	    w[0] = mp_digit_gcd(u[0], v[0]);
@@ -168,6 +207,8 @@ mp_coprime(const mp_digit *u, mp_size usize,
 	return vsize == 0;	/* XXX Is 0 relatively prime to itself? */
     else if (vsize == 0)
 	return false;
+    if (((u[0] | v[0]) & 1) == 0)
+	return false;	/* Both are even. */
 
     mp_size tsize = MIN(usize, vsize);
     mp_digit *tmp = MP_TMP_ALLOC(tsize);
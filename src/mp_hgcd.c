@@ -0,0 +1,338 @@
+/* mp_hgcd.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+#include "weecrypt_memory.h"
+
+#if HGCD_THRESHOLD < 4
+# error "HGCD_THRESHOLD must be at least 4"
+#endif
+
+/* Half-GCD, after Moller, "On Schonhage's algorithm and subquadratic integer
+ * GCD computation," Math. Comp. 77 (2008).
+ *
+ * The quotients of the Euclidean algorithm on A > B depend mostly on the
+ * leading digits of A and B. Writing A = A1 B^p + A0 and B = B1 B^p + B0, the
+ * quotient matrix M found by reducing A1 and B1 from 2s + 1 to s + 1 digits
+ * has entries of at most s digits, so
+ *
+ *   M^-1 (A B)' = B^p M^-1 (A1 B1)' + M^-1 (A0 B0)'
+ *
+ * differs from the reduced A1, B1 (shifted up by p digits) by less than B^(p+s),
+ * a digit less than their size: M is, but for its last few quotients, also the
+ * quotient matrix of A and B. Rather than bounding how many, we check: if
+ * (C D)' = M^-1 (A B)' has C > D >= 0, the continued fraction expansion
+ *
+ *   A/B = [q_1; q_2, ..., q_j, C/D]  with C/D > 1
+ *
+ * is unique, so M holds the true quotients. Otherwise the last quotient is
+ * taken back out of M and the check repeated.
+ *
+ * Each round of mp_hgcd() thus reduces an N-digit A by s = min(N - K, N/3)
+ * digits through a recursive call on 2s + 1 digits, for a cost of O(M(N) log N)
+ * with M(N) the cost of multiplication, against O(N^2) for Euclid. Below
+ * HGCD_THRESHOLD digits, Lehmer steps (see mp_lehmer.c) take over, with
+ * division steps for unbalanced operands and the last digit or so. */
+
+void
+mp_hgcd_matrix_init(mp_hgcd_matrix *m, mp_size alloc)
+{
+    ASSERT(m != NULL);
+    ASSERT(m->m[0][0] == NULL);
+    ASSERT(m->q == NULL);
+
+    m->alloc = alloc;
+    m->det = 1;
+    m->qcount = m->qalloc = 0;
+    if (alloc == 0) {
+	m->size = 0;
+	return;
+    }
+    mp_digit *e = mp_new0(4 * alloc);
+    m->m[0][0] = e;
+    m->m[0][1] = e + alloc;
+    m->m[1][0] = e + alloc * 2;
+    m->m[1][1] = e + alloc * 3;
+    m->m[0][0][0] = m->m[1][1][0] = 1;
+    m->size = 1;
+}
+
+void
+mp_hgcd_matrix_free(mp_hgcd_matrix *m)
+{
+    ASSERT(m != NULL);
+    ASSERT(m->m[0][0] != NULL || m->alloc == 0);
+
+    if (m->m[0][0] != NULL)
+	mp_free(m->m[0][0]);
+    if (m->q != NULL)
+	FREE(m->q);
+    m->m[0][0] = m->m[0][1] = m->m[1][0] = m->m[1][1] = NULL;
+    m->size = m->alloc = 0;
+    m->det = 0;
+    m->q = NULL;
+    m->qcount = m->qalloc = 0;
+}
+
+void
+mp_hgcd_matrix_log(mp_hgcd_matrix *m)
+{
+    ASSERT(m != NULL);
+    ASSERT(m->q == NULL);
+
+    m->qalloc = 64;
+    m->q = MALLOC(m->qalloc);
+    m->qcount = 0;
+}
+
+void
+mp_hgcd_matrix_log_q(mp_hgcd_matrix *m, mp_digit q)
+{
+    ASSERT(m != NULL);
+
+    if (m->q == NULL)
+	return;
+    if (m->qcount == m->qalloc) {
+	m->qalloc *= 2;
+	m->q = REALLOC(m->q, m->qalloc);
+    }
+    m->q[m->qcount++] = q & 7;
+}
+
+/* Store x[xsize] in the entry E, which had at most OLD digits. Return the
+ * normalized size of X. */
+static mp_size
+set_entry(mp_digit *e, mp_size old, const mp_digit *x, mp_size xsize,
+	  mp_size alloc)
+{
+    MP_NORMALIZE(x, xsize);
+    ASSERT(xsize <= alloc);
+    mp_copy(x, xsize, e);
+    if (xsize < old)
+	mp_zero(e + xsize, old - xsize);
+    return xsize;
+}
+
+/* M = M (q 1; 1 0). TMP has room for M->size + qsize + 1 digits. */
+static void
+matrix_mul_q(mp_hgcd_matrix *m, const mp_digit *q, mp_size qsize,
+	     mp_digit *tmp)
+{
+    mp_hgcd_matrix_log_q(m, q[0]);
+    m->det = -m->det;
+    if (m->alloc == 0)
+	return;
+
+    const mp_size n = m->size;
+    mp_size size = 0;
+    for (unsigned i = 0; i < 2; i++) {
+	/* (x y) -> (q x + y  x) */
+	mp_digit *x = m->m[i][0], *y = m->m[i][1];
+	mp_mul(x, n, q, qsize, tmp);
+	tmp[n + qsize] = mp_addi(tmp, n + qsize, y, n);
+	mp_copy(x, n, y);
+	size = MAX(size, set_entry(x, n, tmp, n + qsize + 1, m->alloc));
+    }
+    m->size = size;
+}
+
+/* Take the last quotient back out of M, which must not be the identity: with
+ * M = M' (q 1; 1 0), set M = M'. The first column of M' dominates the second,
+ * and does so strictly in at least one row, so q is the smaller of the
+ * quotients of the columns of M in each row. TMP has room for 3 * M->size + 2
+ * digits. */
+static void
+matrix_undo_q(mp_hgcd_matrix *m, mp_digit *tmp)
+{
+    const mp_size n = m->size;
+    mp_digit *q = tmp, *t = tmp + n + 1;
+
+    mp_size ysize = mp_rsize(m->m[0][1], n);
+    ASSERT(ysize != 0);
+    mp_divrem(m->m[0][0], n, m->m[0][1], ysize, q, NULL);
+    mp_size qsize = mp_rsize(q, n - ysize + 1);
+    ysize = mp_rsize(m->m[1][1], n);
+    if (ysize != 0) {
+	mp_divrem(m->m[1][0], n, m->m[1][1], ysize, t, NULL);
+	const mp_size tsize = mp_rsize(t, n - ysize + 1);
+	if (mp_cmp(t, tsize, q, qsize) < 0) {
+	    mp_copy(t, tsize, q);
+	    qsize = tsize;
+	}
+    }
+
+    for (unsigned i = 0; i < 2; i++) {
+	/* (x y) -> (y  x - q y) */
+	mp_digit *x = m->m[i][0], *y = m->m[i][1];
+	mp_mul(q, qsize, y, n, t);
+	ASSERT(mp_subi(x, n, t, mp_rsize(t, qsize + n)) == 0);
+	mp_xchg(x, y, n);
+    }
+    m->size = MAX(mp_rsize(m->m[0][0], n), mp_rsize(m->m[1][0], n));
+    m->det = -m->det;
+    if (m->q != NULL)
+	m->qcount--;
+}
+
+/* M = M N. TMP has room for 3 * (M->size + N->size + 1) digits. */
+static void
+matrix_mul(mp_hgcd_matrix *m, const mp_hgcd_matrix *n, mp_digit *tmp)
+{
+    for (mp_size i = 0; i < n->qcount; i++)
+	mp_hgcd_matrix_log_q(m, n->q[i]);
+    m->det *= n->det;
+    if (m->alloc == 0)
+	return;
+
+    const mp_size ms = m->size, ns = n->size, pn = ms + ns;
+    mp_digit *t0 = tmp, *t1 = t0 + pn + 1, *p = t1 + pn + 1;
+    mp_size size = 0;
+    for (unsigned i = 0; i < 2; i++) {
+	mp_digit *x = m->m[i][0], *y = m->m[i][1];
+	mp_mul(x, ms, n->m[0][0], ns, t0);
+	mp_mul(y, ms, n->m[1][0], ns, p);
+	t0[pn] = mp_addi(t0, pn, p, pn);
+	mp_mul(x, ms, n->m[0][1], ns, t1);
+	mp_mul(y, ms, n->m[1][1], ns, p);
+	t1[pn] = mp_addi(t1, pn, p, pn);
+	size = MAX(size, set_entry(x, ms, t0, pn + 1, m->alloc));
+	set_entry(y, ms, t1, pn + 1, m->alloc);
+    }
+    m->size = size;
+}
+
+/* Set w = x - y, for x[n] and y[n], and return true if X >= Y; otherwise
+ * return false. */
+static bool
+nonneg_diff(const mp_digit *x, const mp_digit *y, mp_size n,
+	    mp_digit *w, mp_size *wsize)
+{
+    if (mp_cmp_n(x, y, n) < 0)
+	return false;
+    mp_sub_n(x, y, n, w);
+    *wsize = mp_rsize(w, n);
+    return true;
+}
+
+/* Compute (C D)' = M^-1 (A B)' = det (m11 A - m01 B  m00 B - m10 A)'. If
+ * C > D >= 0 and C >= B^K, store C and D in A and B and return true; otherwise
+ * leave A and B alone and return false. TMP has room for
+ * 4 * (asize + M->size) digits. */
+static bool
+hgcd_apply(mp_digit *a, mp_size *asize, mp_digit *b, mp_size *bsize,
+	   mp_size k, const mp_hgcd_matrix *m, mp_digit *tmp)
+{
+    const mp_size an = *asize, bn = *bsize, s = m->size, tn = an + s;
+    mp_digit *x = tmp, *y = tmp + tn, *c = tmp + tn * 2, *d = tmp + tn * 3;
+    mp_size csize, dsize;
+
+    mp_mul(m->m[1][1], s, a, an, x);
+    mp_mul(m->m[0][1], s, b, bn, y);
+    mp_zero(y + s + bn, an - bn);
+    if (!(m->det > 0 ? nonneg_diff(x, y, tn, c, &csize) :
+		       nonneg_diff(y, x, tn, c, &csize)))
+	return false;
+    if (csize <= k)
+	return false;
+    mp_mul(m->m[0][0], s, b, bn, x);
+    mp_zero(x + s + bn, an - bn);
+    mp_mul(m->m[1][0], s, a, an, y);
+    if (!(m->det > 0 ? nonneg_diff(x, y, tn, d, &dsize) :
+		       nonneg_diff(y, x, tn, d, &dsize)))
+	return false;
+    if (mp_cmp(c, csize, d, dsize) <= 0)
+	return false;
+
+    mp_copy(c, csize, a);
+    *asize = csize;
+    mp_copy(d, dsize, b);
+    *bsize = dsize;
+    return true;
+}
+
+/* One Euclidean step: (A B) = (B  A mod B), multiplying (q 1; 1 0) into M if it
+ * is not NULL. TMP has room for asize + 1 digits, plus M->alloc + asize + 1 if
+ * M is not NULL. */
+static void
+hgcd_step(mp_digit *a, mp_size *asize, mp_digit *b, mp_size *bsize,
+	  mp_hgcd_matrix *m, mp_digit *tmp)
+{
+    const mp_size an = *asize, bn = *bsize, qn = an - bn + 1;
+    mp_digit *q = tmp, *r = tmp + qn;
+
+    mp_divrem(a, an, b, bn, q, r);
+    mp_copy(b, bn, a);
+    *asize = bn;
+    mp_copy(r, bn, b);
+    *bsize = mp_rsize(b, bn);
+    if (m != NULL)
+	matrix_mul_q(m, q, mp_rsize(q, qn), r + bn);
+}
+
+/* Reduce the leading 2s + 1 digits of A and B by s digits recursively, and
+ * apply the quotient matrix found to all of A and B (and M, unless it is
+ * NULL). Return false if no progress was made. */
+static bool
+hgcd_round(mp_digit *a, mp_size *asize, mp_digit *b, mp_size *bsize,
+	   mp_size k, mp_size s, mp_hgcd_matrix *m)
+{
+    const mp_size n = *asize, p = n - s * 2 - 1;
+    mp_size a1size = n - p, b1size = *bsize - p;
+
+    if (mp_cmp(a + p, a1size, b + p, b1size) == 0)
+	return false;
+
+    mp_hgcd_matrix m1 = MP_HGCD_MATRIX_INITIALIZER;
+    mp_hgcd_matrix_init(&m1, s + 1);
+    if (m != NULL && m->q != NULL)
+	mp_hgcd_matrix_log(&m1);
+    mp_digit *a1 = mp_new(a1size + b1size), *b1 = a1 + a1size;
+    mp_copy(a + p, a1size, a1);
+    mp_copy(b + p, b1size, b1);
+    mp_hgcd(a1, &a1size, b1, &b1size, s + 1, &m1);
+    mp_free(a1);
+
+    const mp_size tsize = MAX(4 * (n + s + 1),
+			      m != NULL ? 3 * (m->size + s + 2) : 0);
+    mp_digit *tmp = mp_new(tsize);
+    while (!hgcd_apply(a, asize, b, bsize, k, &m1, tmp))
+	matrix_undo_q(&m1, tmp);
+    const bool progress = !mp_is_zero(m1.m[0][1], m1.size);
+    if (progress && m != NULL)
+	matrix_mul(m, &m1, tmp);
+    mp_free(tmp);
+    mp_hgcd_matrix_free(&m1);
+    return progress;
+}
+
+void
+mp_hgcd(mp_digit *a, mp_size *asize, mp_digit *b, mp_size *bsize,
+	mp_size k, mp_hgcd_matrix *m)
+{
+    ASSERT(a != NULL);
+    ASSERT(asize != NULL);
+    ASSERT(b != NULL);
+    ASSERT(bsize != NULL);
+    ASSERT(m == NULL || m->m[0][0] != NULL || m->alloc == 0);
+
+    const mp_size size = *asize;
+    mp_size an = mp_rsize(a, *asize), bn = mp_rsize(b, *bsize);
+    ASSERT(mp_cmp(a, an, b, bn) > 0);
+
+    mp_digit *tmp = NULL;
+    while (bn > k) {
+	const mp_size n = an, s = MIN(n - k, n / 3), p = n - s * 2 - 1;
+	if (n >= HGCD_THRESHOLD && bn > p + s + 1 &&
+	    hgcd_round(a, &an, b, &bn, k, s, m))
+	    continue;
+	if (an >= k + 2 && mp_lehmer_step(a, &an, b, &bn, k, m))
+	    continue;
+	if (tmp == NULL)
+	    tmp = mp_new(size + 1 + (m != NULL ? m->alloc + size + 1 : 0));
+	hgcd_step(a, &an, b, &bn, m, tmp);
+    }
+    mp_free(tmp);
+    *asize = an;
+    *bsize = bn;
+}
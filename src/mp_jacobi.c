@@ -4,16 +4,80 @@
 #include "mp.h"
 #include "mp_internal.h"
 
+/* A precomputed table of values for evaluating the (-1)^((A^2-1)/8) terms in
+ * the Kronecker algorithm. To evalute this for A, index the table with (A & 7)
+ * which is equivalent to A mod 8. */
+static const int etab[8] = { 0, +1, 0, -1, 0, -1, 0, +1 };
+
+/* The Jacobi symbol A over the odd N, for single digits, by the binary
+ * algorithm: factors of two come out of A by (2/N), and for odd A < N,
+ * reciprocity swaps them before N is subtracted. */
+static int
+digit_jacobi(mp_digit a, mp_digit n)
+{
+    ASSERT(n & 1);
+
+    int k = 1;
+    while (a != 0) {
+	const unsigned shift = mp_digit_lsb_shift(a);
+	a >>= shift;
+	if (shift & 1)
+	    k *= etab[n & 7];
+	if (a < n) {
+	    SWAP(a, n, mp_digit);
+	    if (a & n & 2)
+		k = -k;
+	}
+	a -= n;
+    }
+    return n == 1 ? k : 0;
+}
+
+/* The Euclidean algorithm on X > Y, with X = q Y + R, goes on to (Y R). Along
+ * the way the Jacobi symbol is kept as K (Y/X) with X odd (FIRST), or K (X/Y)
+ * with Y odd, and each step needs only the residues of X, Y and R mod 8:
+ *
+ * - For odd Y, (X/Y) = (R/Y), with Y now first.
+ * - For odd X and Y, reciprocity gives (Y/X) = +-(X/Y) = +-(R/Y), likewise.
+ * - For odd X and even Y = 2^e Y', R is odd and (Y/X) = (Y/R) unless e = 1,
+ *   when the factors (2/X) (2/R) and (-1)^((Y'-1)/2 ((X-1)/2 + (R-1)/2)) of
+ *   (Y/X) / (Y/R) remain; R is now second.
+ *
+ * The quotients mod 8 are all that is needed for the residues, so the state
+ * follows the quotients recorded by mp_hgcd(). */
+typedef struct {
+    int		k;
+    bool	first;
+    unsigned	x, y;	/* X mod 8, Y mod 8 */
+} jacobi_state;
+
+static void
+jacobi_update(jacobi_state *s, unsigned r)
+{
+    r &= 7;
+    if (!s->first) {
+	s->first = true;
+    } else if (s->y & 1) {
+	if (s->x & s->y & 2)
+	    s->k = -s->k;
+    } else {
+	if ((s->y & 3) == 2) {
+	    s->k *= etab[s->x] * etab[r];
+	    if ((s->y & 4) && ((s->x ^ r) & 2))
+		s->k = -s->k;
+	}
+	s->first = false;
+    }
+    s->x = s->y;
+    s->y = r;
+}
+
 int
 mp_jacobi(const mp_digit *a, mp_size asize,
 	  const mp_digit *p, mp_size psize)
 {
-    /* A precomputed table of values for evaluating the (-1)^((A^2-1)/8)
-     * terms in the Kronecker algorithm. To evalute this for A, index the table
-     * with (A & 7) which is equivalent to A mod 8. */
-    static const int etab[8] = { 0, +1, 0, -1, 0, -1, 0, +1 };
     int k;
-    mp_digit *atmp, *ptmp, *mtmp;
+    mp_digit *atmp, *ptmp;
 
     ASSERT(a != NULL);
     ASSERT(p != NULL);
@@ -29,39 +93,57 @@ mp_jacobi(const mp_digit *a, mp_size asize,
     if (((a[0] | p[0]) & 1) == 0)
 	return 0;
 
-    /* Allocate temporaries. */
-    atmp = MP_TMP_COPY(a, asize);
+    /* Take the factors of two out of P, leaving it odd. */
+    const unsigned shift = mp_odd_shift(p, psize);
+    k = (shift & 1) ? etab[a[0] & 7] : 1;
+    p += shift / MP_DIGIT_BITS;
+    psize -= shift / MP_DIGIT_BITS;
     ptmp = MP_TMP_COPY(p, psize);
-    mtmp = MP_TMP_ALLOC(asize);
-
-    a = NULL; p = NULL;
-
-    if (mp_odd_shift(ptmp, psize) & 1)
-	k = etab[atmp[0] & 7];
-    else
-	k = 1;
-
-    do {
-	if (mp_odd_shift(atmp, asize) & 1)
-	    k = etab[ptmp[0] & 7];
-	if (atmp[0] & ptmp[0] & 2)
-	    k = -k;
-	/* M = A */
-	mp_copy(atmp, asize, mtmp);
-	/* A = P mod M */
-	mp_mod(ptmp, psize, mtmp, asize, atmp);
-	/* P = M */
-	mp_copy(mtmp, psize = asize, ptmp);
-    } while ((asize = mp_rsize(atmp, asize)) != 0);
-
-    /* If P = 0, return 0, otherwise return K. */
-    if (mp_rsize(ptmp, psize) == 0)
+    if (shift % MP_DIGIT_BITS)
+	mp_rshifti(ptmp, psize, shift % MP_DIGIT_BITS);
+    psize = mp_rsize(ptmp, psize);
+
+    /* J(A,P) = J(A mod P,P) */
+    atmp = MP_TMP_ALLOC(psize);
+    if (mp_cmp(a, asize, ptmp, psize) >= 0) {
+	mp_mod(a, asize, ptmp, psize, atmp);
+	asize = mp_rsize(atmp, psize);
+    } else {
+	mp_copy(a, asize, atmp);
+    }
+
+    if (psize == 1) {
+	k *= digit_jacobi(asize ? atmp[0] : 0, ptmp[0]);
+    } else if (asize == 0) {
 	k = 0;
+    } else {
+	/* Run the Euclidean algorithm on (P A) down to a single digit,
+	 * recording the quotients, then finish as above. */
+	jacobi_state s = { k, true, ptmp[0] & 7, atmp[0] & 7 };
+	mp_hgcd_matrix m = MP_HGCD_MATRIX_INITIALIZER;
+	mp_hgcd_matrix_init(&m, 0);
+	mp_hgcd_matrix_log(&m);
+	mp_hgcd(ptmp, &psize, atmp, &asize, 1, &m);
+	for (mp_size i = 0; i < m.qcount; i++) {
+	    const unsigned q = m.q[i];
+	    jacobi_update(&s, s.x - q * s.y);
+	}
+	mp_hgcd_matrix_free(&m);
+
+	if (asize == 0) {
+	    /* (0/X) with X the GCD. */
+	    k = (psize == 1 && ptmp[0] == 1) ? s.k : 0;
+	} else {
+	    /* One more step, to (Y R) in single digits. */
+	    const mp_digit y = atmp[0], r = mp_dmod(ptmp, psize, y);
+	    jacobi_update(&s, (unsigned)r);
+	    k = s.k * (s.first ? digit_jacobi(r, y) : digit_jacobi(y, r));
+	}
+    }
 
     /* Free temporaries. */
     MP_TMP_FREE(atmp);
     MP_TMP_FREE(ptmp);
-    MP_TMP_FREE(mtmp);
 
     return k;
 }
@@ -4,182 +4,263 @@
 #include "mp.h"
 #include "mp_internal.h"
 
-/* Compute g[min(usize,vsize)] = gcd(u,v) using Lehmer's algorithm.
- * Neither A or B may be 0 */
-void
-mp_lehmer(const mp_digit *u, mp_size usize,
-	  const mp_digit *v, mp_size vsize, mp_digit *g)
+/* Lehmer's algorithm, after Knuth, The Art of Computer Programming Vol.2 3rd
+ * ed. p.345, with double-digit leading parts.
+ *
+ * With A > B, let a and b be the leading two digits of A, and the digits of B
+ * at the same position. The quotients of the Euclidean algorithm on a and b
+ * are those of A and B for as long as the remainders stay well above the
+ * cofactors, so running it until they fall to about 1.25 digits gives a
+ * matrix U with (a b)' = U (c d)' and single-digit entries of about 0.75
+ * digits. One pass over A and B computing (C D)' = U^-1 (A B)' with mp_dmul()
+ * and mp_dmul_sub() then stands in for that many Euclidean steps. As in
+ * mp_hgcd.c, U is accepted only if C > D >= 0, which makes it the true
+ * quotient matrix of A and B; this fails but rarely, and a division step is
+ * taken instead. */
+
+/* Remainders of the leading parts are kept at or above MIN_HIGH * B. */
+#define MIN_HIGH	((mp_digit)1 << (MP_DIGIT_BITS / 4))
+
+/* Return the two digits of u[usize] starting LZ bits below the top of digit
+ * N - 1 (which may be above the top of U). */
+static void
+leading_digits(const mp_digit *u, mp_size usize, mp_size n, unsigned lz,
+	       mp_digit *hi, mp_digit *lo)
 {
-    int rv;
-    mp_digit uhat, vhat, A, B, C, D, T, q, q2;
-    mp_digit *utmp, *vtmp, *t = NULL, *w = NULL;
-
-    ASSERT(usize != 0);
-    ASSERT(u[usize - 1] != 0);
-    ASSERT(vsize != 0);
-    ASSERT(v[vsize - 1] != 0);
-
-    /* Arrange A >= B */
-    rv = mp_cmp(u, usize, v, vsize);
-    if (rv == 0) {
-	mp_copy(u, MIN(usize, vsize), g);
-	return;
+    mp_digit d[3];
+    for (unsigned i = 0; i < 3; i++)
+	d[i] = (n > i && n - 1 - i < usize) ? u[n - 1 - i] : 0;
+    if (lz) {
+	*hi = (d[0] << lz) | (d[1] >> (MP_DIGIT_BITS - lz));
+	*lo = (d[1] << lz) | (d[2] >> (MP_DIGIT_BITS - lz));
+    } else {
+	*hi = d[0];
+	*lo = d[1];
     }
-    if (rv < 0) {
-	SWAP(u, v, const mp_digit *);
-	SWAP(usize, vsize, mp_size);
+}
+
+/* Divide the double digit ah:al by bh:bl, where bh is nonzero. Return the
+ * quotient and leave the remainder in ah:al. */
+static mp_digit
+dd_divrem(mp_digit *ah, mp_digit *al, mp_digit bh, mp_digit bl)
+{
+    /* Most quotients are 1. */
+    mp_digit rl = *al - bl;
+    mp_digit rh = *ah - bh - (*al < bl);
+    if (rh < bh || (rh == bh && rl < bl)) {
+	*ah = rh;
+	*al = rl;
+	return 1;
+    }
+
+    /* Estimate from the top digits of the normalized operands, which is at
+     * most 2 too large (Knuth, Theorem 4.3.1B). */
+    const unsigned s = mp_digit_msb_shift(bh);
+    const mp_digit b1 = s ? (bh << s) | (bl >> (MP_DIGIT_BITS - s)) : bh;
+    const mp_digit a2 = s ? *ah >> (MP_DIGIT_BITS - s) : 0;
+    const mp_digit a1 = s ? (*ah << s) | (*al >> (MP_DIGIT_BITS - s)) : *ah;
+    mp_digit q, r;
+    if (a2 >= b1) {
+	q = MP_DIGIT_MAX;
+    } else {
+	digit_div(a2, a1, b1, q, r);
+	(void)r;
+    }
+
+    /* p2:p1:p0 = q * bh:bl, brought down to at most ah:al. */
+    mp_digit p2, p1, p0, c;
+    digit_mul(q, bl, c, p0);
+    digit_mul(q, bh, p2, p1);
+    p1 += c;
+    p2 += (p1 < c);
+    while (p2 != 0 || p1 > *ah || (p1 == *ah && p0 > *al)) {
+	q--;
+	c = (p0 < bl);
+	p0 -= bl;
+	const mp_digit t = bh + c;
+	p2 -= (p1 < t) | (t < c);
+	p1 -= t;
     }
+    *ah -= p1 + (*al < p0);
+    *al -= p0;
+    return q;
+}
 
-    utmp = MP_TMP_ALLOC(usize + 1);
-    mp_copy(u, usize, utmp);
-    utmp[usize] = 0;
-    u = NULL;
+/* The entries of U stay below B / MIN_HIGH, and grow at least as fast as the
+ * Fibonacci numbers, which bounds the number of quotients. */
+#define MAX_QUOTIENTS	(2 * MP_DIGIT_BITS)
 
-    vtmp = MP_TMP_ALLOC(vsize + 1);
-    mp_copy(v, vsize, vtmp);
-    vtmp[vsize] = 0;
-    v = NULL;
+/* Run the Euclidean algorithm on the double digits a = ah:al >= b = bh:bl,
+ * while the remainders stay at or above MIN_HIGH * B, keeping the product U of
+ * its quotient matrices (q 1; 1 0), its determinant, and the quotients mod 8.
+ * Return false if not even one step could be taken. */
+static bool
+lehmer_matrix(mp_digit ah, mp_digit al, mp_digit bh, mp_digit bl,
+	      mp_digit u[2][2], int *det, unsigned char *qs, unsigned *nq)
+{
+    u[0][0] = u[1][1] = 1;
+    u[0][1] = u[1][0] = 0;
+    *det = 1;
+    *nq = 0;
+    if (bh < MIN_HIGH)
+	return false;
 
     for (;;) {
-	mp_digit uu, vv, dummy;
-
-	MP_NORMALIZE(utmp, usize);
-	MP_NORMALIZE(vtmp, vsize);
-	rv = mp_cmp(utmp, usize, vtmp, vsize);
-	if (rv < 0) {
-	    SWAP(utmp, vtmp, mp_digit *);
-	    SWAP(usize, vsize, mp_size);
+	mp_digit rh = ah, rl = al;
+	const mp_digit q = dd_divrem(&rh, &rl, bh, bl);
+	if (rh < MIN_HIGH)
+	    break;
+	for (unsigned i = 0; i < 2; i++) {
+	    /* (x y) -> (q x + y  x). The entries stay below B / MIN_HIGH. */
+	    const mp_digit x = u[i][0];
+	    u[i][0] = q * x + u[i][1];
+	    u[i][1] = x;
 	}
+	*det = -*det;
+	ASSERT(*nq < MAX_QUOTIENTS);
+	qs[(*nq)++] = q & 7;
+	ah = bh; al = bl;
+	bh = rh; bl = rl;
+    }
+    return u[0][1] != 0;
+}
 
-	if (vsize <= 1) {
-	    /* Handle this case with single-precision Euclidean. */
-	    mp_digit r;
-
-	    vv = vtmp[0];
-	    if (vv == 0) {	/* gcd(u,0) = u */
-		mp_copy(utmp, usize, g);
-		MP_TMP_FREE(utmp);
-		MP_TMP_FREE(vtmp);
-		return;
-	    }
-
-	    if ((r = mp_dmod(utmp, usize, vv)) == 0) {
-		g[0] = vv;
-		MP_TMP_FREE(utmp);
-		MP_TMP_FREE(vtmp);
-		return;
-	    }
-	    uu = vv; vv = r;
-	    for (;;) {
-		if ((r = uu % vv) == 0)
-		    break;
-		uu = vv;
-		vv = r;
-	    }
-	    g[0] = vv;
-	    MP_TMP_FREE(utmp);
-	    MP_TMP_FREE(vtmp);
-	    return;
-	}
+/* Set w[n + 1] = x[xsize] * xm - y[ysize] * ym, where xsize and ysize are at
+ * most N, and return true; return false if that would be negative. */
+static bool
+dmul_diff(const mp_digit *x, mp_size xsize, mp_digit xm,
+	  const mp_digit *y, mp_size ysize, mp_digit ym,
+	  mp_size n, mp_digit *w)
+{
+    w[xsize] = mp_dmul(x, xsize, xm, w);
+    mp_zero(w + xsize + 1, n - xsize);
+    const mp_digit borrow = mp_dmul_sub(y, ysize, ym, w);
+    return borrow == 0 || mp_dsubi(w + ysize, n + 1 - ysize, borrow) == 0;
+}
 
-	uhat = utmp[usize - 1];
-	vhat = (usize == vsize) ? vtmp[vsize - 1] : 0;
-	A = 1;
-	B = 0;
-	C = 0;
-	D = 1;
-
-	for (;;) {
-	    printf("ul=%u vl=%u uhat=" MP_FORMAT
-		   " vhat=" MP_FORMAT" A=" MP_FORMAT " B=" MP_FORMAT
-		   " C=" MP_FORMAT " D=" MP_FORMAT "\n",
-		   usize, vsize, uhat, vhat, A, B, C, D);
-	    /* If \^v + C = 0 or \^v + D = 0, do multiprecision step, because
-	     * either of these cases would result in division by zero. */
-	    if (vhat == 0 && (C == 0 || D == 0))
-		break;
-
-	    /* q = (uhat+A)/(vhat+C). (uhat+A) can overflow, (vhat+C) can't */
-	    uu = uhat + A;
-	    vv = vhat + C;
-	    ASSERT(vv >= C);
-	    if (uu < A) {
-		ASSERT(uu == 0);
-		printf("uu overflow\n");
-		digit_div(1, uu, vv, q, dummy);
-	    } else {
-		q = uu / vv;
-	    }
-
-	    /* q2 = (uhat+B)/(vhat+D). (vhat+D) can overflow, (uhat+B) can't */
-	    uu = uhat + B;
-	    vv = vhat + D;
-	    ASSERT(uu >= B);
-	    if (vv < D) { /* if (vhat+D) overflows q2 must = 0 */
-		printf("vv overflow\n");
-		q2 = 0;
-	    } else {
-		q2 = uu / vv;
-	    }
-
-	    printf("q1=" MP_FORMAT " q2=" MP_FORMAT "\n", q, q2);
-
-	    if (q != q2)
-		break;
-
-	    printf("doing single precision\n");
-	    /* Single-precision step. */
-	    ASSERT(A >= q * C);
-	    T = A - q * C;
-	    A = C;
-	    C = T;
-
-	    ASSERT(B >= q * D);
-	    T = B - q * D;
-	    B = D;
-	    D = T;
-
-	    ASSERT(uhat >= q * vhat);
-	    T = uhat - q * vhat;
-	    uhat = vhat;
-	    vhat = T;
-	}
+/* M = M U, for U with single-digit entries and quotients QS. TMP has room for
+ * 2 * (M->size + 1) digits. */
+static void
+matrix_mul_digits(mp_hgcd_matrix *m, mp_digit u[2][2], int det,
+		  const unsigned char *qs, unsigned nq, mp_digit *tmp)
+{
+    for (unsigned i = 0; i < nq; i++)
+	mp_hgcd_matrix_log_q(m, qs[i]);
+    m->det *= det;
+    if (m->alloc == 0)
+	return;
+
+    const mp_size n = m->size;
+    mp_digit *t0 = tmp, *t1 = tmp + n + 1;
+    mp_size size = 0;
+    for (unsigned i = 0; i < 2; i++) {
+	/* (x y) -> (u00 x + u10 y  u01 x + u11 y) */
+	mp_digit *x = m->m[i][0], *y = m->m[i][1];
+	t0[n] = mp_dmul(x, n, u[0][0], t0);
+	t0[n] += mp_dmul_add(y, n, u[1][0], t0);
+	t1[n] = mp_dmul(x, n, u[0][1], t1);
+	t1[n] += mp_dmul_add(y, n, u[1][1], t1);
+	const mp_size xsize = mp_rsize(t0, n + 1);
+	const mp_size ysize = mp_rsize(t1, n + 1);
+	ASSERT(xsize <= m->alloc);
+	ASSERT(ysize <= m->alloc);
+	mp_copy(t0, MIN(n + 1, m->alloc), x);
+	mp_copy(t1, MIN(n + 1, m->alloc), y);
+	size = MAX(size, MAX(xsize, ysize));
+    }
+    m->size = size;
+}
 
-	/* Multi-precision step. */
-	if (B == 0) {	/* Happens very rarely. */
-	    printf("Doing multiprecision step #1\n");
-	    /* Set t = u mod v, u = v, v = t */
-	    mp_modi(utmp, usize, vtmp, vsize);	/* u[0..vsize-1] = u % v */
-	    mp_xchg(utmp, vtmp, vsize);			/* u <=> v */
-	    usize = vsize;
-	    MP_NORMALIZE(vtmp, vsize);
-	} else {
-	    /* t = A*u, t = t+B*v, w = C*u, w = w+D*v, u = t, v = w */
-	    mp_digit cy;
-
-	    printf("Doing multiprecision step #2\n");
-
-	    if (t == NULL)
-		t = MP_TMP_ALLOC(usize + 1);
-	    t[usize] = mp_dmul(utmp, usize, A, t);
-	    cy = mp_dmul_add(vtmp, vsize, B, t);
-	    if (cy)
-		cy = mp_daddi(t + vsize, usize + 1 - vsize, cy);
-	    ASSERT(cy == 0);
-
-	    if (w == NULL)
-		w = MP_TMP_ALLOC(usize + 1);
-	    w[usize] = mp_dmul(utmp, usize, C, w);
-	    cy = mp_dmul_add(vtmp, vsize, D, w);
-	    if (cy)
-		cy = mp_daddi(w + vsize, usize + 1 - vsize, cy);
-	    ASSERT(cy == 0);
-
-	    usize += (t[usize] != 0);
-	    mp_copy(t, usize, utmp);
-
-	    vsize += (t[vsize] != 0);
-	    mp_copy(w, vsize, vtmp);
+bool
+mp_lehmer_step(mp_digit *a, mp_size *asize, mp_digit *b, mp_size *bsize,
+	       mp_size k, mp_hgcd_matrix *m)
+{
+    ASSERT(a != NULL);
+    ASSERT(asize != NULL);
+    ASSERT(b != NULL);
+    ASSERT(bsize != NULL);
+
+    const mp_size an = *asize, bn = *bsize;
+    ASSERT(an != 0 && a[an - 1] != 0);
+    ASSERT(mp_cmp(a, an, b, bn) > 0);
+    if (an < 2 || bn == 0)
+	return false;
+
+    const unsigned lz = mp_digit_msb_shift(a[an - 1]);
+    mp_digit ah, al, bh, bl, u[2][2];
+    unsigned char qs[MAX_QUOTIENTS];
+    unsigned nq;
+    int det;
+    leading_digits(a, an, an, lz, &ah, &al);
+    leading_digits(b, bn, an, lz, &bh, &bl);
+    if (!lehmer_matrix(ah, al, bh, bl, u, &det, qs, &nq))
+	return false;
+
+    /* (C D)' = det (u11 A - u01 B  u00 B - u10 A)' */
+    const mp_size tn = MAX(an, m != NULL ? m->size : 0) + 1;
+    mp_digit *c = MP_TMP_ALLOC(2 * tn);
+    mp_digit *d = c + tn;
+    bool ok = det > 0 ?
+	dmul_diff(a, an, u[1][1], b, bn, u[0][1], an, c) &&
+	dmul_diff(b, bn, u[0][0], a, an, u[1][0], an, d) :
+	dmul_diff(b, bn, u[0][1], a, an, u[1][1], an, c) &&
+	dmul_diff(a, an, u[1][0], b, bn, u[0][0], an, d);
+    if (ok) {
+	const mp_size cn = mp_rsize(c, an + 1), dn = mp_rsize(d, an + 1);
+	ok = cn > k && mp_cmp(c, cn, d, dn) > 0;
+	if (ok) {
+	    mp_copy(c, cn, a);
+	    *asize = cn;
+	    mp_copy(d, dn, b);
+	    *bsize = dn;
+	    if (m != NULL)
+		matrix_mul_digits(m, u, det, qs, nq, c);
 	}
     }
+    MP_TMP_FREE(c);
+    return ok;
+}
+
+void
+mp_lehmer(const mp_digit *u, mp_size usize,
+	  const mp_digit *v, mp_size vsize, mp_digit *w)
+{
+    ASSERT(u != NULL);
+    ASSERT(v != NULL);
+    ASSERT(w != NULL);
+    ASSERT(u != w);
+    ASSERT(v != w);
+
+    mp_zero(w, MIN(usize, vsize));
+    MP_NORMALIZE(u, usize);
+    MP_NORMALIZE(v, vsize);
+    const int cmp = mp_cmp(u, usize, v, vsize);
+    if (cmp < 0) {
+	SWAP(u, v, const mp_digit *);
+	SWAP(usize, vsize, mp_size);
+    }
+    if (cmp == 0 || vsize == 0) {
+	/* gcd(U, U) = gcd(U, 0) = U. */
+	mp_copy(u, usize, w);
+	return;
+    }
+
+    mp_digit *a = mp_dup(u, usize);
+    mp_digit *b = mp_dup(v, vsize);
+    mp_size an = usize, bn = vsize;
+    while (bn > 1) {
+	if (mp_lehmer_step(a, &an, b, &bn, 0, NULL))
+	    continue;
+	/* (A B) = (B  A mod B) */
+	mp_modi(a, an, b, bn);
+	an = mp_rsize(a, bn);
+	SWAP(a, b, mp_digit *);
+	SWAP(an, bn, mp_size);
+    }
+    if (bn == 0)
+	mp_copy(a, an, w);
+    else
+	w[0] = mp_digit_gcd(b[0], mp_dmod(a, an, b[0]));
+    mp_free(a);
+    mp_free(b);
 }
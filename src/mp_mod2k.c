@@ -0,0 +1,153 @@
+/* mp_mod2k.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Number of digits needed to hold a residue modulo 2^K. */
+#define DIGITS_2K(k)	(((k) + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS)
+
+/* Clear all bits of w[size] at or above bit K, where size = DIGITS_2K(k). */
+static void
+mask_2k(mp_digit *w, mp_size size, unsigned k)
+{
+    if (k % MP_DIGIT_BITS)
+	w[size - 1] &= ((mp_digit)1 << (k % MP_DIGIT_BITS)) - 1;
+}
+
+/* Newton's iteration as in mp_digit_invert, carried out to as many digits as
+ * needed: if U X = 1 (mod B^n) then X' = X - X (U X - 1) satisfies
+ * U X' = 1 (mod B^2n). */
+void
+mp_invert_2k(const mp_digit *u, mp_size usize, unsigned k, mp_digit *w)
+{
+    ASSERT(u != NULL);
+    ASSERT(usize != 0);
+    ASSERT((u[0] & 1) == 1);
+    ASSERT(k != 0);
+
+    const mp_size wsize = DIGITS_2K(k);
+    mp_zero(w, wsize);
+    w[0] = mp_digit_invert(u[0]);
+    if (wsize > 1) {
+	mp_digit *tmp = MP_TMP_ALLOC(2 * wsize);
+	mp_digit *c = tmp + wsize;
+	for (mp_size n = 1; n < wsize; ) {
+	    n = MIN(2 * n, wsize);
+	    mp_mul_mod_powb(u, MIN(usize, n), w, n, tmp, n);
+	    ASSERT(mp_dec(tmp, n) == 0);
+	    mp_mul_mod_powb(w, n, tmp, n, c, n);
+	    mp_subi_n(w, c, n);
+	}
+	MP_TMP_FREE(tmp);
+    }
+    mask_2k(w, wsize, k);
+}
+
+/* Left-to-right binary exponentiation; reduction modulo 2^K is free since
+ * only the low digits of each product need to be computed. */
+
+/*  Input: u[0..usize-1], p[0..psize-1], k > 0
+ * Output: w[0..ceil(k/B)-1] = (u ** p) mod 2^k */
+void
+mp_modexp_2k(const mp_digit *u, mp_size usize,
+	     const mp_digit *p, mp_size psize,
+	     unsigned k, mp_digit *w)
+{
+    ASSERT(u != NULL);
+    ASSERT(p != NULL);
+    ASSERT(w != NULL);
+    ASSERT(k != 0);
+
+    const mp_size wsize = DIGITS_2K(k);
+    mp_zero(w, wsize);
+    MP_NORMALIZE(p, psize);
+    if (psize == 0) {
+	w[0] = 1;
+	return;
+    }
+    MP_NORMALIZE(u, usize);
+    if (usize == 0)
+	return;
+
+    const unsigned twos = mp_odd_shift(u, usize);
+    unsigned pbits = mp_significant_bits(p, psize);
+    if (twos != 0) {
+	/* U^P is divisible by 2^(P * TWOS), so it vanishes once P >= K/TWOS. */
+	if (twos >= k || psize > 1 || p[0] >= (k + twos - 1) / twos)
+	    return;
+    } else {
+	/* The group of odd residues modulo 2^K has exponent 2^(K-2) for K >= 3,
+	 * and 2 for K = 2, so only that many low bits of P matter. */
+	const unsigned ebits = (k >= 3) ? k - 2 : 1;
+	if (pbits > ebits) {
+	    pbits = ebits;
+	    while (pbits && !(p[(pbits - 1) / MP_DIGIT_BITS] &
+			      ((mp_digit)1 << ((pbits - 1) % MP_DIGIT_BITS))))
+		--pbits;
+	    if (pbits == 0) {
+		w[0] = 1;
+		return;
+	    }
+	}
+    }
+
+    mp_digit *tmp = MP_TMP_ALLOC(2 * wsize);
+    mp_digit *base = tmp + wsize;
+    const mp_size bsize = MIN(usize, wsize);
+    mp_copy(u, bsize, base);
+    mp_zero(base + bsize, wsize - bsize);
+    mask_2k(base, wsize, k);
+    mp_copy(base, wsize, w);
+
+    while (--pbits != 0) {
+	const unsigned b = pbits - 1;
+	mp_mul_mod_powb(w, wsize, w, wsize, tmp, wsize);
+	if (p[b / MP_DIGIT_BITS] & ((mp_digit)1 << (b % MP_DIGIT_BITS)))
+	    mp_mul_mod_powb(tmp, wsize, base, wsize, w, wsize);
+	else
+	    mp_copy(tmp, wsize, w);
+    }
+    mask_2k(w, wsize, k);
+
+    MP_TMP_FREE(tmp);
+}
+
+/* Chinese remaindering: for A < N and C < 2^K,
+ *
+ * X = A + N * ((C - A) * N^-1 mod 2^K)
+ *
+ * is less than N + N * (2^K - 1) = 2^K N, and agrees with A modulo N and with C
+ * modulo 2^K. */
+void
+mp_crt_2k(const mp_digit *a, const mp_digit *n, mp_size nsize,
+	  const mp_digit *c, unsigned k, mp_digit *w, mp_size wsize)
+{
+    ASSERT(n[0] & 1);
+    ASSERT(k != 0);
+
+    const mp_size ksize = DIGITS_2K(k);
+    mp_digit *ninv = MP_TMP_ALLOC(3 * ksize + (nsize + ksize));
+    mp_digit *d = ninv + ksize;
+    mp_digit *h = d + ksize;
+    mp_digit *x = h + ksize;
+    mp_invert_2k(n, nsize, k, ninv);
+
+    /* H = (C - A) * N^-1 mod 2^K */
+    const mp_size alen = MIN(nsize, ksize);
+    mp_copy(a, alen, d);
+    mp_zero(d + alen, ksize - alen);
+    mp_sub_n(c, d, ksize, d);
+    mp_mul_mod_powb(d, ksize, ninv, ksize, h, ksize);
+    mask_2k(h, ksize, k);
+
+    /* W = A + N * H */
+    mp_mul(n, nsize, h, ksize, x);
+    ASSERT(mp_addi(x, nsize + ksize, a, nsize) == 0);
+    ASSERT(mp_rsize(x, nsize + ksize) <= wsize);
+    const mp_size xsize = MIN(wsize, nsize + ksize);
+    mp_copy(x, xsize, w);
+    mp_zero(w + xsize, wsize - xsize);
+
+    MP_TMP_FREE(ninv);
+}
@@ -0,0 +1,137 @@
+/* mp_modctx.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* mp_modmul() and mp_modsqr() divide every product by M with mp_modi(), which
+ * normalizes the divisor and runs a full long division each time. With a
+ * context, that work is done once: an odd M gets a Montgomery context, whose
+ * reductions cost about one multiplication, and an even M a Barrett context,
+ * whose reductions cost about two. An M close to a power of two (see
+ * mp_special.c) is instead reduced by a few shifted additions, if it is even
+ * or has at least SPECIAL_MOD_THRESHOLD digits. */
+
+void
+mp_mod_ctx_init(mp_mod_ctx *ctx, const mp_digit *m, mp_size msize)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m == NULL);
+    ASSERT(m != NULL);
+
+    MP_NORMALIZE(m, msize);
+    ASSERT(msize != 0);
+
+    ctx->m = m;
+    ctx->k = msize;
+    if (((m[0] & 1) == 0 || msize >= SPECIAL_MOD_THRESHOLD) &&
+	mp_special_mod_ctx_init(&ctx->special_ctx, m, msize)) {
+	ctx->kind = MP_MOD_CTX_SPECIAL;
+    } else if (m[0] & 1) {
+	ctx->kind = MP_MOD_CTX_MONT;
+	mp_mont_ctx_init(&ctx->mont_ctx, m, msize);
+    } else {
+	ctx->kind = MP_MOD_CTX_BARRETT;
+	mp_barrett_ctx_init(&ctx->barrett_ctx, m, msize);
+    }
+}
+
+void
+mp_mod_ctx_free(mp_mod_ctx *ctx)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m != NULL);
+
+    if (ctx->kind == MP_MOD_CTX_SPECIAL)
+	mp_special_mod_ctx_free(&ctx->special_ctx);
+    else if (ctx->kind == MP_MOD_CTX_MONT)
+	mp_mont_ctx_free(&ctx->mont_ctx);
+    else
+	mp_barrett_ctx_free(&ctx->barrett_ctx);
+    ctx->m = NULL;
+    ctx->k = 0;
+    ctx->kind = MP_MOD_CTX_BARRETT;
+}
+
+void
+mp_mod_ctx_to(const mp_digit *u, mp_size usize,
+	      const mp_mod_ctx *ctx, mp_digit *w)
+{
+    ASSERT(ctx != NULL);
+
+    if (ctx->kind == MP_MOD_CTX_MONT) {
+	mp_mont_to(u, usize, &ctx->mont_ctx, w);
+	return;
+    }
+    if (ctx->kind == MP_MOD_CTX_SPECIAL) {
+	mp_special_reduce(u, usize, &ctx->special_ctx, w);
+	return;
+    }
+    MP_NORMALIZE(u, usize);
+    if (usize == 0)
+	mp_zero(w, ctx->k);
+    else
+	mp_mod(u, usize, ctx->m, ctx->k, w);
+}
+
+void
+mp_mod_ctx_from(const mp_digit *u, const mp_mod_ctx *ctx, mp_digit *w)
+{
+    ASSERT(ctx != NULL);
+
+    if (ctx->kind == MP_MOD_CTX_MONT)
+	mp_mont_from(u, &ctx->mont_ctx, w);
+    else if (u != w)
+	mp_copy(u, ctx->k, w);
+}
+
+void
+mp_modmul_ctx(const mp_digit *u, const mp_digit *v,
+	      const mp_mod_ctx *ctx, mp_digit *w)
+{
+    ASSERT(ctx != NULL);
+
+    if (ctx->kind == MP_MOD_CTX_MONT) {
+	mp_mont_mul(u, v, &ctx->mont_ctx, w);
+	return;
+    }
+    mp_digit *t = MP_TMP_ALLOC(2 * ctx->k);
+    mp_mul_n(u, v, ctx->k, t);
+    if (ctx->kind == MP_MOD_CTX_SPECIAL)
+	mp_special_reduce(t, 2 * ctx->k, &ctx->special_ctx, w);
+    else
+	mp_barrett_reduce(t, &ctx->barrett_ctx, w);
+    MP_TMP_FREE(t);
+}
+
+void
+mp_modsqr_ctx(const mp_digit *u, const mp_mod_ctx *ctx, mp_digit *w)
+{
+    ASSERT(ctx != NULL);
+
+    if (ctx->kind == MP_MOD_CTX_MONT) {
+	mp_mont_sqr(u, &ctx->mont_ctx, w);
+	return;
+    }
+    mp_digit *t = MP_TMP_ALLOC(2 * ctx->k);
+    mp_sqr(u, ctx->k, t);
+    if (ctx->kind == MP_MOD_CTX_SPECIAL)
+	mp_special_reduce(t, 2 * ctx->k, &ctx->special_ctx, w);
+    else
+	mp_barrett_reduce(t, &ctx->barrett_ctx, w);
+    MP_TMP_FREE(t);
+}
+
+void
+mp_modexp_ctx(const mp_digit *u, const mp_digit *p, mp_size psize,
+	      mp_mod_ctx *ctx, mp_digit *w)
+{
+    ASSERT(ctx != NULL);
+
+    if (ctx->kind == MP_MOD_CTX_MONT)
+	mp_mont_exp(u, p, psize, &ctx->mont_ctx, w);
+    else if (ctx->kind == MP_MOD_CTX_SPECIAL)
+	mp_special_exp(u, ctx->k, p, psize, &ctx->special_ctx, w);
+    else
+	mp_barrett(u, ctx->k, p, psize, &ctx->barrett_ctx, w);
+}
@@ -4,6 +4,29 @@
 #include "mp.h"
 #include "mp_internal.h"
 
+/* Odd moduli of fewer digits than this are worked in Montgomery form by
+ * mp_modexp_u64(), where the fused multiply-and-reduce kernel beats a squaring
+ * followed by a division. Above it the two cost about the same, and the
+ * context setup is not worth it. */
+#ifndef MODEXP_U64_MONT_THRESHOLD
+# define MODEXP_U64_MONT_THRESHOLD	16
+#endif /* !MODEXP_U64_MONT_THRESHOLD */
+
+/* Return true if mp_modexp_u64() should use Montgomery arithmetic for EXPONENT
+ * modulo an M of MSIZE digits. Setting up the context and converting in and
+ * out cost about three multiplications, which a chain of at least eight steps
+ * recovers. */
+static bool
+u64_use_mont(const mp_digit *m, mp_size msize, uint64_t exponent)
+{
+    if ((m[0] & 1) == 0 || msize >= MODEXP_U64_MONT_THRESHOLD)
+	return false;
+    unsigned steps = 0;
+    for (uint64_t e = exponent; e > 1; e >>= 1)
+	steps += 1 + (e & 1);
+    return steps >= 8;
+}
+
 void
 mp_modexp(const mp_digit *u, mp_size usize,
 	  const mp_digit *p, mp_size psize,
@@ -24,7 +47,7 @@ mp_modexp(const mp_digit *u, mp_size usize,
     MP_NORMALIZE(u, usize);
     MP_NORMALIZE(p, psize);
     if (usize == 0 || psize == 0) {
-	w[0] = (psize != 0);
+	w[0] = (usize != 0);
 	return;
     }
 
@@ -42,6 +65,11 @@ mp_modexp(const mp_digit *u, mp_size usize,
 	}
     }
 
+    if (mp_is_pow2(m, msize)) {
+	mp_modexp_2k(u, usize, p, psize, mp_significant_bits(m, msize) - 1, w);
+	return;
+    }
+
     /* Precompute U mod M. */
     mp_mod(u, usize, m, msize, w);
     const mp_size umsize = mp_rsize(w, msize);
@@ -117,6 +145,16 @@ mp_modexp_u64(const mp_digit *u, mp_size usize, uint64_t exponent,
 	return;
     }
 
+    if (u64_use_mont(m, msize, exponent)) {
+	mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+	mp_mont_ctx_init(&ctx, m, msize);
+	mp_mont_to(w, umsize, &ctx, w);
+	mp_mont_exp_u64(w, exponent, &ctx, w);
+	mp_mont_from(w, &ctx, w);
+	mp_mont_ctx_free(&ctx);
+	return;
+    }
+
     mp_digit *tmp, *umod;
     if (exponent & (exponent - 1)) {
 	tmp = MP_TMP_ALLOC(umsize + (msize * 2));
@@ -145,3 +183,33 @@ mp_modexp_u64(const mp_digit *u, mp_size usize, uint64_t exponent,
 
     MP_TMP_FREE(tmp);
 }
+
+void
+mp_modexp_u64_batch(const mp_digit *const *u, const mp_size *usize,
+		    unsigned n, uint64_t exponent,
+		    const mp_digit *m, mp_size msize, mp_digit *const *w)
+{
+    ASSERT(u != NULL);
+    ASSERT(usize != NULL);
+    ASSERT(m != NULL);
+    ASSERT(w != NULL);
+
+    MP_NORMALIZE(m, msize);
+    ASSERT(msize != 0);
+
+    if ((msize == 1 && m[0] == 1) || !u64_use_mont(m, msize, exponent)) {
+	for (unsigned i = 0; i < n; i++)
+	    mp_modexp_u64(u[i], usize[i], exponent, m, msize, w[i]);
+	return;
+    }
+
+    /* One Montgomery context serves every base. A zero base stays zero. */
+    mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+    mp_mont_ctx_init(&ctx, m, msize);
+    for (unsigned i = 0; i < n; i++) {
+	mp_mont_to(u[i], usize[i], &ctx, w[i]);
+	mp_mont_exp_u64(w[i], exponent, &ctx, w[i]);
+	mp_mont_from(w[i], &ctx, w[i]);
+    }
+    mp_mont_ctx_free(&ctx);
+}
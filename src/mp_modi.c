@@ -29,6 +29,12 @@ mp_modi(mp_digit *u, mp_size usize, const mp_digit *v, mp_size vsize)
 	return;
     }
 
+    if (mp_is_pow2(v, vsize)) {
+	u[vsize - 1] &= v[vsize - 1] - 1;
+	mp_zero(u + vsize, usize - vsize);
+	return;
+    }
+
     if (vsize == 1) {
 	u[0] = mp_dmod(u, usize, v[0]);
 	mp_zero(u + 1, usize - 1);
@@ -0,0 +1,173 @@
+/* mp_modsqrt.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Tonelli-Shanks, after Cohen, "A Course in Computational Algebraic Number
+ * Theory," algorithm 1.5.1, for P - 1 = 2^S Q with Q odd. With Z a non-residue
+ * and C = Z^Q of order 2^S, R = A^((Q+1)/2) has R^2 = A T with T = A^Q, whose
+ * order 2^I is below 2^M. Each step multiplies R by B = C^(2^(M-I-1)),
+ * and T by B^2, of the same order as T, which lowers the order of T; once T
+ * is 1, R^2 = A. X and R are in Montgomery form, ONE is R mod P, and E has
+ * room for K digits. Return false if A turns out to be a non-residue, or P
+ * not to be prime. */
+static bool
+tonelli_shanks(const mp_digit *x, const mp_digit *one,
+	       const mp_mont_ctx *ctx, mp_digit *e, mp_digit *r)
+{
+    const mp_digit *p = ctx->m;
+    const mp_size k = ctx->k;
+
+    /* Find the least non-residue, which for prime P is less than 2 ln(P)^2
+     * under the GRH; the bound below is a little larger. Z may take more than
+     * one small digit. */
+    const unsigned bits = mp_significant_bits(p, k);
+    const uint32_t zmax = (bits < 0x10000) ? bits * bits : UINT32_MAX;
+    mp_digit z[(4 + MP_DIGIT_SIZE - 1) / MP_DIGIT_SIZE];
+    mp_size zsize;
+    for (uint32_t zv = 3;; zv++) {
+	if (zv > zmax)
+	    return false;
+#if MP_DIGIT_MAX >= UINT32_MAX
+	z[0] = zv;
+	zsize = 1;
+#else
+	zsize = 0;
+	for (uint32_t v = zv; v != 0; v >>= MP_DIGIT_BITS)
+	    z[zsize++] = (mp_digit)v;
+#endif
+	const int j = mp_jacobi(z, zsize, p, k);
+	if (j < 0)
+	    break;
+	if (j == 0)
+	    return false;
+    }
+
+    /* E = Q = (P - 1) / 2^S, shifted by whole digits and then by bits. */
+    mp_copy(p, k, e);
+    e[0]--;
+    const unsigned s = mp_odd_shift(e, k);
+    const mp_size qsize = k - s / MP_DIGIT_BITS;
+    mp_copy(e + s / MP_DIGIT_BITS, qsize, e);
+    mp_rshifti(e, qsize, s % MP_DIGIT_BITS);
+
+    mp_digit *c = MP_TMP_ALLOC(k * 3);
+    mp_digit *t = c + k, *b = t + k;
+    mp_mont_to(z, zsize, ctx, b);
+    mp_mont_exp(b, e, qsize, ctx, c);
+    /* B = A^((Q-1)/2), R = A B = A^((Q+1)/2), T = R B = A^Q. */
+    mp_rshifti(e, qsize, 1);
+    mp_mont_exp(x, e, qsize, ctx, b);
+    mp_mont_mul(x, b, ctx, r);
+    mp_mont_mul(r, b, ctx, t);
+
+    bool ok = true;
+    for (unsigned m = s; mp_cmp_n(t, one, k) != 0; ) {
+	/* Find the order 2^I of T. */
+	unsigned i = 0;
+	mp_copy(t, k, b);
+	do {
+	    mp_mont_sqr(b, ctx, b);
+	    i++;
+	} while (i < m && mp_cmp_n(b, one, k) != 0);
+	if (i == m) {
+	    ok = false;
+	    break;
+	}
+
+	mp_copy(c, k, b);
+	for (unsigned j = i + 1; j < m; j++)
+	    mp_mont_sqr(b, ctx, b);
+	mp_mont_mul(r, b, ctx, r);
+	mp_mont_sqr(b, ctx, c);
+	mp_mont_mul(t, c, ctx, t);
+	m = i;
+    }
+    MP_TMP_FREE(c);
+    return ok;
+}
+
+/* Which method applies depends on P mod 8:
+ *
+ * - For P = 3 (mod 4), R = A^((P+1)/4), since R^2 = A^((P-1)/2) A = A for a
+ *   quadratic residue A.
+ * - For P = 5 (mod 8), Atkin's method: 2 is a non-residue, so with
+ *   V = (2A)^((P-5)/8), I = 2A V^2 = (2A)^((P-1)/4) is a square root of -1,
+ *   and R = A V (I - 1) has R^2 = A V^2 (-2I) = A (2A)^((P-1)/4) (-I) = A.
+ * - Otherwise, Tonelli-Shanks as above.
+ *
+ * The first two take a single exponentiation. They do not tell residues from
+ * non-residues, so the root is checked by squaring it. */
+bool
+mp_modsqrt_ctx(const mp_digit *a, mp_size asize, const mp_mont_ctx *ctx,
+	       mp_digit *w)
+{
+    ASSERT(a != NULL);
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m != NULL);
+    ASSERT(w != NULL);
+
+    const mp_digit *p = ctx->m;
+    const mp_size k = ctx->k;
+    mp_digit *x = MP_TMP_ALLOC(k * 5);
+    mp_digit *r = x + k, *e = r + k, *t = e + k, *one = t + k;
+
+    bool ok = true;
+    mp_mont_to(a, asize, ctx, x);
+    if (mp_is_zero(x, k)) {
+	mp_zero(w, k);
+	MP_TMP_FREE(x);
+	return true;
+    }
+    const mp_digit d = 1;
+    mp_mont_to(&d, 1, ctx, one);
+
+    if ((p[0] & 3) == 3) {
+	mp_rshift(p, k, 2, e);
+	mp_inc(e, k);
+	mp_mont_exp(x, e, k, ctx, r);
+    } else if ((p[0] & 7) == 5) {
+	mp_modadd(x, x, p, k, t);
+	mp_rshift(p, k, 3, e);
+	mp_mont_exp(t, e, k, ctx, r);
+	mp_mont_sqr(r, ctx, e);
+	mp_mont_mul(e, t, ctx, e);
+	mp_modsub(e, one, p, k, e);
+	mp_mont_mul(r, x, ctx, r);
+	mp_mont_mul(r, e, ctx, r);
+    } else {
+	ok = tonelli_shanks(x, one, ctx, e, r);
+    }
+
+    if (ok) {
+	mp_mont_sqr(r, ctx, t);
+	ok = mp_cmp_n(t, x, k) == 0;
+    }
+    if (ok)
+	mp_mont_from(r, ctx, w);
+    MP_TMP_FREE(x);
+    return ok;
+}
+
+bool
+mp_modsqrt(const mp_digit *a, mp_size asize,
+	   const mp_digit *p, mp_size psize, mp_digit *w)
+{
+    ASSERT(a != NULL);
+    ASSERT(p != NULL);
+    ASSERT(w != NULL);
+
+    const mp_size wsize = psize;
+    MP_NORMALIZE(p, psize);
+    ASSERT(psize != 0);
+    ASSERT(p[0] & 1);
+
+    mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+    mp_mont_ctx_init(&ctx, p, psize);
+    const bool ok = mp_modsqrt_ctx(a, asize, &ctx, w);
+    mp_mont_ctx_free(&ctx);
+    if (ok)
+	mp_zero(w + psize, wsize - psize);
+    return ok;
+}
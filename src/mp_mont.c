@@ -0,0 +1,496 @@
+/* mp_mont.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+#define MAX_K	8
+#define MAX_NK	(1U << MAX_K)
+
+/* Below this many digits, Montgomery products use the interleaved CIOS kernel
+ * with an S + 2 digit working set; from here on the product is formed with
+ * Karatsuba multiplication and then reduced. */
+#ifndef MONT_CIOS_THRESHOLD
+# define MONT_CIOS_THRESHOLD	KARATSUBA_MUL_THRESHOLD
+#endif /* !MONT_CIOS_THRESHOLD */
+
+/* Define this to use the FIOS kernel rather than CIOS. */
+/* #define MONT_USE_FIOS */
+#ifdef MONT_USE_FIOS
+# define mont_mul_kernel	mp_mont_mul_fios
+#else
+# define mont_mul_kernel	mp_mont_mul_cios
+#endif
+
+/* Decompose an unsigned 8-bit integer N into the form 2^K * Q, Q odd:
+ * K = pow2tab[N], Q = odd_tab[N] */
+static const uint8_t pow2tab[256] = {
+    0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+};
+
+static const uint8_t odd_tab[256] = {
+    0x00, 0x01, 0x01, 0x03, 0x01, 0x05, 0x03, 0x07, 0x01, 0x09, 0x05, 0x0b,
+    0x03, 0x0d, 0x07, 0x0f, 0x01, 0x11, 0x09, 0x13, 0x05, 0x15, 0x0b, 0x17,
+    0x03, 0x19, 0x0d, 0x1b, 0x07, 0x1d, 0x0f, 0x1f, 0x01, 0x21, 0x11, 0x23,
+    0x09, 0x25, 0x13, 0x27, 0x05, 0x29, 0x15, 0x2b, 0x0b, 0x2d, 0x17, 0x2f,
+    0x03, 0x31, 0x19, 0x33, 0x0d, 0x35, 0x1b, 0x37, 0x07, 0x39, 0x1d, 0x3b,
+    0x0f, 0x3d, 0x1f, 0x3f, 0x01, 0x41, 0x21, 0x43, 0x11, 0x45, 0x23, 0x47,
+    0x09, 0x49, 0x25, 0x4b, 0x13, 0x4d, 0x27, 0x4f, 0x05, 0x51, 0x29, 0x53,
+    0x15, 0x55, 0x2b, 0x57, 0x0b, 0x59, 0x2d, 0x5b, 0x17, 0x5d, 0x2f, 0x5f,
+    0x03, 0x61, 0x31, 0x63, 0x19, 0x65, 0x33, 0x67, 0x0d, 0x69, 0x35, 0x6b,
+    0x1b, 0x6d, 0x37, 0x6f, 0x07, 0x71, 0x39, 0x73, 0x1d, 0x75, 0x3b, 0x77,
+    0x0f, 0x79, 0x3d, 0x7b, 0x1f, 0x7d, 0x3f, 0x7f, 0x01, 0x81, 0x41, 0x83,
+    0x21, 0x85, 0x43, 0x87, 0x11, 0x89, 0x45, 0x8b, 0x23, 0x8d, 0x47, 0x8f,
+    0x09, 0x91, 0x49, 0x93, 0x25, 0x95, 0x4b, 0x97, 0x13, 0x99, 0x4d, 0x9b,
+    0x27, 0x9d, 0x4f, 0x9f, 0x05, 0xa1, 0x51, 0xa3, 0x29, 0xa5, 0x53, 0xa7,
+    0x15, 0xa9, 0x55, 0xab, 0x2b, 0xad, 0x57, 0xaf, 0x0b, 0xb1, 0x59, 0xb3,
+    0x2d, 0xb5, 0x5b, 0xb7, 0x17, 0xb9, 0x5d, 0xbb, 0x2f, 0xbd, 0x5f, 0xbf,
+    0x03, 0xc1, 0x61, 0xc3, 0x31, 0xc5, 0x63, 0xc7, 0x19, 0xc9, 0x65, 0xcb,
+    0x33, 0xcd, 0x67, 0xcf, 0x0d, 0xd1, 0x69, 0xd3, 0x35, 0xd5, 0x6b, 0xd7,
+    0x1b, 0xd9, 0x6d, 0xdb, 0x37, 0xdd, 0x6f, 0xdf, 0x07, 0xe1, 0x71, 0xe3,
+    0x39, 0xe5, 0x73, 0xe7, 0x1d, 0xe9, 0x75, 0xeb, 0x3b, 0xed, 0x77, 0xef,
+    0x0f, 0xf1, 0x79, 0xf3, 0x3d, 0xf5, 0x7b, 0xf7, 0x1f, 0xf9, 0x7d, 0xfb,
+    0x3f, 0xfd, 0x7f, 0xff
+};
+
+/* Montgomery product, as given by Dusse & Kaliski:
+ *  Input: a[0 .. s-1], b[0 .. s-1], n[0 .. s-1], n odd.
+ * Output: w[0 .. s-1]
+ * 1. Set t = a * b, n0' = -n^-1 mod B
+ * 2. For i = 0 to s-1 do
+ *      m = (t[i] * n0') mod B
+ *      t = t + n * m * B^i
+ * 3. Set t = t / B^s; if t >= n, t -= n
+ * 4. Output w = t
+ *
+ * This is mp_mont_redc, applied to a product formed beforehand. For small
+ * moduli, the kernels below instead interleave the multiplication with the
+ * reduction, following "Analyzing and Comparing Montgomery Multiplication
+ * Algorithms," by Koc, Acar & Kaliski, IEEE Micro 16(3), 1996. */
+
+#ifndef MP_MONT_MUL_CIOS_ASM
+/* Coarsely Integrated Operand Scanning: for each digit of V, add U * v[i] to T,
+ * then add a multiple of M to make T divisible by B and shift T down a digit.
+ *
+ *  Input: u[0..s-1], v[0..s-1] < M, m[0..s-1] odd, m0_inv = -M^-1 mod B
+ * Output: t[0..s] = U * V / B^s mod M + (0 or M), less than 2M. T must have
+ *         room for s + 2 digits. */
+void
+mp_mont_mul_cios(const mp_digit *u, const mp_digit *v, const mp_digit *m,
+		 mp_size s, mp_digit m0_inv, mp_digit *t)
+{
+    mp_zero(t, s + 2);
+    for (mp_size i = 0; i < s; i++) {
+	const mp_digit vi = v[i];
+	mp_digit c = 0, hi, lo;
+	for (mp_size j = 0; j < s; j++) {
+	    digit_mul(u[j], vi, hi, lo);
+	    lo += c;
+	    hi += (lo < c);
+	    lo += t[j];
+	    hi += (lo < t[j]);
+	    t[j] = lo;
+	    c = hi;
+	}
+	t[s] += c;
+	t[s + 1] = (t[s] < c);
+
+	const mp_digit q = t[0] * m0_inv;
+	digit_mul(q, m[0], hi, lo);
+	lo += t[0];
+	c = hi + (lo < t[0]);
+	for (mp_size j = 1; j < s; j++) {
+	    digit_mul(q, m[j], hi, lo);
+	    lo += c;
+	    hi += (lo < c);
+	    lo += t[j];
+	    hi += (lo < t[j]);
+	    t[j - 1] = lo;
+	    c = hi;
+	}
+	t[s - 1] = t[s] + c;
+	t[s] = t[s + 1] + (t[s - 1] < c);
+    }
+}
+#endif /* !MP_MONT_MUL_CIOS_ASM */
+
+#ifndef MP_MONT_MUL_FIOS_ASM
+/* Finely Integrated Operand Scanning: as CIOS, but with both products added in
+ * a single pass over the digits, each with its own carry. Same input and
+ * output as mp_mont_mul_cios. */
+void
+mp_mont_mul_fios(const mp_digit *u, const mp_digit *v, const mp_digit *m,
+		 mp_size s, mp_digit m0_inv, mp_digit *t)
+{
+    mp_zero(t, s + 2);
+    for (mp_size i = 0; i < s; i++) {
+	const mp_digit vi = v[i];
+	mp_digit c1, c2, hi, lo, hi2, lo2;
+	digit_mul(u[0], vi, hi, lo);
+	lo += t[0];
+	c1 = hi + (lo < t[0]);
+	const mp_digit q = lo * m0_inv;
+	digit_mul(q, m[0], hi2, lo2);
+	lo2 += lo;
+	c2 = hi2 + (lo2 < lo);
+	for (mp_size j = 1; j < s; j++) {
+	    digit_mul(u[j], vi, hi, lo);
+	    lo += t[j];
+	    hi += (lo < t[j]);
+	    lo += c1;
+	    c1 = hi + (lo < c1);
+	    digit_mul(q, m[j], hi2, lo2);
+	    lo2 += lo;
+	    hi2 += (lo2 < lo);
+	    lo2 += c2;
+	    c2 = hi2 + (lo2 < c2);
+	    t[j - 1] = lo2;
+	}
+	mp_digit x = t[s] + c1;
+	mp_digit cy = (x < c1);
+	x += c2;
+	cy += (x < c2);
+	t[s - 1] = x;
+	t[s] = cy;
+    }
+}
+#endif /* !MP_MONT_MUL_FIOS_ASM */
+
+/* W = U * V / R mod M with an interleaved kernel; T has room for k + 2
+ * digits. */
+static void
+mont_mul_small(const mp_digit *u, const mp_digit *v, const mp_mont_ctx *ctx,
+	       mp_digit *t, mp_digit *w)
+{
+    const mp_size k = ctx->k;
+    mont_mul_kernel(u, v, ctx->m, k, ctx->m0_inv, t);
+    if (t[k] || mp_cmp_n(t, ctx->m, k) >= 0)
+	ASSERT(mp_subi_n(t, ctx->m, k) == t[k]);
+    mp_copy(t, k, w);
+}
+
+/* Set up CTX for arithmetic modulo M, which must be odd. R = B^K where K is the
+ * normalized size of M, and R^2 mod M is kept for conversion into Montgomery
+ * form. M is not copied and must outlive CTX. */
+void
+mp_mont_ctx_init(mp_mont_ctx *ctx, const mp_digit *m, mp_size msize)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m == NULL);
+    ASSERT(ctx->r2 == NULL);
+    ASSERT(ctx->k == 0);
+
+    MP_NORMALIZE(m, msize);
+    ASSERT(msize != 0);
+    ASSERT((m[0] & 1) == 1);
+
+    mp_digit *s = MP_TMP_ALLOC0(msize * 2 + 1);
+    s[msize * 2] = 1;
+
+    ctx->m = m;
+    ctx->k = msize;
+    ctx->m0_inv = -mp_digit_invert(m[0]);
+    ctx->r2 = mp_new(msize);
+    mp_mod(s, msize * 2 + 1, m, msize, ctx->r2);
+
+    MP_TMP_FREE(s);
+}
+
+void
+mp_mont_ctx_free(mp_mont_ctx *ctx)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m != NULL);
+    ASSERT(ctx->r2 != NULL);
+    ASSERT(ctx->k != 0);
+
+    ctx->m = NULL;
+    mp_free(ctx->r2);
+    ctx->r2 = NULL;
+    ctx->m0_inv = 0;
+    ctx->k = 0;
+}
+
+/*  Input: t[0..2s-1] < M * R
+ * Output: w[0..s-1] = t * R^-1 mod M; T is overwritten. */
+void
+mp_mont_redc(mp_digit *t, const mp_mont_ctx *ctx, mp_digit *w)
+{
+    const mp_size s = ctx->k;
+    const mp_digit *n = ctx->m;
+    mp_digit cy = 0;
+    for (mp_size i = 0; i < s; i++) {
+	const mp_digit m = t[i] * ctx->m0_inv;
+	const mp_digit co = mp_dmul_add(n, s, m, &t[i]);
+	if (co)
+	    cy += mp_daddi(&t[s + i], s - i, co);
+	ASSERT(t[i] == 0);
+    }
+
+    t += s;
+    if (cy || mp_cmp_n(t, n, s) >= 0) {
+	cy -= mp_subi_n(t, n, s);
+	ASSERT(cy == 0);
+    }
+    mp_copy(t, s, w);
+}
+
+/* W = U * R mod M; W may alias U. Any U of at most K digits satisfies
+ * U * (R^2 mod M) < M * R, so a Montgomery product with R^2 suffices; larger U
+ * are reduced first. */
+void
+mp_mont_to(const mp_digit *u, mp_size usize, const mp_mont_ctx *ctx,
+	   mp_digit *w)
+{
+    const mp_size k = ctx->k;
+    MP_NORMALIZE(u, usize);
+
+    mp_digit *t = MP_TMP_ALLOC(3 * k);
+    if (usize > k) {
+	mp_mod(u, usize, ctx->m, k, t + 2 * k);
+	mp_mul_n(t + 2 * k, ctx->r2, k, t);
+    } else if (usize == 0) {
+	mp_zero(t, 2 * k);
+    } else {
+	mp_mul(ctx->r2, k, u, usize, t);
+	mp_zero(t + k + usize, k - usize);
+    }
+    mp_mont_redc(t, ctx, w);
+    MP_TMP_FREE(t);
+}
+
+/* W = U * R^-1 mod M, for U in Montgomery form; W may alias U. */
+void
+mp_mont_from(const mp_digit *u, const mp_mont_ctx *ctx, mp_digit *w)
+{
+    const mp_size k = ctx->k;
+    mp_digit *t = MP_TMP_ALLOC(2 * k);
+    mp_copy(u, k, t);
+    mp_zero(t + k, k);
+    mp_mont_redc(t, ctx, w);
+    MP_TMP_FREE(t);
+}
+
+/* W = U * V * R^-1 mod M; W may alias U or V. */
+void
+mp_mont_mul(const mp_digit *u, const mp_digit *v, const mp_mont_ctx *ctx,
+	    mp_digit *w)
+{
+    const mp_size k = ctx->k;
+    mp_digit *t = MP_TMP_ALLOC(2 * k + 2);
+    if (k < MONT_CIOS_THRESHOLD) {
+	mont_mul_small(u, v, ctx, t, w);
+    } else {
+	mp_mul_n(u, v, k, t);
+	mp_mont_redc(t, ctx, w);
+    }
+    MP_TMP_FREE(t);
+}
+
+/* W = U^2 * R^-1 mod M; W may alias U. */
+void
+mp_mont_sqr(const mp_digit *u, const mp_mont_ctx *ctx, mp_digit *w)
+{
+    const mp_size k = ctx->k;
+    mp_digit *t = MP_TMP_ALLOC(2 * k + 2);
+    if (k < MONT_CIOS_THRESHOLD) {
+	mont_mul_small(u, u, ctx, t, w);
+    } else {
+	mp_sqr(u, k, t);
+	mp_mont_redc(t, ctx, w);
+    }
+    MP_TMP_FREE(t);
+}
+
+/* Base 2^k exponentiation with Montgomery modular reduction, based on
+ * algorithm 1.2.4 from Cohen, "A Course in Computational Algebraic Number
+ * Theory." Both U and W are in Montgomery form; W may alias U. */
+void
+mp_mont_exp(const mp_digit *u, const mp_digit *p, mp_size psize,
+	    const mp_mont_ctx *ctx, mp_digit *w)
+{
+    ASSERT(u != NULL);
+    ASSERT(p != NULL);
+    ASSERT(ctx != NULL);
+    ASSERT(w != NULL);
+
+    const mp_size msize = ctx->k;
+    MP_NORMALIZE(p, psize);
+    if (psize == 0) {
+	/* U^0 = 1, which is R mod M in Montgomery form. */
+	mp_digit one = 1;
+	mp_mont_to(&one, 1, ctx, w);
+	return;
+    }
+    if (mp_is_zero(u, msize)) {
+	mp_zero(w, msize);
+	return;
+    }
+
+    /* Choose optimal value of K */
+    unsigned b = mp_significant_bits(p, psize);
+    unsigned k = MAX_K;
+    for (; k > 1; k--) {
+	if (((k - 1) * (k << ((k - 1) << 1)) / ((1 << k) - k - 1)) < (b - 1))
+	    break;
+    }
+    unsigned nk = 1U << k;
+
+    mp_digit *tmp = MP_TMP_ALLOC(msize * 2 + 2);
+    mp_digit *up[MAX_NK] = { NULL };
+    up[1] = MP_TMP_COPY(u, msize);
+
+    const bool small = msize < MONT_CIOS_THRESHOLD;
+#define SQR(a, r) \
+    do { \
+	if (small) { \
+	    mont_mul_small((a), (a), ctx, tmp, (r)); \
+	} else { \
+	    mp_sqr((a), msize, tmp); \
+	    mp_mont_redc(tmp, ctx, (r)); \
+	} \
+    } while (0)
+#define MUL(a, b, r) \
+    do { \
+	if (small) { \
+	    mont_mul_small((a), (b), ctx, tmp, (r)); \
+	} else { \
+	    mp_mul_n((a), (b), msize, tmp); \
+	    mp_mont_redc(tmp, ctx, (r)); \
+	} \
+    } while (0)
+
+    up[2] = MP_TMP_ALLOC(msize);
+    SQR(up[1], up[2]);
+
+    for (unsigned j = 3; j < nk; j += 2) {
+	up[j] = MP_TMP_ALLOC(msize);
+	MUL(up[2], up[j-2], up[j]);
+    }
+
+    unsigned t = b % k;
+    if (t != 0)
+	b += k - t;
+    ASSERT(b % k == 0);
+
+    unsigned a = 0;
+    mp_digit mask = (mp_digit)1 << (b % MP_DIGIT_BITS);
+    for (unsigned j = k; j != 0; j--) {
+	ASSERT(b != 0);
+	b -= 1;
+	if ((mask >>= 1) == 0)
+	    mask = MP_DIGIT_MSB;
+	if ((b / MP_DIGIT_BITS) >= psize)
+	    continue;
+	a <<= 1;
+	if (p[b / MP_DIGIT_BITS] & mask)
+	    a |= 1;
+    }
+    ASSERT(a != 0);
+    t = pow2tab[a];
+    a = odd_tab[a];
+    mp_copy(up[a], msize, w);
+    for (unsigned j = t; j != 0; j--) {
+	SQR(w, w);
+    }
+
+    while (b != 0) {
+	a = 0;
+	for (unsigned j = k; j != 0; j--) {
+	    ASSERT(b != 0);
+	    b -= 1;
+	    if ((mask >>= 1) == 0)
+		mask = MP_DIGIT_MSB;
+	    a <<= 1;
+	    if (p[b / MP_DIGIT_BITS] & mask)
+		a |= 1;
+	}
+	if (a == 0) {
+	    for (unsigned j = k; j != 0; j--) {
+		SQR(w, w);
+	    }
+	} else {
+	    t = pow2tab[a];
+	    a = odd_tab[a];
+	    for (unsigned j = k - t; j != 0; j--) {
+		SQR(w, w);
+	    }
+	    MUL(w, up[a], w);
+	    for (unsigned j = t; j != 0; j--) {
+		SQR(w, w);
+	    }
+	}
+    }
+#undef SQR
+#undef MUL
+
+    MP_TMP_FREE(up[1]);
+    MP_TMP_FREE(up[2]);
+    for (unsigned j = 3; j < nk; j += 2)
+	MP_TMP_FREE(up[j]);
+    MP_TMP_FREE(tmp);
+}
+
+/* Left-to-right binary exponentiation by a one-word exponent, without a table
+ * of powers. This is the binary addition chain for EXPONENT: one squaring per
+ * bit after the first, and one multiplication per further one bit. For the
+ * exponents 2^k + 1 used as RSA public exponents (3, 17, 65537) it is optimal,
+ * and skips the 2^(k-1) precomputed powers mp_mont_exp() would set up. Both U
+ * and W are in Montgomery form; W may alias U. */
+void
+mp_mont_exp_u64(const mp_digit *u, uint64_t exponent,
+		const mp_mont_ctx *ctx, mp_digit *w)
+{
+    ASSERT(u != NULL);
+    ASSERT(ctx != NULL);
+    ASSERT(w != NULL);
+
+    const mp_size msize = ctx->k;
+    if (exponent == 0) {
+	mp_digit one = 1;
+	mp_mont_to(&one, 1, ctx, w);
+	return;
+    }
+
+    mp_digit *tmp = MP_TMP_ALLOC(msize * 3 + 2);
+    mp_digit *base = tmp + msize * 2 + 2;
+    mp_copy(u, msize, base);
+    mp_copy(base, msize, w);
+
+    unsigned b = 63;
+    while (!(exponent >> b))
+	b--;
+    const bool small = msize < MONT_CIOS_THRESHOLD;
+    while (b-- != 0) {
+	if (small) {
+	    mont_mul_small(w, w, ctx, tmp, w);
+	} else {
+	    mp_sqr(w, msize, tmp);
+	    mp_mont_redc(tmp, ctx, w);
+	}
+	if ((exponent >> b) & 1) {
+	    if (small) {
+		mont_mul_small(w, base, ctx, tmp, w);
+	    } else {
+		mp_mul_n(w, base, msize, tmp);
+		mp_mont_redc(tmp, ctx, w);
+	    }
+	}
+    }
+    MP_TMP_FREE(tmp);
+}
@@ -20,6 +20,7 @@ _mp_mul_base(const mp_digit *u, mp_size usize,
 	mp_zero(w + (ul + vl), usize + vsize - (ul + vl));
     /* One or both are zero. */
     if (!ul || !vl) {
+	mp_zero(w, ul + vl);
 	return;
     }
 
@@ -254,13 +255,25 @@ mp_mul_mod_powb(const mp_digit *u, mp_size usize,
 	return;
     }
 
-    mp_zero(w, wsize);
-
     if (usize < vsize) {
 	SWAP(u, v, const mp_digit *);
 	SWAP(usize, vsize, mp_size);
     }
 
+    /* The schoolbook short product only saves half of a quadratic product, so
+     * large operands are better off truncated and multiplied out in full. */
+    if (MIN(vsize, wsize) >= MUL_MOD_POWB_FULL_THRESHOLD) {
+	usize = MIN(usize, wsize);
+	vsize = MIN(vsize, wsize);
+	mp_digit *tmp = mp_new(usize + vsize);
+	mp_mul(u, usize, v, vsize, tmp);
+	mp_copy(tmp, wsize, w);
+	mp_free(tmp);
+	return;
+    }
+
+    mp_zero(w, wsize);
+
     mp_size j = 0;
     if (wsize > usize)
 	mp_mul(u, usize, v, j = wsize - usize, w);
@@ -0,0 +1,165 @@
+/* mp_multiexp.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+#include "weecrypt_memory.h"
+
+/* Largest sliding window used for any one base. */
+#ifndef MULTIEXP_MAX_WINDOW
+# define MULTIEXP_MAX_WINDOW	6
+#endif /* !MULTIEXP_MAX_WINDOW */
+
+/* Set w[msize] = 1 mod M. */
+static void
+set_one(const mp_digit *m, mp_size msize, mp_digit *w)
+{
+    mp_zero(w, msize);
+    w[0] = (msize > 1 || m[0] != 1);
+}
+
+/* An even M = 2^K N, N odd, has no Montgomery form, but N does. As in
+ * mp_mexp(), run the interleaved chain modulo N, multiply together the powers
+ * modulo 2^K, where products are truncated rather than reduced, and recombine
+ * the two by the Chinese remainder theorem. */
+static void
+multi_exp_even(const mp_digit *const *bases, const mp_size *bsizes,
+	       const mp_digit *const *exps, const mp_size *esizes,
+	       unsigned n, const mp_digit *m, mp_size msize, mp_digit *w)
+{
+    const unsigned k = mp_odd_shift(m, msize);
+    const mp_size ksize = (k + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS;
+    const mp_size nsize = msize - k / MP_DIGIT_BITS;
+    mp_digit *c = MP_TMP_ALLOC(3 * ksize + 2 * nsize);
+    mp_digit *p = c + ksize, *t = p + ksize;
+    mp_digit *odd = t + ksize, *a = odd + nsize;
+
+    /* C = prod U_i^P_i mod 2^K */
+    mp_modexp_2k(bases[0], bsizes[0], exps[0], esizes[0], k, c);
+    for (unsigned i = 1; i < n; i++) {
+	mp_modexp_2k(bases[i], bsizes[i], exps[i], esizes[i], k, p);
+	mp_mul_mod_powb(c, ksize, p, ksize, t, ksize);
+	if (k % MP_DIGIT_BITS)
+	    t[ksize - 1] &= ((mp_digit)1 << (k % MP_DIGIT_BITS)) - 1;
+	mp_copy(t, ksize, c);
+    }
+    if (mp_is_pow2(m, msize)) {
+	mp_copy(c, ksize, w);
+	mp_zero(w + ksize, msize - ksize);
+	MP_TMP_FREE(c);
+	return;
+    }
+
+    /* N = M / 2^K */
+    if (k % MP_DIGIT_BITS)
+	mp_rshift(m + k / MP_DIGIT_BITS, nsize, k % MP_DIGIT_BITS, odd);
+    else
+	mp_copy(m + k / MP_DIGIT_BITS, nsize, odd);
+    const mp_size nlen = mp_rsize(odd, nsize);
+    mp_multi_exp(bases, bsizes, exps, esizes, n, odd, nlen, a);
+    mp_crt_2k(a, odd, nlen, c, k, w, msize);
+    MP_TMP_FREE(c);
+}
+
+/* Interleaved sliding windows, as in Moller, "Algorithms for
+ * multi-exponentiation," SAC 2001: each base gets its own table of odd powers
+ * and window width, but all of them share a single chain of squarings. Scanning
+ * the exponents from the top bit down, a window of base i is opened at the
+ * first one bit not yet covered and closed at its last one bit, where the
+ * accumulator is multiplied by the table entry. The cost is max(L_i)
+ * squarings plus about sum(L_i / (w_i + 1)) multiplications, rather than
+ * sum(L_i) squarings for separate exponentiations. */
+void
+mp_multi_exp(const mp_digit *const *bases, const mp_size *bsizes,
+	     const mp_digit *const *exps, const mp_size *esizes,
+	     unsigned n, const mp_digit *m, mp_size msize, mp_digit *w)
+{
+    ASSERT(bases != NULL);
+    ASSERT(bsizes != NULL);
+    ASSERT(exps != NULL);
+    ASSERT(esizes != NULL);
+    ASSERT(m != NULL);
+    ASSERT(w != NULL);
+
+    MP_NORMALIZE(m, msize);
+    ASSERT(msize != 0);
+    if (n == 0) {
+	set_one(m, msize, w);
+	return;
+    }
+    if ((m[0] & 1) == 0) {
+	multi_exp_even(bases, bsizes, exps, esizes, n, m, msize, w);
+	return;
+    }
+
+    mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+    mp_mont_ctx_init(&ctx, m, msize);
+
+    /* Lay out the tables of odd powers, one after another. */
+    unsigned *window = MALLOC(n * 4 * sizeof(unsigned));
+    unsigned *offset = window + n;	/* Start of table i, in entries. */
+    unsigned *close = offset + n;	/* Bit where open window ends, plus 1. */
+    unsigned *value = close + n;	/* Its bits, which select the entry. */
+    unsigned maxbits = 0, entries = 0;
+    for (unsigned i = 0; i < n; i++) {
+	const unsigned bits = mp_significant_bits(exps[i], esizes[i]);
+	window[i] = mp_window_size(bits, MULTIEXP_MAX_WINDOW);
+	offset[i] = entries;
+	close[i] = 0;
+	if (bits != 0)
+	    entries += 1U << (window[i] - 1);
+	maxbits = MAX(maxbits, bits);
+    }
+    if (maxbits == 0) {
+	/* All exponents are zero. */
+	FREE(window);
+	set_one(m, msize, w);
+	mp_mont_ctx_free(&ctx);
+	return;
+    }
+
+    mp_digit *table = mp_new(entries * msize);
+    mp_digit *u2 = MP_TMP_ALLOC(msize);
+    for (unsigned i = 0; i < n; i++) {
+	if (mp_is_zero(exps[i], esizes[i]))
+	    continue;
+	mp_digit *tab = table + offset[i] * msize;
+	mp_mont_to(bases[i], bsizes[i], &ctx, tab);
+	const unsigned count = 1U << (window[i] - 1);
+	if (count > 1)
+	    mp_mont_sqr(tab, &ctx, u2);
+	for (unsigned j = 1; j < count; j++)
+	    mp_mont_mul(tab + (j - 1) * msize, u2, &ctx, tab + j * msize);
+    }
+    MP_TMP_FREE(u2);
+
+    bool first = true;
+    for (unsigned b = maxbits; b-- > 0; ) {
+	if (!first)
+	    mp_mont_sqr(w, &ctx, w);
+	for (unsigned i = 0; i < n; i++) {
+	    if (close[i] == 0) {
+		if (!mp_exp_bit(exps[i], esizes[i], b))
+		    continue;
+		/* Open the longest window b .. l ending in a one. */
+		close[i] = mp_window_scan(exps[i], esizes[i], b + 1, window[i],
+					  &value[i]) + 1;
+	    }
+	    if (close[i] != b + 1)
+		continue;
+	    const mp_digit *e = table + (offset[i] + (value[i] >> 1)) * msize;
+	    if (first) {
+		mp_copy(e, msize, w);
+		first = false;
+	    } else {
+		mp_mont_mul(w, e, &ctx, w);
+	    }
+	    close[i] = 0;
+	}
+    }
+    mp_mont_from(w, &ctx, w);
+
+    mp_free(table);
+    FREE(window);
+    mp_mont_ctx_free(&ctx);
+}
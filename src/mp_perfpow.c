@@ -0,0 +1,233 @@
+/* mp_perfpow.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Number of primes Q = 1 (mod P) used to filter out P-th power non-residues
+ * before a P-th root is attempted. */
+#ifndef PERFPOW_FILTER_PRIMES
+# define PERFPOW_FILTER_PRIMES	3
+#endif /* !PERFPOW_FILTER_PRIMES */
+
+/* Number of bits above a single-digit candidate root that must be zero. */
+#ifndef PERFPOW_2ADIC_CHECK_BITS
+# define PERFPOW_2ADIC_CHECK_BITS	16
+#endif /* !PERFPOW_2ADIC_CHECK_BITS */
+
+/* Number of odd candidate exponents sieved at a time. */
+#define EXPONENT_SIEVE_SIZE	1024
+
+/* Enumerates the odd primes in increasing order, sieving a window of odd
+ * numbers base, base + 2, ..., base + 2 * (EXPONENT_SIEVE_SIZE - 1) at a
+ * time. */
+typedef struct {
+    unsigned	base;
+    unsigned	pos;
+    bool	composite[EXPONENT_SIEVE_SIZE];
+} exponent_sieve;
+
+static void
+exponent_sieve_fill(exponent_sieve *s)
+{
+    const unsigned end = s->base + 2 * EXPONENT_SIEVE_SIZE;
+
+    memset(s->composite, 0, sizeof(s->composite));
+    for (unsigned d = 3; d * d < end; d += 2) {
+	unsigned m = d * d;
+	if (m < s->base) {
+	    m = s->base + (d - s->base % d) % d;
+	    if ((m & 1) == 0)
+		m += d;
+	}
+	for (; m < end; m += 2 * d)
+	    s->composite[(m - s->base) / 2] = true;
+    }
+    s->pos = 0;
+}
+
+static void
+exponent_sieve_init(exponent_sieve *s)
+{
+    s->base = 3;
+    exponent_sieve_fill(s);
+}
+
+static unsigned
+exponent_sieve_next(exponent_sieve *s)
+{
+    for (;;) {
+	while (s->pos < EXPONENT_SIEVE_SIZE) {
+	    const unsigned pos = s->pos++;
+	    if (!s->composite[pos])
+		return s->base + 2 * pos;
+	}
+	s->base += 2 * EXPONENT_SIEVE_SIZE;
+	exponent_sieve_fill(s);
+    }
+}
+
+/* Return true if N, which must be odd and at least 3, is prime. */
+static bool
+odd_is_prime(mp_digit n)
+{
+    for (mp_digit d = 3; d <= n / d; d += 2)
+	if (n % d == 0)
+	    return false;
+    return true;
+}
+
+/* Return A^E (mod M), for A < M. */
+static mp_digit
+digit_modexp(mp_digit a, mp_digit e, mp_digit m)
+{
+    mp_digit r = 1, hi, lo, q;
+
+    for (; e; e >>= 1) {
+	if (e & 1) {
+	    digit_mul(r, a, hi, lo);
+	    digit_div(hi, lo, m, q, r);
+	}
+	digit_sqr(a, hi, lo);
+	digit_div(hi, lo, m, q, a);
+    }
+    (void)q;
+    return r;
+}
+
+/* If U is a P-th power, its residue modulo a prime Q = 1 (mod P) is either 0 or
+ * a P-th power residue, i.e. U^((Q-1)/P) = 1 (mod Q). Each such Q rejects all
+ * but about 1/P of non-powers. The primes are multiplied together so that U is
+ * only reduced once, by their product. Return false if U is certainly not a
+ * P-th power. */
+static bool
+residue_filter(const mp_digit *u, mp_size usize, unsigned p)
+{
+    mp_digit q[PERFPOW_FILTER_PRIMES];
+    unsigned nprimes = 0;
+    mp_digit m = 1;
+    for (mp_digit i = 1; nprimes < PERFPOW_FILTER_PRIMES && i <= 64; i++) {
+	if (p > (MP_DIGIT_MAX - 1) / (2 * i))
+	    break;
+	const mp_digit qi = 2 * i * p + 1;
+	if (!odd_is_prime(qi))
+	    continue;
+	if (m > MP_DIGIT_MAX / qi)
+	    break;
+	m *= qi;
+	q[nprimes++] = qi;
+    }
+    if (nprimes == 0)
+	return true;
+
+    const mp_digit r = mp_dmod(u, usize, m);
+    for (unsigned i = 0; i < nprimes; i++) {
+	const mp_digit ri = r % q[i];
+	if (ri != 0 && digit_modexp(ri, (q[i] - 1) / p, q[i]) != 1)
+	    return false;
+    }
+    return true;
+}
+
+/* Every odd residue X modulo 2^C satisfies X^(2^(C-1)) = 1, so for odd P and
+ * E = 1/P (mod 2^(C-1)), X = (X^P)^E. Hence an odd U has exactly one P-th root
+ * modulo 2^C, for C <= MP_DIGIT_BITS, namely U^E. */
+static mp_digit
+digit_root_2adic(mp_digit u, unsigned p, unsigned c)
+{
+    ASSERT(c >= 1 && c <= MP_DIGIT_BITS);
+
+    mp_digit e = mp_digit_invert((mp_digit)p);
+    if (c < MP_DIGIT_BITS)
+	e &= ((mp_digit)1 << (c - 1)) - 1;
+    mp_digit r = 1;
+    for (; e; e >>= 1) {
+	r *= (e & 1) ? u : 1;
+	u *= u;
+    }
+    if (c < MP_DIGIT_BITS)
+	r &= ((mp_digit)1 << c) - 1;
+    return r;
+}
+
+/* Return true and store the root in ROOT if U, which has NBITS significant bits
+ * and is divisible by exactly 2^TWOS, is a perfect P-th power for prime P. */
+static bool
+is_pth_power(const mp_digit *u, mp_size usize, unsigned nbits, unsigned twos,
+	     unsigned p, mp_digit *root)
+{
+    /* A P-th power is divisible by a power of two that is a multiple of P. */
+    if (twos % p)
+	return false;
+    if (p == 2) {
+	if (!mp_perfsqr(u, usize))
+	    return false;
+	mp_sqrt(u, usize, root);
+	return true;
+    }
+    const unsigned b = (nbits + p - 1) / p;
+    if (twos == 0 && b <= MP_DIGIT_BITS) {
+	/* A P-th root would fit in a digit and have exactly B bits, so it can
+	 * only be the 2-adic root of the low digit of U. Checking that this has
+	 * B bits only requires it modulo 2^C for a few more bits C > B. */
+	const unsigned c = MIN(b + PERFPOW_2ADIC_CHECK_BITS, MP_DIGIT_BITS);
+	const mp_digit y = digit_root_2adic(u[0], p, c);
+	if (mp_digit_log2(y) != b - 1)
+	    return false;
+    }
+    /* That check is weak when B is close to a full digit, so filter further. */
+    if (!residue_filter(u, usize, p))
+	return false;
+
+    mp_digit *rem = MP_TMP_ALLOC(usize);
+    mp_rootrem(u, usize, p, root, rem);
+    const bool is_power = mp_is_zero(rem, usize);
+    MP_TMP_FREE(rem);
+    return is_power;
+}
+
+/* If U = X^K with K maximal, then U is a P-th power for each prime P dividing K,
+ * and X^(K/P) has maximal exponent K/P. So test prime exponents P in increasing
+ * order, and on success replace U by its P-th root and continue with the same
+ * P. Since U >= 2^P for a P-th power, only P < lg(U) need be tested. */
+unsigned
+mp_perfect_power(const mp_digit *u, mp_size usize, mp_digit *root)
+{
+    ASSERT(u != NULL);
+
+    const mp_size rsize = (usize + 1) / 2;
+    if (root != NULL)
+	mp_zero(root, rsize);
+    MP_NORMALIZE(u, usize);
+    if (usize == 0 || (usize == 1 && u[0] == 1))
+	return 0;
+
+    mp_digit *cur = MP_TMP_COPY(u, usize);
+    mp_digit *x = MP_TMP_ALLOC(rsize);
+    mp_size csize = usize;
+    exponent_sieve sieve;
+    exponent_sieve_init(&sieve);
+    unsigned k = 1;
+    unsigned p = 2;
+    for (;;) {
+	const unsigned nbits = mp_significant_bits(cur, csize);
+	const unsigned twos = mp_odd_shift(cur, csize);
+	if (p >= nbits || (twos && p > twos))
+	    break;
+	if (is_pth_power(cur, csize, nbits, twos, p, x)) {
+	    k *= p;
+	    csize = mp_rsize(x, (csize + p - 1) / p);
+	    mp_copy(x, csize, cur);
+	    continue;
+	}
+	p = exponent_sieve_next(&sieve);
+    }
+
+    if (k == 1)
+	k = 0;
+    else if (root != NULL)
+	mp_copy(cur, csize, root);
+    MP_TMP_FREE(cur);
+    MP_TMP_FREE(x);
+    return k;
+}
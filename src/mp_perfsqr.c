@@ -5,42 +5,133 @@
 #include "mp_internal.h"
 
 /* Adapted from Algorithm 1.7.3 from Cohen, "A Course in Computational
- * Algebraic Number Theory" */
+ * Algebraic Number Theory": before taking a square root, check that N is a
+ * quadratic residue modulo several small numbers. Rather than reducing N once
+ * for each of them, N is reduced once modulo
+ *
+ * 2^48 - 1 = 3^2 * 5 * 7 * 13 * 17 * 97 * 241 * 257 * 673,
+ *
+ * which takes only additions, and the small moduli are taken from that. */
 
-/* q11[N mod 11] = 0 if N non-perfect
- * for (k = 0; k < 11; k++) q11[k] = 0;
- * for (k = 0; k <  6; k++) q11[(k * k) % 11] = 1; */
-static const uint8_t q11[11] = {
-    1, 1, 0, 1, 1, 1, 0, 0, 0, 1, 0
+/* Bit R of sqM is set iff R is a square modulo M:
+ * for (k = 0; k < M; k++) sqM[((k * k) % M) / 64] |= 1 << (((k * k) % M) % 64);
+ */
+#define IS_SQUARE(tbl, r)	(((tbl)[(r) / 64] >> ((r) % 64)) & 1)
+
+static const uint64_t sq64 = UINT64_C(0x0202021202030213);
+
+static const uint64_t sq63[1] = {
+    UINT64_C(0x0402483012450293)
+};
+
+static const uint64_t sq65[2] = {
+    UINT64_C(0x218a019866014613),
+    UINT64_C(0x0000000000000001)
 };
 
-/* q63[N mod 63] = 0 if N non-perfect
- * for (k = 0; k < 63; k++) q63[k] = 0;
- * for (k = 0; k < 32; k++) q63[(k * k) % 63] = 1; */
-static const uint8_t q63[63] = {
-    1, 1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 1,
-    0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0,
-    1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0
+static const uint64_t sq17[1] = {
+    UINT64_C(0x000000000001a317)
 };
 
-/* q64[N mod 64] = 0 if N non-perfect
- * for (k = 0; k < 64; k++) q64[k] = 0;
- * for (k = 0; k < 32; k++) q64[(k * k) % 64] = 1; */
-static const uint8_t q64[64] = {
-    1, 1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
-    0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0,
-    0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0
+static const uint64_t sq97[2] = {
+    UINT64_C(0x6067981b8b451b5f),
+    UINT64_C(0x00000001eb628b47)
 };
 
-/* q11[N mod 11] = 0 if N non-perfect
- * for (k = 0; k < 65; k++) q65[k] = 0;
- * for (k = 0; k < 33; k++) q65[(k * k) % 65] = 1; */
-static const uint8_t q65[65] = {
-    1, 1, 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
-    0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 0, 0, 0,
-    0, 0, 0, 1, 0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 0, 1, 0, 0, 1
+static const uint64_t sq241[4] = {
+    UINT64_C(0x3c67a3116b15977f),
+    UINT64_C(0x2fd21c174c8fa909),
+    UINT64_C(0x98f24257c4cba0e1),
+    UINT64_C(0x0001fba6a35a2317)
 };
 
+static const uint64_t sq257[5] = {
+    UINT64_C(0x7e16541de6e7ab17),
+    UINT64_C(0x1f76811c93128359),
+    UINT64_C(0x6b052324e205bbe3),
+    UINT64_C(0xa3579d9ee0a9a1fa),
+    UINT64_C(0x0000000000000001)
+};
+
+static const uint64_t sq673[11] = {
+    UINT64_C(0x85f744b13fa573df),
+    UINT64_C(0xc231d5979aba4f21),
+    UINT64_C(0xe944c76e98dd0c01),
+    UINT64_C(0xd20e0f2bd993e915),
+    UINT64_C(0x616259fb225208ab),
+    UINT64_C(0x7e691a18f8b7b47c),
+    UINT64_C(0x53c1c12f54412913),
+    UINT64_C(0xdb8c8a5ea25f266f),
+    UINT64_C(0xa6ae310e00c2ec65),
+    UINT64_C(0x348bbe8613c97567),
+    UINT64_C(0x00000001ef3a97f2)
+};
+
+#define MOD48_MASK	((UINT64_C(1) << 48) - 1)
+
+/* Return X modulo 2^48 - 1, as a number of at most 48 bits. */
+static inline uint64_t
+fold48(uint64_t x)
+{
+    while (x > MOD48_MASK)
+	x = (x & MOD48_MASK) + (x >> 48);
+    return x;
+}
+
+/* Return X * 2^S modulo 2^48 - 1, for X of at most 48 bits and S < 48, which is
+ * a rotation of the 48 bits of X. */
+static inline uint64_t
+rot48(uint64_t x, unsigned s)
+{
+    return s ? ((x << s) & MOD48_MASK) | (x >> (48 - s)) : x;
+}
+
+/* Return u[usize] modulo 2^48 - 1 (possibly equal to 2^48 - 1). Since
+ * 2^48 = 1 (mod 2^48 - 1), B^P = 1 for P = 48 / gcd(MP_DIGIT_BITS, 48), so
+ * digits whose indices agree modulo P can simply be summed. */
+static uint64_t
+mod_2_48_minus_1(const mp_digit *u, mp_size usize)
+{
+#if MP_DIGIT_SIZE == 8
+    /* P = 3; digit sums need an extra carry digit. B = 2^16 (mod 2^48 - 1). */
+    mp_digit a0 = 0, a1 = 0, a2 = 0, c0 = 0, c1 = 0, c2 = 0;
+    mp_size i = 0;
+    for (; i + 3 <= usize; i += 3) {
+	a0 += u[i + 0]; c0 += (a0 < u[i + 0]);
+	a1 += u[i + 1]; c1 += (a1 < u[i + 1]);
+	a2 += u[i + 2]; c2 += (a2 < u[i + 2]);
+    }
+    if (i < usize) {
+	a0 += u[i]; c0 += (a0 < u[i]);
+	if (++i < usize) {
+	    a1 += u[i]; c1 += (a1 < u[i]);
+	}
+    }
+    /* A_j B^j + C_j B^(j+1). */
+    return fold48(rot48(fold48(a0), 0) + rot48(fold48(c0), 16) +
+		  rot48(fold48(a1), 16) + rot48(fold48(c1), 32) +
+		  rot48(fold48(a2), 32) + rot48(fold48(c2), 0));
+#else
+    /* Digits are at most 32 bits, so they can be summed in 64 bits. */
+# if MP_DIGIT_SIZE == 1
+#  define PERIOD	6
+# else
+#  define PERIOD	3
+# endif
+    uint64_t a[PERIOD] = { 0 };
+    for (mp_size i = 0, j = 0; i < usize; i++) {
+	a[j] += u[i];
+	if (++j == PERIOD)
+	    j = 0;
+    }
+    uint64_t r = 0;
+    for (unsigned j = 0; j < PERIOD; j++)
+	r += rot48(fold48(a[j]), (j * MP_DIGIT_BITS) % 48);
+    return fold48(r);
+# undef PERIOD
+#endif
+}
+
 bool
 mp_perfsqr(const mp_digit *u, mp_size usize)
 {
@@ -50,26 +141,25 @@ mp_perfsqr(const mp_digit *u, mp_size usize)
     if (!usize)
 	return true;
 
-    if (q64[u[0] & 63] == 0)
-	return false;
-#if MP_DIGIT_SIZE == 1
-    if (q63[mp_dmod(u, usize, 63)] == 0 ||
-	q65[mp_dmod(u, usize, 65)] == 0 ||
-	q11[mp_dmod(u, usize, 11)] == 0)
+    if (!((sq64 >> (u[0] & 63)) & 1))
 	return false;
-#else
+
     /* U (mod m1) == (U (mod m1*m2)) (mod m1) since
      * (U (mod m1*m2)) = U - m1*m2*floor(U/(m1*m2)) and
      * any multiple of m1 == 0 (mod m1). */
-    mp_digit r = mp_dmod(u, usize, 45045U); /* 63 * 65 * 11 */
-    if (q63[r % 63] == 0 ||
-	q65[r % 65] == 0 ||
-	q11[r % 11] == 0)
+    const uint64_t r = mod_2_48_minus_1(u, usize);
+    if (!IS_SQUARE(sq63, r % 63) ||
+	!IS_SQUARE(sq65, r % 65) ||
+	!IS_SQUARE(sq17, r % 17) ||
+	!IS_SQUARE(sq97, r % 97) ||
+	!IS_SQUARE(sq241, r % 241) ||
+	!IS_SQUARE(sq257, r % 257) ||
+	!IS_SQUARE(sq673, r % 673))
 	return false;
-#endif
-    /* Previous fast tests filter out 709/715 = ~99.16% of numbers.  If that
-     * didn't work, calculate square root and remainder. U is perfect square
-     * iff remainder is zero. */
+
+    /* Previous fast tests filter out all but about 1/1900 of non-squares. If
+     * that didn't work, calculate square root and remainder. U is perfect
+     * square iff remainder is zero. */
     mp_digit *rem = MP_TMP_ALLOC(usize);
     mp_sqrtrem(u, usize, NULL, rem);
     bool is_perfect_square = (mp_rsize(rem, usize) == 0);
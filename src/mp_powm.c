@@ -0,0 +1,59 @@
+/* mp_powm.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Crossover tables from mp_config.h, indexed by floor(lg(msize)). */
+static const unsigned exp_bits_table[] = POWM_EXP_BITS_TABLE;
+static const unsigned small_base_exp_bits_table[] =
+    POWM_SMALL_BASE_EXP_BITS_TABLE;
+
+#define TABLE_SIZE	(sizeof(exp_bits_table) / sizeof(exp_bits_table[0]))
+
+/* Montgomery exponentiation costs two extra reductions to convert in and out of
+ * Montgomery form, plus a table of odd powers, so binary exponentiation with
+ * division wins for short exponents, the more so for one-digit bases whose
+ * multiplications are cheap. Powers of two are reduced by masking in
+ * mp_modexp, and mp_mexp handles other even moduli by splitting off the power
+ * of two, so parity needs no table of its own. Moduli close to a power of two
+ * are reduced by folding in mp_special_exp, which beats both for any exponent
+ * once the modulus is long enough (or even). */
+void
+mp_powm(const mp_digit *u, mp_size usize,
+	const mp_digit *p, mp_size psize,
+	const mp_digit *m, mp_size msize, mp_digit *w)
+{
+    ASSERT(u != NULL);
+    ASSERT(p != NULL);
+    ASSERT(m != NULL);
+    ASSERT(w != NULL);
+
+    MP_NORMALIZE(m, msize);
+    ASSERT(msize != 0);
+    MP_NORMALIZE(u, usize);
+    MP_NORMALIZE(p, psize);
+
+    if (usize == 0 || psize == 0 || mp_is_pow2(m, msize)) {
+	mp_modexp(u, usize, p, psize, m, msize, w);
+	return;
+    }
+
+    mp_special_mod_ctx special = MP_SPECIAL_MOD_CTX_INITIALIZER;
+    if (((m[0] & 1) == 0 || msize >= SPECIAL_MOD_THRESHOLD) &&
+	mp_special_mod_ctx_init(&special, m, msize)) {
+	mp_special_exp(u, usize, p, psize, &special, w);
+	mp_special_mod_ctx_free(&special);
+	return;
+    }
+
+    unsigned i = 0;
+    while (i + 1 < TABLE_SIZE && (msize >> (i + 1)) != 0)
+	i++;
+    const unsigned threshold = (usize == 1) ? small_base_exp_bits_table[i]
+					     : exp_bits_table[i];
+    if (mp_significant_bits(p, psize) < threshold)
+	mp_modexp(u, usize, p, psize, m, msize, w);
+    else
+	mp_mexp(u, usize, p, psize, m, msize, w);
+}
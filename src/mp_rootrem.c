@@ -0,0 +1,227 @@
+/* mp_rootrem.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Roots with at most this many bits are found one bit at a time; larger roots
+ * are found by Newton's iteration at doubling precision. */
+#ifndef ROOTREM_BITWISE_BITS
+# define ROOTREM_BITWISE_BITS	32
+#endif /* !ROOTREM_BITWISE_BITS */
+
+/* Set p = x[xsize]^e, e >= 1, and return the normalized size of P, unless the
+ * power would exceed CAP digits, in which case CAP + 1 is returned. P and T
+ * must both have room for 2 * CAP + 2 digits; T is used as scratch space. */
+static mp_size
+pow_capped(const mp_digit *x, mp_size xsize, unsigned e, mp_size cap,
+	   mp_digit *p, mp_digit *t)
+{
+    MP_NORMALIZE(x, xsize);
+    ASSERT(xsize != 0);
+    ASSERT(e != 0);
+
+    if (xsize > cap)
+	return cap + 1;
+    mp_copy(x, xsize, p);
+    mp_size psize = xsize;
+    unsigned bit = 1U << (sizeof(e) * 8 - 1);
+    while (!(e & bit))
+	bit >>= 1;
+    while (bit >>= 1) {
+	/* P^2 >= B^(2*psize - 2), so it will not fit if 2*psize - 2 >= CAP. */
+	if (2 * psize - 2 >= cap)
+	    return cap + 1;
+	mp_sqr(p, psize, t);
+	mp_size tsize = mp_rsize(t, 2 * psize);
+	if (tsize > cap)
+	    return cap + 1;
+	if (e & bit) {
+	    mp_mul(t, tsize, x, xsize, p);
+	    psize = mp_rsize(p, tsize + xsize);
+	    if (psize > cap)
+		return cap + 1;
+	} else {
+	    mp_copy(t, tsize, p);
+	    psize = tsize;
+	}
+    }
+    return psize;
+}
+
+/* Return true if x[xsize]^k <= u[usize]. T must have room for 4*usize + 4
+ * digits. */
+static bool
+pow_le(const mp_digit *x, mp_size xsize, unsigned k,
+       const mp_digit *u, mp_size usize, mp_digit *t)
+{
+    mp_digit *p = t + 2 * usize + 2;
+    mp_size psize = pow_capped(x, xsize, k, usize, p, t);
+    return psize <= usize && mp_cmp(p, psize, u, usize) <= 0;
+}
+
+/* Given x[xsize] >= floor(U^(1/k)), set X to floor(U^(1/k)) with Newton's
+ * iteration
+ *
+ * x_{i+1} = floor(((k - 1) x_{i} + floor(U / x_{i}^(k-1))) / k)
+ *
+ * which decreases monotonically toward the root from above, and stops as soon
+ * as x_{i+1} >= x_{i}. T must have room for 4*usize + 4 digits. */
+static void
+root_newton(const mp_digit *u, mp_size usize, unsigned k,
+	    mp_digit *x, mp_size xsize, mp_digit *t)
+{
+    mp_digit *p = t + 2 * usize + 2;
+    mp_digit *q = MP_TMP_ALLOC((usize + 1) + (xsize + 1));
+    mp_digit *y = q + usize + 1;
+
+    for (;;) {
+	mp_size xlen = mp_rsize(x, xsize);
+	ASSERT(xlen != 0);
+	/* Q = floor(U / X^(k-1)), or zero if X^(k-1) > U. */
+	mp_size qsize = 0;
+	mp_size psize = pow_capped(x, xlen, k - 1, usize, p, t);
+	if (psize <= usize) {
+	    mp_div(u, usize, p, psize, q);
+	    qsize = usize - psize + 1;
+	}
+	qsize = mp_rsize(q, qsize);
+	/* Since X >= the root, Q <= X and so Y = ((k - 1) X + Q) / k <= X. */
+	if (qsize > xsize)
+	    break;
+	y[xsize] = mp_dmul(x, xsize, (mp_digit)(k - 1), y);
+	ASSERT(mp_addi(y, xsize + 1, q, qsize) == 0);
+	mp_ddivi(y, xsize + 1, (mp_digit)k);
+	ASSERT(y[xsize] == 0);
+	if (mp_cmp_n(y, x, xsize) >= 0)
+	    break;
+	mp_copy(y, xsize, x);
+    }
+    MP_TMP_FREE(q);
+}
+
+/* Set u[size] = u[size] * 2^shift, discarding bits shifted out. */
+static void
+lshift_bits(mp_digit *u, mp_size size, unsigned shift)
+{
+    const mp_size digits = shift / MP_DIGIT_BITS;
+    if (digits) {
+	ASSERT(digits < size);
+	for (mp_size i = size; i-- > digits; )
+	    u[i] = u[i - digits];
+	mp_zero(u, digits);
+    }
+    if (shift % MP_DIGIT_BITS)
+	mp_lshifti(u, size, shift % MP_DIGIT_BITS);
+}
+
+/* Set v[usize] = floor(u[usize] / 2^shift) and return its normalized size. */
+static mp_size
+rshift_bits(const mp_digit *u, mp_size usize, unsigned shift, mp_digit *v)
+{
+    const mp_size digits = shift / MP_DIGIT_BITS;
+    ASSERT(digits < usize);
+    mp_zero(v + usize - digits, digits);
+    if (shift % MP_DIGIT_BITS)
+	mp_rshift(u + digits, usize - digits, shift % MP_DIGIT_BITS, v);
+    else
+	mp_copy(u + digits, usize - digits, v);
+    return mp_rsize(v, usize - digits);
+}
+
+/* The root S of a number with N bits has ceil(N/k) bits. Writing
+ * U_j = floor(U / 2^(k (N - b_j))) for an increasing sequence of bit counts
+ * b_0 < b_1 < ... < b_L = ceil(N/k), the root of U_j is floor(S / 2^(N - b_j)).
+ * The root of U_0 is built up one bit at a time. Then for each j, if S_j is the
+ * root of U_j, (S_j + 1) 2^(b_{j+1} - b_j) is an upper bound for the root of
+ * U_{j+1} that is correct to about b_j bits, so Newton's iteration converges
+ * in one or two steps. Since b_{j+1} is about twice b_j, the total cost is a
+ * small multiple of the final iteration. */
+void
+mp_rootrem(const mp_digit *u, mp_size usize, unsigned k,
+	   mp_digit *v, mp_digit *r)
+{
+    ASSERT(u != NULL);
+    ASSERT(k != 0);
+#if MP_DIGIT_SIZE < 4
+    ASSERT(k <= MP_DIGIT_MAX);
+#endif
+
+    if (!v && !r)
+	return;	/* Nothing to do. */
+    if (k == 2) {
+	mp_sqrtrem(u, usize, v, r);
+	return;
+    }
+    const mp_size vsize = (usize + k - 1) / k;
+    if (v != NULL)
+	mp_zero(v, vsize);
+    if (r != NULL)
+	mp_zero(r, usize);
+    MP_NORMALIZE(u, usize);
+    if (!usize)
+	return;
+    if (k == 1) {
+	if (v != NULL)
+	    mp_copy(u, usize, v);
+	return;
+    }
+
+    const unsigned nbits = mp_significant_bits(u, usize);
+    if (k >= nbits) {
+	/* 2^(N-1) <= U < 2^N <= 2^k, so the root is 1. */
+	if (v != NULL)
+	    v[0] = 1;
+	if (r != NULL)
+	    ASSERT(mp_dsub(u, usize, 1, r) == 0);
+	return;
+    }
+
+    /* Choose the precisions, from the final one down. */
+    const unsigned extra = (mp_digit_log2(k) + 1) / 2 + 2;
+    unsigned bits[64];
+    unsigned nlevels = 0;
+    bits[nlevels++] = (nbits + k - 1) / k;
+    while (bits[nlevels - 1] > ROOTREM_BITWISE_BITS &&
+	   bits[nlevels - 1] / 2 + extra < bits[nlevels - 1]) {
+	ASSERT(nlevels < sizeof(bits) / sizeof(bits[0]));
+	bits[nlevels] = bits[nlevels - 1] / 2 + extra;
+	nlevels++;
+    }
+
+    const mp_size xsize = (bits[0] + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS + 1;
+    mp_digit *x = MP_TMP_ALLOC0(xsize + usize + (4 * usize + 4));
+    mp_digit *uj = x + xsize;
+    mp_digit *t = uj + usize;
+
+    /* Build up the root of U_0 one bit at a time. */
+    unsigned b = bits[--nlevels];
+    mp_size ujsize = rshift_bits(u, usize, k * (bits[0] - b), uj);
+    for (unsigned i = b; i-- > 0; ) {
+	mp_setbit(x, xsize, i);
+	if (!pow_le(x, xsize, k, uj, ujsize, t))
+	    mp_clearbit(x, xsize, i);
+    }
+
+    /* Lift it up through successive precisions with Newton's iteration. */
+    while (nlevels-- > 0) {
+	const unsigned nb = bits[nlevels];
+	ASSERT(mp_inc(x, xsize) == 0);
+	lshift_bits(x, xsize, nb - b);
+	b = nb;
+	ujsize = rshift_bits(u, usize, k * (bits[0] - b), uj);
+	root_newton(uj, ujsize, k, x, xsize, t);
+    }
+
+    const mp_size xlen = mp_rsize(x, xsize);
+    ASSERT(xlen <= vsize);
+    if (v != NULL)
+	mp_copy(x, xlen, v);
+    if (r != NULL) {
+	mp_digit *p = t + 2 * usize + 2;
+	const mp_size psize = pow_capped(x, xlen, k, usize, p, t);
+	ASSERT(psize <= usize);
+	ASSERT(mp_sub(u, usize, p, psize, r) == 0);
+    }
+    MP_TMP_FREE(x);
+}
@@ -702,7 +702,9 @@ mp_sieve(const mp_digit *u, mp_size size)
 	    digit_mul(prime_product, next_prime, p1, p0);
 	}
 	if (p1) {
-	    const mp_digit r = mp_dmod(u, size, prime_product);
+	    mp_dinv_ctx ctx;
+	    mp_dinv_ctx_init(&ctx, prime_product);
+	    const mp_digit r = mp_dmod_preinv(u, size, &ctx);
 	    for (unsigned j = 0; j < num_primes; j++)
 		if (r % primes[j] == 0)
 		    return primes[j];
@@ -714,7 +716,9 @@ mp_sieve(const mp_digit *u, mp_size size)
 	primes[num_primes++] = next_prime;
     }
     if (num_primes) {
-	const mp_digit r = mp_dmod(u, size, prime_product);
+	mp_dinv_ctx ctx;
+	mp_dinv_ctx_init(&ctx, prime_product);
+	const mp_digit r = mp_dmod_preinv(u, size, &ctx);
 	for (unsigned j = 0; j < num_primes; j++)
 	    if (r % primes[j] == 0)
 		return primes[j];
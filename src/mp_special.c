@@ -0,0 +1,330 @@
+/* mp_special.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Largest sliding window used by mp_special_exp(). */
+#ifndef SPECIAL_MAX_WINDOW
+# define SPECIAL_MAX_WINDOW	6
+#endif /* !SPECIAL_MAX_WINDOW */
+
+/* Reduction modulo M = 2^N - C, for C much smaller than M, as in Crandall's
+ * pseudo-Mersenne primes and the generalized Mersenne primes of Solinas,
+ * "Generalized Mersenne numbers," CORR 99-39. Since 2^N = C (mod M), writing
+ * X = H*2^N + L gives
+ *
+ *   X = L + H*C  (mod M),
+ *
+ * and each such fold shortens X by about N - lg(C) bits, so a product of two
+ * residues takes two folds and at most one subtraction. If C fits in a digit
+ * H*C is a single-digit multiply-add; otherwise C must have a short
+ * non-adjacent form C = sum(+/-2^e), and H*C is that many shifted additions
+ * and subtractions of H. Either way no multiplication by M is needed. */
+
+bool
+mp_special_mod_ctx_init(mp_special_mod_ctx *ctx,
+			const mp_digit *m, mp_size msize)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m == NULL);
+    ASSERT(m != NULL);
+
+    MP_NORMALIZE(m, msize);
+    if (msize < 2)	/* Nothing to gain over a digit division. */
+	return false;
+
+    /* C = 2^N - M = -M mod 2^N, with N the bit length of M. */
+    const unsigned bits = mp_significant_bits(m, msize);
+    mp_digit *c = MP_TMP_ALLOC(msize + 1);
+    mp_copy(m, msize, c);
+    mp_flip(c, msize);
+    mp_inc(c, msize);
+    if (bits % MP_DIGIT_BITS)
+	c[msize - 1] &= ((mp_digit)1 << (bits % MP_DIGIT_BITS)) - 1;
+    c[msize] = 0;
+    mp_size csize = mp_rsize(c, msize);
+    if (2 * mp_significant_bits(c, csize) > bits) {
+	MP_TMP_FREE(c);
+	return false;
+    }
+
+    ctx->nterms = 0;
+    ctx->c = 0;
+    if (csize == 1) {
+	ctx->c = c[0];
+    } else {
+	/* Non-adjacent form, least significant term first. */
+	for (unsigned e = 0; csize != 0; e++) {
+	    if (c[0] & 1) {
+		if (ctx->nterms == MP_SPECIAL_MAX_TERMS) {
+		    MP_TMP_FREE(c);
+		    return false;
+		}
+		ctx->exps[ctx->nterms] = e;
+		ctx->neg[ctx->nterms] = (c[0] & 3) == 3;
+		if (ctx->neg[ctx->nterms])
+		    mp_inc(c, csize + 1);
+		else
+		    c[0] &= ~(mp_digit)1;
+		ctx->nterms++;
+		csize = mp_rsize(c, csize + 1);
+	    }
+	    mp_rshifti(c, csize, 1);
+	    csize = mp_rsize(c, csize);
+	}
+    }
+    MP_TMP_FREE(c);
+
+    ctx->m = m;
+    ctx->k = msize;
+    ctx->bits = bits;
+    return true;
+}
+
+void
+mp_special_mod_ctx_free(mp_special_mod_ctx *ctx)
+{
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m != NULL);
+
+    ctx->m = NULL;
+    ctx->k = 0;
+    ctx->bits = 0;
+    ctx->c = 0;
+    ctx->nterms = 0;
+}
+
+/* Set y[xsize + 1] = L + H*C for X = H*2^N + L, X >= 2^N, and return its
+ * normalized size, for C that fits in a digit. This is the inner loop of every
+ * modular multiplication, so the digits of H and L are taken from X as they
+ * are needed rather than shifted out into buffers first. */
+static mp_size
+special_fold_digit(const mp_digit *x, mp_size xsize,
+		   const mp_special_mod_ctx *ctx, mp_digit *y)
+{
+    const mp_size kd = ctx->bits / MP_DIGIT_BITS;
+    const unsigned kb = ctx->bits % MP_DIGIT_BITS;
+    const mp_size k = ctx->k, hsize = xsize - kd;
+    const mp_digit c = ctx->c;
+    const mp_digit mask = ((mp_digit)1 << kb) - 1;
+
+    mp_digit cy = 0;
+    mp_size i = 0;
+    for (; i < hsize; i++) {
+	mp_digit hd = x[kd + i], l = 0;
+	if (kb) {
+	    hd >>= kb;
+	    if (kd + i + 1 < xsize)
+		hd |= x[kd + i + 1] << (MP_DIGIT_BITS - kb);
+	}
+	if (i < kd)
+	    l = x[i];
+	else if (i == kd && kb)
+	    l = x[kd] & mask;
+	mp_digit hi, lo;
+	digit_mul(hd, c, hi, lo);
+	lo += cy;
+	hi += (lo < cy);
+	lo += l;
+	hi += (lo < l);
+	y[i] = lo;
+	cy = hi;
+    }
+    for (; i < k; i++) {
+	const mp_digit l = (i < kd) ? x[i] : (x[kd] & mask);
+	y[i] = l + cy;
+	cy = (y[i] < cy);
+    }
+    y[i++] = cy;
+    return mp_rsize(y, i);
+}
+
+/* As above, for C with a short signed binary form. HBUF and S have room for
+ * xsize - N/MP_DIGIT_BITS + 1 digits each. */
+static mp_size
+special_fold(const mp_digit *x, mp_size xsize, const mp_special_mod_ctx *ctx,
+	     mp_digit *y, mp_digit *hbuf, mp_digit *s)
+{
+    const mp_size kd = ctx->bits / MP_DIGIT_BITS;
+    const unsigned kb = ctx->bits % MP_DIGIT_BITS;
+    const mp_size ysize = xsize + 1;
+
+    const mp_digit *h = x + kd;	/* Already normalized if N is whole digits. */
+    mp_size hsize = xsize - kd;
+    if (kb) {
+	mp_rshift(h, hsize, kb, hbuf);
+	h = hbuf;
+	MP_NORMALIZE(h, hsize);
+    }
+
+    mp_copy(x, ctx->k, y);
+    if (kb)
+	y[kd] &= ((mp_digit)1 << kb) - 1;
+    mp_zero(y + ctx->k, ysize - ctx->k);
+
+    /* Add the positive terms before subtracting the negative ones, so no
+     * partial sum goes below the final, nonnegative one. */
+    for (int neg = 0; neg <= 1; neg++) {
+	for (unsigned i = 0; i < ctx->nterms; i++) {
+	    if (ctx->neg[i] != neg)
+		continue;
+	    const unsigned e = ctx->exps[i];
+	    s[hsize] = mp_lshift(h, hsize, e, s);
+	    mp_digit *yd = y + e / MP_DIGIT_BITS;
+	    const mp_size ydsize = ysize - e / MP_DIGIT_BITS;
+	    if (neg)
+		mp_subi(yd, ydsize, s, hsize + 1);
+	    else
+		mp_addi(yd, ydsize, s, hsize + 1);
+	}
+    }
+    return mp_rsize(y, ysize);
+}
+
+/* Return true if x[xsize], normalized, is at least 2^N. */
+static inline bool
+above_2n(const mp_digit *x, mp_size xsize, const mp_special_mod_ctx *ctx)
+{
+    const unsigned kb = ctx->bits % MP_DIGIT_BITS;
+    if (xsize != ctx->k)
+	return xsize > ctx->k;
+    return kb != 0 && (x[xsize - 1] >> kb) != 0;
+}
+
+void
+mp_special_reduce(const mp_digit *x, mp_size xsize,
+		  const mp_special_mod_ctx *ctx, mp_digit *w)
+{
+    ASSERT(x != NULL);
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m != NULL);
+    ASSERT(w != NULL);
+
+    const mp_size k = ctx->k;
+    MP_NORMALIZE(x, xsize);
+    if (xsize < k) {
+	/* X < B^(k-1) <= 2^(N-1) <= M. */
+	if (x != w)
+	    mp_copy(x, xsize, w);
+	mp_zero(w + xsize, k - xsize);
+	return;
+    }
+
+    /* Each fold leaves at most as many digits as it was given. */
+    const mp_size hmax = xsize - ctx->bits / MP_DIGIT_BITS + 1;
+    mp_digit *tmp = MP_TMP_ALLOC(2 * (xsize + 1) + 2 * hmax);
+    mp_digit *a = tmp;
+    mp_digit *b = a + xsize + 1;
+    mp_digit *h = b + xsize + 1;
+    mp_digit *s = h + hmax;
+
+    const mp_digit *cur = x;
+    mp_size size = xsize;
+    while (above_2n(cur, size, ctx)) {
+	if (ctx->nterms == 0)
+	    size = special_fold_digit(cur, size, ctx, a);
+	else
+	    size = special_fold(cur, size, ctx, a, h, s);
+	cur = a;
+	SWAP(a, b, mp_digit *);
+    }
+    /* Now X < 2^N = M + C, so one subtraction suffices. */
+    if (cur != w)
+	mp_copy(cur, size, w);
+    mp_zero(w + size, k - size);
+    if (mp_cmp_n(w, ctx->m, k) >= 0)
+	mp_subi_n(w, ctx->m, k);
+    MP_TMP_FREE(tmp);
+}
+
+/* Sliding window exponentiation (see mp_window.c), with every product reduced
+ * by mp_special_reduce(). */
+void
+mp_special_exp(const mp_digit *u, mp_size usize,
+	       const mp_digit *p, mp_size psize,
+	       const mp_special_mod_ctx *ctx, mp_digit *w)
+{
+    ASSERT(u != NULL);
+    ASSERT(p != NULL);
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->m != NULL);
+    ASSERT(w != NULL);
+
+    const mp_size k = ctx->k;
+    MP_NORMALIZE(u, usize);
+    MP_NORMALIZE(p, psize);
+    if (usize == 0 || psize == 0) {
+	mp_zero(w, k);
+	w[0] = (usize != 0);
+	return;
+    }
+
+    mp_digit *umod = MP_TMP_ALLOC(3 * k);
+    mp_digit *t = umod + k;
+    mp_special_reduce(u, usize, ctx, umod);
+    if (mp_is_zero(umod, k)) {
+	mp_zero(w, k);
+	MP_TMP_FREE(umod);
+	return;
+    }
+
+    unsigned i = mp_significant_bits(p, psize);
+    if (mp_rsize(umod, k) == 1) {
+	/* Multiplying by a single digit is cheaper than any table lookup. */
+	const mp_digit g = umod[0];
+	mp_copy(umod, k, w);
+	while (--i != 0) {
+	    mp_sqr(w, k, t);
+	    mp_special_reduce(t, 2 * k, ctx, w);
+	    if (mp_exp_bit(p, psize, i - 1)) {
+		t[k] = mp_dmul(w, k, g, t);
+		mp_special_reduce(t, k + 1, ctx, w);
+	    }
+	}
+	MP_TMP_FREE(umod);
+	return;
+    }
+
+    /* Odd powers U, U^3, ..., U^(2^window - 1). */
+    const unsigned window = mp_window_size(i, SPECIAL_MAX_WINDOW);
+    const mp_size count = (mp_size)1 << (window - 1);
+    mp_digit *powers = MP_TMP_ALLOC((count + 1) * k);
+    mp_digit *u2 = powers + count * k;
+    mp_copy(umod, k, powers);
+    if (count > 1) {
+	mp_sqr(umod, k, t);
+	mp_special_reduce(t, 2 * k, ctx, u2);
+    }
+    for (mp_size j = 1; j < count; j++) {
+	mp_mul_n(powers + (j - 1) * k, u2, k, t);
+	mp_special_reduce(t, 2 * k, ctx, powers + j * k);
+    }
+
+    bool first = true;
+    while (i != 0) {
+	if (!mp_exp_bit(p, psize, i - 1)) {
+	    mp_sqr(w, k, t);
+	    mp_special_reduce(t, 2 * k, ctx, w);
+	    i--;
+	    continue;
+	}
+	unsigned val;
+	const unsigned l = mp_window_scan(p, psize, i, window, &val);
+	const mp_digit *pw = powers + (val >> 1) * k;
+	if (first) {
+	    mp_copy(pw, k, w);
+	    first = false;
+	} else {
+	    for (unsigned j = i - l; j != 0; j--) {
+		mp_sqr(w, k, t);
+		mp_special_reduce(t, 2 * k, ctx, w);
+	    }
+	    mp_mul_n(w, pw, k, t);
+	    mp_special_reduce(t, 2 * k, ctx, w);
+	}
+	i = l;
+    }
+    MP_TMP_FREE(powers);
+    MP_TMP_FREE(umod);
+}
@@ -4,14 +4,21 @@
 #include "mp.h"
 #include "mp_internal.h"
 
-/* Find the integer part of the square root of U and store it in V; V must be
- * at least as large as ceil(ULEN / 2). */
-void
-mp_sqrtrem(const mp_digit *u, mp_size usize, mp_digit *v, mp_digit *r)
-{
-    ASSERT(u != NULL);
-    ASSERT(v != NULL);
+/* Below this many root digits, the divide-and-conquer square root hands off to
+ * Newton's iteration. */
+#ifndef SQRTREM_DC_THRESHOLD
+# define SQRTREM_DC_THRESHOLD	4
+#endif /* !SQRTREM_DC_THRESHOLD */
+#if SQRTREM_DC_THRESHOLD < 2
+# error "SQRTREM_DC_THRESHOLD must be at least 2"
+#endif
 
+/* Find the integer part of the square root of u[usize] and store it in
+ * v[(usize + 1) / 2], and the remainder in r[usize]; neither may be NULL.
+ * U must be normalized (u[usize - 1] != 0). */
+static void
+sqrtrem_newton(const mp_digit *u, mp_size usize, mp_digit *v, mp_digit *r)
+{
     /* Newton iteration begins with some guess x_{0} and computes the sequence
      *
      * x_{i+1} = x_{i} - f(x_{i})/f'(x_{i})
@@ -25,27 +32,14 @@ mp_sqrtrem(const mp_digit *u, mp_size usize, mp_digit *v, mp_digit *r)
      *
      * with x_{0} = 2^(floor(lg(N))/2 + 1)
      */
+    const mp_size vsize = (usize + 1) / 2;
 
-    /* TODO: Implement a higher-order iteration for faster convergence? */
-
-    if (!v && !r)
-	return;	/* Nothing to do. */
-    if (v)
-	mp_zero(v, (usize + 1) / 2);
-    if (r)
-	mp_zero(r, usize);
-    MP_NORMALIZE(u, usize);
-    if (!usize)
-	return;
     if (usize == 1) {
 	mp_digit root = mp_digit_sqrt(u[0]);
-	if (v != NULL)
-	    v[0] = root;
-	if (r != NULL)
-	    r[0] = u[0] - root * root;
+	v[0] = root;
+	r[0] = u[0] - root * root;
 	return;
     }
-    mp_size vsize = (usize + 1) / 2;
 
     /* FIXME: This is very "generous" in terms of amount of space allocated for
      * X and Y. Come up with something better? */
@@ -77,15 +71,167 @@ mp_sqrtrem(const mp_digit *u, mp_size usize, mp_digit *v, mp_digit *r)
 	x_len = y_len;
     }
     ASSERT(x_len == vsize);
-    if (v != NULL)
-	mp_copy(x, x_len, v);
-    if (r != NULL) {
-	mp_sqr(v, vsize, x);
-	ASSERT(mp_sub(u, usize, x, vsize * 2, r) == 0);
-    }
+    mp_copy(x, x_len, v);
+    mp_sqr(v, vsize, x);
+    ASSERT(mp_sub(u, usize, x, vsize * 2, r) == 0);
     MP_TMP_FREE(x);
 }
 
+/* Karatsuba square root, from Zimmermann, "Karatsuba Square Root", INRIA
+ * Research Report 3805 (1999), and algorithm 1.12 in Brent & Zimmermann,
+ * "Modern Computer Arithmetic."
+ *
+ *  Input: a[0..2n-1], with a[2n-1] >= B/4 (A is normalized).
+ * Output: s[0..n-1] = floor(sqrt(A)), and remainder R = A - S^2, 0 <= R <= 2S,
+ *         stored in a[0..n-1], with the high digit of R (0 or 1) returned.
+ *
+ * Writing A = A' B^2l + A1 B^l + A0 with l = floor(n/2), the algorithm is
+ * 1. (S', R') = SqrtRem(A')
+ * 2. (Q, U) = DivRem(R' B^l + A1, 2S')
+ * 3. S = S' B^l + Q, R = U B^l + A0 - Q^2
+ * 4. If R < 0, set R = R + 2S - 1 and S = S - 1.
+ * Since step 2 divides a number of roughly 3n/2 digits by one of n/2 digits,
+ * the cost is dominated by the squaring in step 3 and by the recursion, giving
+ * a running time of about one n-digit multiplication. */
+static mp_digit
+sqrtrem_dc(mp_digit *s, mp_digit *a, mp_size n)
+{
+    ASSERT(n != 0);
+    ASSERT(a[2 * n - 1] >= (MP_DIGIT_MSB >> 1));
+
+    if (n < SQRTREM_DC_THRESHOLD) {
+	mp_digit *r = MP_TMP_ALLOC(2 * n);
+	sqrtrem_newton(a, 2 * n, s, r);
+	ASSERT(mp_rsize(r, 2 * n) <= n + 1);
+	mp_copy(r, n, a);
+	const mp_digit rh = r[n];
+	ASSERT(rh <= 1);
+	MP_TMP_FREE(r);
+	return rh;
+    }
+
+    const mp_size l = n / 2, h = n - l;
+    mp_digit *s1 = s + l;
+
+    /* Step 1: S' goes into s[l..n-1], R' into a[2l..2l+h-1] plus RH. */
+    const mp_digit rh = sqrtrem_dc(s1, a + 2 * l, h);
+
+    /* Step 2: divide N = R' B^l + A1 by S' (normalized since A' is), then
+     * halve the quotient to get Q = floor(N / 2S'); the remainder is
+     * U = N mod S' + S' if the quotient was odd. */
+    mp_digit *tmp = MP_TMP_ALLOC((n + 1) + (l + 2) + (h + 1) + 2 * (l + 1));
+    mp_digit *num = tmp;		/* n + 1 digits */
+    mp_digit *q = num + n + 1;		/* l + 2 digits */
+    mp_digit *u = q + l + 2;		/* h + 1 digits */
+    mp_digit *q2 = u + h + 1;		/* 2 * (l + 1) digits */
+    mp_copy(a + l, n, num);
+    num[n] = rh;
+    mp_divrem(num, n + 1, s1, h, q, u);
+    const bool odd = q[0] & 1;
+    mp_rshifti(q, l + 2, 1);
+    ASSERT(q[l + 1] == 0);
+    u[h] = odd ? mp_addi_n(u, s1, h) : 0;
+
+    /* Step 3: S = S' B^l + Q. Q <= B^l, so S may momentarily equal B^n (when
+     * S' = B^h - 1 and Q = B^l); step 4 then necessarily brings it back. */
+    mp_copy(q, l, s);
+    const mp_digit scarry = q[l] ? mp_daddi(s1, h, q[l]) : 0;
+
+    /* R = U B^l + A0 - Q^2, built up in NUM. */
+    mp_copy(u, h + 1, num + l);
+    mp_copy(a, l, num);
+    mp_sqr(q, l + 1, q2);
+    mp_size q2size = mp_rsize(q2, 2 * (l + 1));
+    ASSERT(q2size <= n + 1);
+
+    /* Step 4: if R < 0, set R = R + 2S - 1 and S = S - 1. */
+    if (scarry || mp_cmp(num, n + 1, q2, q2size) < 0) {
+	mp_digit cy = mp_addi(num, n + 1, s, n);
+	cy += mp_addi(num, n + 1, s, n);
+	num[n] += 2 * scarry;
+	ASSERT(cy == 0);
+	ASSERT(mp_dsubi(num, n + 1, 1) == 0);
+	ASSERT(mp_dsubi(s, n, 1) == scarry);
+    }
+    ASSERT(mp_subi(num, n + 1, q2, q2size) == 0);
+    mp_copy(num, n, a);
+    const mp_digit r_high = num[n];
+    ASSERT(r_high <= 1);
+    MP_TMP_FREE(tmp);
+    return r_high;
+}
+
+/* Find the integer part of the square root of U and store it in V; V must be
+ * at least as large as ceil(ULEN / 2). */
+void
+mp_sqrtrem(const mp_digit *u, mp_size usize, mp_digit *v, mp_digit *r)
+{
+    ASSERT(u != NULL);
+
+    if (!v && !r)
+	return;	/* Nothing to do. */
+    if (v)
+	mp_zero(v, (usize + 1) / 2);
+    if (r)
+	mp_zero(r, usize);
+    MP_NORMALIZE(u, usize);
+    if (!usize)
+	return;
+    if (usize == 1) {
+	mp_digit root = mp_digit_sqrt(u[0]);
+	if (v != NULL)
+	    v[0] = root;
+	if (r != NULL)
+	    r[0] = u[0] - root * root;
+	return;
+    }
+
+    /* Normalize: pad U to an even number of digits and shift it left by an
+     * even number of bits 2T so the most significant digit is at least B/4.
+     * Then sqrt(U) = floor(sqrt(U * 4^T) / 2^T). */
+    const mp_size n = (usize + 1) / 2;
+    mp_digit *tmp = MP_TMP_ALLOC(3 * n);
+    mp_digit *a = tmp;
+    mp_digit *s = tmp + 2 * n;
+    unsigned zbits = mp_digit_msb_shift(u[usize - 1]);
+    if (usize & 1)
+	zbits += MP_DIGIT_BITS;
+    const unsigned t = zbits / 2;
+    const unsigned tdigits = (2 * t) / MP_DIGIT_BITS;
+    mp_zero(a, tdigits);
+    mp_copy(u, usize, a + tdigits);
+    mp_zero(a + tdigits + usize, 2 * n - tdigits - usize);
+    if ((2 * t) % MP_DIGIT_BITS)
+	ASSERT(mp_lshifti(a, 2 * n, (2 * t) % MP_DIGIT_BITS) == 0);
+
+    const mp_digit rh = sqrtrem_dc(s, a, n);
+
+    if (t == 0) {
+	/* Already normalized; the remainder comes for free. */
+	if (v != NULL)
+	    mp_copy(s, n, v);
+	if (r != NULL) {
+	    mp_copy(a, n, r);
+	    r[n] = rh;
+	}
+    } else {
+	const unsigned sdigits = t / MP_DIGIT_BITS;
+	const mp_size vsize = n - sdigits;
+	mp_digit *root = s + sdigits;
+	if (t % MP_DIGIT_BITS)
+	    mp_rshifti(root, vsize, t % MP_DIGIT_BITS);
+	if (v != NULL)
+	    mp_copy(root, vsize, v);
+	if (r != NULL) {
+	    /* R = U - V^2; reuse A as scratch space. */
+	    ASSERT(2 * vsize <= 2 * n);
+	    mp_sqr(root, vsize, a);
+	    ASSERT(mp_sub(u, usize, a, mp_rsize(a, 2 * vsize), r) == 0);
+	}
+    }
+    MP_TMP_FREE(tmp);
+}
+
 mp_digit
 mp_digit_sqrt(mp_digit n)
 {
@@ -294,6 +294,17 @@ mp_odd_shift(const mp_digit *u, mp_size size)
     return bits + mp_digit_lsb_shift(*u);
 }
 
+bool
+mp_is_pow2(const mp_digit *u, mp_size size)
+{
+    MP_NORMALIZE(u, size);
+    if (!size)
+	return false;
+
+    const mp_digit top = u[size - 1];
+    return (top & (top - 1)) == 0 && mp_rsize(u, size - 1) == 0;
+}
+
 unsigned
 mp_significant_bits(const mp_digit *u, mp_size size)
 {
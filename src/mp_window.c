@@ -0,0 +1,45 @@
+/* mp_window.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved. */
+
+#include "mp.h"
+#include "mp_internal.h"
+
+/* Left-to-right sliding window exponentiation (algorithm 14.85 in "Handbook
+ * of Applied Cryptography"), as used by mp_barrett(), mp_special_exp() and
+ * mp_multi_exp(). Runs of zero bits cost one squaring per bit; each window of
+ * at most W bits that starts and ends with a one costs one multiplication by
+ * one of the 2^(W-1) precomputed odd powers. */
+
+/* Return the window width for an exponent of NBITS bits, at most MAX_WINDOW.
+ * The table lists the longest exponent for which each width beats the next,
+ * counting the odd powers against about NBITS / (W + 1) multiplications. */
+unsigned
+mp_window_size(unsigned nbits, unsigned max_window)
+{
+    static const unsigned max_bits[] = { 7, 25, 80, 240, 672 };
+    unsigned w = 1;
+    while (w < max_window &&
+	   w <= sizeof(max_bits) / sizeof(max_bits[0]) &&
+	   nbits > max_bits[w - 1])
+	w++;
+    return w;
+}
+
+/* Find the longest window p[i-1 .. l] of at most WINDOW bits that ends in a
+ * one, where bit I - 1 of P is a one. Set *VAL to its bits, which select the
+ * odd power VAL >> 1, and return L. */
+unsigned
+mp_window_scan(const mp_digit *p, mp_size psize, unsigned i,
+	       unsigned window, unsigned *val)
+{
+    ASSERT(mp_exp_bit(p, psize, i - 1));
+
+    unsigned l = (i > window) ? i - window : 0;
+    while (!mp_exp_bit(p, psize, l))
+	l++;
+    unsigned v = 0;
+    for (unsigned j = i; j-- > l; )
+	v = (v << 1) | mp_exp_bit(p, psize, j);
+    *val = v;
+    return l;
+}
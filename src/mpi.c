@@ -852,6 +852,69 @@ mpi_divrem(const mpi *a, const mpi *b, mpi *q, mpi *r)
     r->sign = 0; /* XXX */
 }
 
+/* Q = A / B and R = A % B, truncating toward zero as in C; the remainder has
+ * the sign of A. Either Q or R may be NULL. */
+void
+mpi_divrem_u32(const mpi *a, uint32_t b, mpi *q, mpi *r)
+{
+    ASSERT(b != 0);
+    ASSERT(q == NULL || q != r);
+
+    if (a->size == 0) {
+	if (q != NULL)
+	    mpi_zero(q);
+	if (r != NULL)
+	    mpi_zero(r);
+	return;
+    }
+
+#if MP_DIGIT_SIZE < 4
+    if (b > MP_DIGIT_MAX) {
+	mpi_t bb = MPI_INITIALIZER, qq = MPI_INITIALIZER, rr = MPI_INITIALIZER;
+	mpi_set_u32(bb, b);
+	mpi_divrem(a, bb, qq, rr);
+	qq->sign = (qq->size != 0) && a->sign;
+	rr->sign = (rr->size != 0) && a->sign;
+	if (q != NULL)
+	    mpi_swap(q, qq);
+	if (r != NULL)
+	    mpi_swap(r, rr);
+	mpi_free(bb);
+	mpi_free(qq);
+	mpi_free(rr);
+	return;
+    }
+#endif
+
+    const unsigned sign = a->sign;
+    mp_dinv_ctx ctx;
+    mp_dinv_ctx_init(&ctx, (mp_digit)b);
+    mp_digit rem;
+    if (q != NULL) {
+	if (q != a)
+	    mpi_set_mpi(q, a);
+	rem = mp_ddivi_preinv(q->digits, q->size, &ctx);
+	MPI_NORMALIZE(q);
+	q->sign = (q->size != 0) && sign;
+    } else {
+	rem = mp_dmod_preinv(a->digits, a->size, &ctx);
+    }
+    if (r != NULL) {
+	mpi_set_u32(r, (uint32_t)rem);
+	r->sign = (rem != 0) && sign;
+    }
+}
+
+void
+mpi_divrem_s32(const mpi *a, int32_t b, mpi *q, mpi *r)
+{
+    ASSERT(b != 0);
+
+    mpi_divrem_u32(a, (b < 0) ? -(uint32_t)b : (uint32_t)b, q, r);
+    if (b < 0 && q != NULL && q->size != 0)
+	q->sign ^= 1;
+}
+
 void
 mpi_div(const mpi *a, const mpi *b, mpi *q)
 {
@@ -882,7 +945,7 @@ mpi_div(const mpi *a, const mpi *b, mpi *q)
 	MPI_MIN_ALLOC(q, qsize);
 	mp_div(a->digits, a->size,
 	       b->digits, b->size, q->digits);
-	MP_NORMALIZE(q->digits, q->size);
+	q->size = mp_rsize(q->digits, qsize);
     }
     q->sign = a->sign ^ b->sign;
 }
@@ -0,0 +1,119 @@
+/* mpi_batch_gcd.c
+ * Copyright (C) 2003-2012 Farooq Mela. All rights reserved. */
+
+#include "mpi.h"
+#include "mpi_internal.h"
+#include "weecrypt_memory.h"
+
+/* Set gcds[i] = gcd(N_i, R_i / N_i), where gcds[i] holds R_i = P mod N_i^2
+ * on entry. */
+static void
+finish_gcds(const mpi *const *moduli, unsigned n, mpi *const *gcds)
+{
+    mpi_t g;
+    mpi_init(g);
+    for (unsigned i = 0; i < n; i++) {
+	mpi_divexact(gcds[i], moduli[i], gcds[i]);
+	mpi_gcd(moduli[i], gcds[i], g);
+	mpi_set_mpi(gcds[i], g);
+    }
+    mpi_free(g);
+}
+
+/* Bernstein's batch GCD ("How to find smooth parts of integers", 2004), as
+ * used to find RSA moduli sharing a prime. The product tree of N_0 ... N_(n-1)
+ * has P = N_0 ... N_(n-1) at its root. Going back down, each node gets its
+ * parent's remainder modulo the square of the node, so that leaf i ends up
+ * with R_i = P mod N_i^2. As N_i divides both P and N_i^2, it divides R_i,
+ * and R_i / N_i = P / N_i (mod N_i), whence
+ *
+ *   gcd(N_i, prod_(j != i) N_j) = gcd(N_i, R_i / N_i).
+ *
+ * Both trees take O(M(P) log n) time, with M(P) the cost of multiplying
+ * numbers the size of P, against n^2 pairwise GCDs. */
+void
+mpi_batch_gcd(const mpi *const *moduli, unsigned n, mpi *const *gcds)
+{
+    ASSERT(moduli != NULL);
+    ASSERT(gcds != NULL);
+
+    if (n == 0)
+	return;
+    if (n == 1) {
+	/* No other moduli. */
+	mpi_set_u32(gcds[0], 1);
+	return;
+    }
+
+    mpi_prodtree tree = MPI_PRODTREE_INITIALIZER;
+    mpi_prodtree_init(&tree, moduli, n);
+    mpi_remtree_sqr(&tree, mpi_prodtree_root(&tree), gcds);
+    mpi_prodtree_free(&tree);
+    finish_gcds(moduli, n, gcds);
+}
+
+/* The same, one batch of moduli at a time. P mod N_i^2 only needs P modulo
+ * the square S of the product P_b of the batch holding N_i, and that is the
+ * product of P_b and of every other batch product P_c reduced modulo S. Only
+ * the batch products are kept throughout; a batch's product tree is built to
+ * take the remainders down from S, and freed before the next. */
+void
+mpi_batch_gcd_chunked(const mpi *const *moduli, unsigned n, unsigned batch,
+		      mpi *const *gcds)
+{
+    ASSERT(moduli != NULL);
+    ASSERT(gcds != NULL);
+    ASSERT(batch != 0);
+
+    if (n <= batch) {
+	mpi_batch_gcd(moduli, n, gcds);
+	return;
+    }
+
+    const unsigned nbatches = (n + batch - 1) / batch;
+    mpi *prod = MALLOC(nbatches * sizeof(mpi));
+    for (unsigned c = 0; c < nbatches; c++) {
+	const unsigned first = c * batch;
+	mpi_init(&prod[c]);
+	mpi_product(moduli + first, MIN(batch, n - first), &prod[c]);
+    }
+
+    mpi_t s, x, r, t;
+    mpi_init(s);
+    mpi_init(x);
+    mpi_init(r);
+    mpi_init(t);
+    for (unsigned b = 0; b < nbatches; b++) {
+	const unsigned first = b * batch, count = MIN(batch, n - first);
+
+	/* X = P mod S */
+	mpi_sqr(&prod[b], s);
+	mp_barrett_ctx ctx = MP_BARRETT_CTX_INITIALIZER;
+	if (s->size >= BARRETT_NEWTON_THRESHOLD)
+	    mp_barrett_ctx_init(&ctx, s->digits, s->size);
+	mpi_set_mpi(x, &prod[b]);
+	for (unsigned c = 0; c < nbatches; c++) {
+	    if (c == b)
+		continue;
+	    mpi_barrett_mod(&prod[c], s, &ctx, r);
+	    mpi_mul(x, r, t);
+	    mpi_barrett_mod(t, s, &ctx, x);
+	}
+	if (ctx.mu != NULL)
+	    mp_barrett_ctx_free(&ctx);
+
+	mpi_prodtree tree = MPI_PRODTREE_INITIALIZER;
+	mpi_prodtree_init(&tree, moduli + first, count);
+	mpi_remtree_sqr(&tree, x, gcds + first);
+	mpi_prodtree_free(&tree);
+	finish_gcds(moduli + first, count, gcds + first);
+    }
+    mpi_free(s);
+    mpi_free(x);
+    mpi_free(r);
+    mpi_free(t);
+
+    for (unsigned c = 0; c < nbatches; c++)
+	mpi_free(&prod[c]);
+    FREE(prod);
+}
@@ -22,27 +22,18 @@ mpi_binomial(uint64_t n, uint64_t k, mpi *coeff)
 	return;
     }
 
+    /* N choose K = N choose N-K; take the shorter products. */
+    if (k > n - k)
+	k = n - k;
+
     /*             (N-K+1) x (N-K+2) x ... x N
 		   N choose K = ---------------------------
 		   1 x 2 x ... x K       */
     mpi_t num, den;
-    mpi_init_u64(num, n - k + 1);
-    mpi_init_u32(den, 1);
-    for (uint64_t i = 2; i <= k; ++i) {
-	mpi_mul_u64(num, n - k + i, num);
-	mpi_mul_u64(den, i, den);
-	if ((i & 31) == 0) {
-	    unsigned digits = 0;
-	    while ((num->digits[digits] | den->digits[digits]) == 0)
-		++digits;
-	    unsigned shift = mp_digit_lsb_shift(num->digits[digits] |
-						den->digits[digits]);
-	    if (digits || shift) {
-		mpi_rshift(num, digits * MP_DIGIT_BITS + shift, num);
-		mpi_rshift(den, digits * MP_DIGIT_BITS + shift, den);
-	    }
-	}
-    }
+    mpi_init(num);
+    mpi_init(den);
+    mpi_product_range(n - k + 1, n, num);
+    mpi_product_range(2, k, den);
     mpi_divexact(num, den, coeff);
     mpi_free(num);
     mpi_free(den);
@@ -2,6 +2,20 @@
  * Copyright (C) 2003-2012 Farooq Mela. All rights reserved. */
 
 #include "mpi.h"
+#include "mpi_internal.h"
+#include "weecrypt_memory.h"
+
+/* R = A mod M, with 0 <= R < M; mpi_mod() leaves negative A < M as it is. */
+static void
+mod_nonneg(const mpi *a, const mpi *m, mpi *r)
+{
+    const bool neg = mpi_is_neg(a);
+    mpi_set_mpi(r, a);
+    mpi_abs(r);
+    mpi_mod(r, m, r);
+    if (neg && !mpi_is_zero(r))
+	mpi_sub(m, r, r);
+}
 
 void
 mpi_crt_init(mpi_crt_ctx *ctx)
@@ -39,7 +53,7 @@ mpi_crt_step(mpi_crt_ctx *ctx, const mpi *a_i, const mpi *m_i)
 	mpi_mul(v, ctx->x, v);
 	mpi_add(u, v, ctx->x);
 	mpi_mul(ctx->m, m_i, ctx->m);
-	mpi_mod(ctx->x, ctx->m, ctx->x);
+	mod_nonneg(ctx->x, ctx->m, ctx->x);
 
 	mpi_free(u);
 	mpi_free(v);
@@ -62,3 +76,103 @@ mpi_crt_finish(mpi_crt_ctx *ctx, mpi *a)
     mpi_free(ctx->m);
     return 0;
 }
+
+/* With c_i = (M / m_i)^-1 mod m_i, X = sum_i (a_i c_i mod m_i) M / m_i mod M.
+ * The M / m_i mod m_i come out of one remainder tree, as in mpi_batch_gcd():
+ * M mod m_i^2 = (M / m_i mod m_i) m_i. */
+int
+mpi_crt_plan_init(mpi_crt_plan *plan, const mpi *const *moduli, unsigned n)
+{
+    ASSERT(plan != NULL);
+    ASSERT(plan->inv == NULL);
+    ASSERT(moduli != NULL);
+    ASSERT(n != 0);
+
+    mpi_prodtree_init(&plan->tree, moduli, n);
+    plan->inv = MALLOC(n * sizeof(mpi));
+    mpi **inv = MALLOC(n * sizeof(mpi *));
+    for (unsigned i = 0; i < n; i++) {
+	mpi_init(&plan->inv[i]);
+	inv[i] = &plan->inv[i];
+    }
+    mpi_remtree_sqr(&plan->tree, mpi_prodtree_root(&plan->tree), inv);
+
+    mpi_t c;
+    mpi_init(c);
+    int ret = 0;
+    for (unsigned i = 0; i < n && ret == 0; i++) {
+	mpi_divexact(inv[i], moduli[i], inv[i]);
+	if (!mpi_modinv(moduli[i], inv[i], c))
+	    ret = -1;
+	mpi_set_mpi(inv[i], c);
+    }
+    mpi_free(c);
+    FREE(inv);
+    if (ret != 0)
+	mpi_crt_plan_free(plan);
+    return ret;
+}
+
+void
+mpi_crt_plan_free(mpi_crt_plan *plan)
+{
+    ASSERT(plan != NULL);
+    ASSERT(plan->inv != NULL);
+
+    for (unsigned i = 0; i < plan->tree.count[0]; i++)
+	mpi_free(&plan->inv[i]);
+    FREE(plan->inv);
+    plan->inv = NULL;
+    mpi_prodtree_free(&plan->tree);
+}
+
+/* Going up the tree, a node with children L and R gets
+ * X_node = X_L R + X_R L, the sum of the terms of its leaves over its own
+ * product, so the root has the whole sum, which is below n M. */
+void
+mpi_crt_plan_solve(const mpi_crt_plan *plan, const mpi *const *residues,
+		   mpi *x)
+{
+    ASSERT(plan != NULL);
+    ASSERT(plan->inv != NULL);
+    ASSERT(residues != NULL);
+    ASSERT(x != NULL);
+
+    const mpi_prodtree *tree = &plan->tree;
+    unsigned count = tree->count[0];
+    mpi *cur = MALLOC(count * sizeof(mpi));
+    for (unsigned i = 0; i < count; i++) {
+	const mpi *m = &tree->node[0][i];
+	mpi_init(&cur[i]);
+	mod_nonneg(residues[i], m, &cur[i]);
+	mpi_mul(&cur[i], &plan->inv[i], &cur[i]);
+	mpi_mod(&cur[i], m, &cur[i]);
+    }
+
+    mpi_t t;
+    mpi_init(t);
+    for (unsigned l = 1; l < tree->levels; l++) {
+	const mpi *below = tree->node[l - 1];
+	mpi *next = MALLOC(tree->count[l] * sizeof(mpi));
+	for (unsigned i = 0; i < tree->count[l]; i++) {
+	    mpi_init(&next[i]);
+	    if (2 * i + 1 == count) {
+		/* Carried up as it is. */
+		SWAP(next[i], cur[2 * i], mpi);
+		continue;
+	    }
+	    mpi_mul(&cur[2 * i], &below[2 * i + 1], &next[i]);
+	    mpi_mul(&cur[2 * i + 1], &below[2 * i], t);
+	    mpi_add(&next[i], t, &next[i]);
+	}
+	for (unsigned i = 0; i < count; i++)
+	    mpi_free(&cur[i]);
+	FREE(cur);
+	cur = next;
+	count = tree->count[l];
+    }
+    mpi_mod(&cur[0], mpi_prodtree_root(tree), x);
+    mpi_free(&cur[0]);
+    FREE(cur);
+    mpi_free(t);
+}
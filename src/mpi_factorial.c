@@ -5,18 +5,13 @@
 #include "mpi_internal.h"
 
 /* Compute N! = N x (N-1) x (N-2) ... x (2) x (1) */
-/* TODO: use a better algorithm, e.g. the recursive-splitting algorithm. */
 void
 mpi_factorial(uint64_t n, mpi *fact)
 {
     ASSERT(fact != NULL);
 
-    if (!n) {
+    if (!n)
 	mpi_zero(fact);
-    } else {
-	mpi_set_u64(fact, n);
-	for (uint64_t m = n - 1; m >= 2; --m) {
-	    mpi_mul_u64(fact, m, fact);
-	}
-    }
+    else
+	mpi_product_range(2, n, fact);
 }
@@ -4,6 +4,50 @@
 #include "mpi.h"
 #include "mpi_internal.h"
 
+/* For A > B: reduce (A B)' = M (C D)' with mp_hgcd() until D is small,
+ * finish with Euclid on C and D to get C*U0 + D*V0 = G, and map the cofactors
+ * back through M^-1 = det (m11 -m01; -m10 m00), giving
+ *
+ *   U = det (U0 m11 - V0 m10),  V = det (V0 m00 - U0 m01). */
+static void
+gcdext_hgcd(const mpi *a, const mpi *b, mpi *u, mpi *v, mpi *g)
+{
+    mpi_t c, d, u0, v0, e, t;
+
+    mpi_init_mpi(c, a);
+    mpi_init_mpi(d, b);
+    mp_hgcd_matrix m = MP_HGCD_MATRIX_INITIALIZER;
+    mp_hgcd_matrix_init(&m, a->size);
+    mp_hgcd(c->digits, &c->size, d->digits, &d->size,
+	    GCDEXT_LEHMER_THRESHOLD - 1, &m);
+
+    mpi_init(u0);
+    mpi_init(v0);
+    mpi_gcdext(c, d, u0, v0, g);
+    mpi_free(c);
+    mpi_free(d);
+
+    mpi_init(t);
+    mpi_init_mp(e, m.m[1][1], m.size);
+    mpi_mul(u0, e, u);
+    mpi_init_mp(e, m.m[1][0], m.size);
+    mpi_mul(v0, e, t);
+    mpi_sub(u, t, u);
+    mpi_init_mp(e, m.m[0][0], m.size);
+    mpi_mul(v0, e, v);
+    mpi_init_mp(e, m.m[0][1], m.size);
+    mpi_mul(u0, e, t);
+    mpi_sub(v, t, v);
+    if (m.det < 0) {
+	mpi_neg(u);
+	mpi_neg(v);
+    }
+    mpi_free(t);
+    mpi_free(u0);
+    mpi_free(v0);
+    mp_hgcd_matrix_free(&m);
+}
+
 /* Cohen algorithm 1.3.6 (Extended Euclid)
  * Given non-negative integers A and B, this algorithm will determine U, V,
  * and D such that A * U + B * V = G = GCD(A,B) */
@@ -16,6 +60,17 @@ mpi_gcdext(const mpi *a, const mpi *b, mpi *u, mpi *v, mpi *g)
     ASSERT(a->sign == 0);
     ASSERT(b->sign == 0);
 
+    if (MIN(a->size, b->size) >= GCDEXT_LEHMER_THRESHOLD) {
+	const int cmp = mpi_cmp(a, b);
+	if (cmp > 0) {
+	    gcdext_hgcd(a, b, u, v, g);
+	    return;
+	} else if (cmp < 0) {
+	    gcdext_hgcd(b, a, v, u, g);
+	    return;
+	}
+    }
+
     /* 1. Initialize. */
     mpi_set_u32(u, 1);
     mpi_set_mpi(g, a);
@@ -0,0 +1,52 @@
+/* mpi_modexp.c
+ * Copyright (C) 2003-2012 Farooq Mela. All rights reserved. */
+
+#include "mpi.h"
+#include "mpi_internal.h"
+
+/* R = A^P mod M, with 0 <= R < M. P must be nonnegative and M positive. A
+ * negative A gives the same result as its (nonnegative) residue modulo M. */
+void
+mpi_modexp(const mpi *a, const mpi *p, const mpi *m, mpi *r)
+{
+    ASSERT(a != NULL);
+    ASSERT(p != NULL);
+    ASSERT(m != NULL);
+    ASSERT(r != NULL);
+    ASSERT(m->size != 0);
+    ASSERT(!m->sign);
+    ASSERT(!p->sign);
+
+    if (a->size == 0 || mpi_is_one(m)) {
+	mpi_zero(r);
+	return;
+    }
+    if (p->size == 0) {
+	mpi_set_u32(r, 1);
+	return;
+    }
+
+    const mp_size msize = m->size;
+    mp_digit *w = MP_TMP_ALLOC(msize);
+    mp_powm(a->digits, a->size, p->digits, p->size, m->digits, msize, w);
+    mp_size wsize = mp_rsize(w, msize);
+    /* (-A)^P = -(A^P) for odd P. */
+    if (a->sign && (p->digits[0] & 1) && wsize != 0) {
+	ASSERT(mp_sub(m->digits, msize, w, wsize, w) == 0);
+	wsize = mp_rsize(w, msize);
+    }
+    MPI_MIN_ALLOC(r, msize);
+    mp_copy(w, wsize, r->digits);
+    r->size = wsize;
+    r->sign = 0;
+    MP_TMP_FREE(w);
+}
+
+void
+mpi_modexp_u32(const mpi *a, uint32_t p, const mpi *m, mpi *r)
+{
+    mpi_t pp;
+    mpi_init_u32(pp, p);
+    mpi_modexp(a, pp, m, r);
+    mpi_free(pp);
+}
@@ -0,0 +1,44 @@
+/* mpi_modsqrt.c
+ * Copyright (C) 2003-2012 Farooq Mela. All rights reserved. */
+
+#include "mpi.h"
+#include "mpi_internal.h"
+
+/* Find a square root R of A modulo the odd prime P, such that R^2 = A (mod P).
+ * If A is a quadratic residue, stores the root in R and returns 1. Returns 0
+ * otherwise. */
+int
+mpi_modsqrt(const mpi *a, const mpi *p, mpi *r)
+{
+    ASSERT(a != NULL);
+    ASSERT(p != NULL);
+    ASSERT(r != NULL);
+    ASSERT(mpi_is_pos(p));
+    ASSERT(mpi_is_odd(p));
+
+    const mp_size psize = p->size;
+    mp_digit *w = MP_TMP_ALLOC(psize);
+    bool ok;
+    if (a->sign) {
+	/* -|A| mod P = P - (|A| mod P) */
+	if (mp_cmp(a->digits, a->size, p->digits, psize) >= 0)
+	    mp_mod(a->digits, a->size, p->digits, psize, w);
+	else
+	    mp_copy(a->digits, a->size, w);
+	const mp_size wsize = mp_rsize(w, MIN(a->size, psize));
+	if (wsize != 0)
+	    ASSERT(mp_sub(p->digits, psize, w, wsize, w) == 0);
+	ok = mp_modsqrt(w, wsize != 0 ? psize : 0, p->digits, psize, w);
+    } else {
+	ok = mp_modsqrt(a->digits, a->size, p->digits, psize, w);
+    }
+    if (ok) {
+	const mp_size wsize = mp_rsize(w, psize);
+	MPI_MIN_ALLOC(r, wsize);
+	mp_copy(w, wsize, r->digits);
+	r->size = wsize;
+	r->sign = 0;
+    }
+    MP_TMP_FREE(w);
+    return ok;
+}
@@ -0,0 +1,275 @@
+/* mpi_prodtree.c
+ * Copyright (C) 2003-2012 Farooq Mela. All rights reserved. */
+
+#include "mpi.h"
+#include "mpi_internal.h"
+#include "weecrypt_memory.h"
+
+/* Products of at most this many words are accumulated one word at a time. */
+#define PRODUCT_BASE	8
+
+/* Multiplying the numbers in order makes each step cost a multiplication of
+ * the product so far, which is quadratic in the size of the result overall.
+ * Splitting the range in halves instead multiplies numbers of like size at
+ * each level, so that the cost is that of multiplying out the result, times
+ * the number of levels. */
+void
+mpi_product(const mpi *const *in, unsigned n, mpi *out)
+{
+    ASSERT(in != NULL || n == 0);
+    ASSERT(out != NULL);
+
+    if (n == 0) {
+	mpi_set_u32(out, 1);
+	return;
+    }
+    if (n == 1) {
+	mpi_set_mpi(out, in[0]);
+	return;
+    }
+
+    /* Both halves go to temporaries, so OUT may alias an input. */
+    mpi_t lo, hi;
+    mpi_init(lo);
+    mpi_init(hi);
+    mpi_product(in, n / 2, lo);
+    mpi_product(in + n / 2, n - n / 2, hi);
+    mpi_mul(lo, hi, out);
+    mpi_free(lo);
+    mpi_free(hi);
+}
+
+void
+mpi_product_u64(const uint64_t *in, unsigned n, mpi *out)
+{
+    ASSERT(in != NULL || n == 0);
+    ASSERT(out != NULL);
+
+    if (n <= PRODUCT_BASE) {
+	mpi_set_u32(out, 1);
+	for (unsigned i = 0; i < n; i++)
+	    mpi_mul_u64(out, in[i], out);
+	return;
+    }
+
+    mpi_t hi;
+    mpi_init(hi);
+    mpi_product_u64(in, n / 2, out);
+    mpi_product_u64(in + n / 2, n - n / 2, hi);
+    mpi_mul(out, hi, out);
+    mpi_free(hi);
+}
+
+/* Take the factors of two out of the integers, which then go into a word
+ * until the next would overflow it, and multiply out the words as above. */
+void
+mpi_product_range(uint64_t lo, uint64_t hi, mpi *out)
+{
+    ASSERT(out != NULL);
+
+    if (lo == 0) {
+	mpi_zero(out);
+	return;
+    }
+
+    unsigned n = 0, alloc = 0, twos = 0;
+    uint64_t *words = NULL;
+    uint64_t w = 1;
+    for (uint64_t i = lo; i <= hi && i != 0; i++) {
+	uint64_t m = i;
+	while ((m & 1) == 0) {
+	    m >>= 1;
+	    twos++;
+	}
+	if (w <= UINT64_MAX / m) {
+	    w *= m;
+	    continue;
+	}
+	if (n == alloc) {
+	    alloc = alloc ? alloc * 2 : 64;
+	    words = REALLOC(words, alloc * sizeof(uint64_t));
+	}
+	words[n++] = w;
+	w = m;
+    }
+    mpi_product_u64(words, n, out);
+    mpi_mul_u64(out, w, out);
+    mpi_lshift(out, twos, out);
+    FREE(words);
+}
+
+/* Node I of level L is the odd one out of the level below, carried up as it
+ * is; its remainder is then its parent's. */
+#define CARRIED(tree,l,i) \
+    ((l) + 1 < (tree)->levels && (i) % 2 == 0 && (i) + 1 == (tree)->count[l])
+
+void
+mpi_prodtree_init(mpi_prodtree *tree, const mpi *const *leaves, unsigned n)
+{
+    ASSERT(tree != NULL);
+    ASSERT(tree->node == NULL);
+    ASSERT(leaves != NULL);
+    ASSERT(n != 0);
+
+    unsigned levels = 1;
+    for (unsigned c = n; c > 1; c = (c + 1) / 2)
+	levels++;
+    tree->levels = levels;
+    tree->count = MALLOC(levels * sizeof(unsigned));
+    tree->node = MALLOC(levels * sizeof(mpi *));
+    tree->ctx = NULL;
+
+    tree->count[0] = n;
+    tree->node[0] = MALLOC(n * sizeof(mpi));
+    for (unsigned i = 0; i < n; i++) {
+	ASSERT(mpi_is_pos(leaves[i]));
+	mpi_init_mpi(&tree->node[0][i], leaves[i]);
+    }
+    for (unsigned l = 1; l < levels; l++) {
+	const mpi *below = tree->node[l - 1];
+	const unsigned count = (tree->count[l - 1] + 1) / 2;
+	tree->count[l] = count;
+	tree->node[l] = MALLOC(count * sizeof(mpi));
+	for (unsigned i = 0; i < count; i++) {
+	    if (CARRIED(tree, l - 1, 2 * i)) {
+		mpi_init_mpi(&tree->node[l][i], &below[2 * i]);
+	    } else {
+		mpi_init(&tree->node[l][i]);
+		mpi_mul(&below[2 * i], &below[2 * i + 1], &tree->node[l][i]);
+	    }
+	}
+    }
+}
+
+void
+mpi_prodtree_free(mpi_prodtree *tree)
+{
+    ASSERT(tree != NULL);
+
+    for (unsigned l = 0; l < tree->levels; l++) {
+	for (unsigned i = 0; i < tree->count[l]; i++) {
+	    if (tree->ctx != NULL && tree->ctx[l][i].mu != NULL)
+		mp_barrett_ctx_free(&tree->ctx[l][i]);
+	    mpi_free(&tree->node[l][i]);
+	}
+	if (tree->ctx != NULL)
+	    FREE(tree->ctx[l]);
+	FREE(tree->node[l]);
+    }
+    FREE(tree->ctx);
+    FREE(tree->node);
+    FREE(tree->count);
+    tree->ctx = NULL;
+    tree->node = NULL;
+    tree->count = NULL;
+    tree->levels = 0;
+}
+
+/* R = A mod M, through CTX if it has been set up. Long division would make a
+ * remainder tree quadratic, so large nodes get a Barrett context, whose
+ * reciprocal is found with multiplications only. R must not alias A. */
+void
+mpi_barrett_mod(const mpi *a, const mpi *m, const mp_barrett_ctx *ctx, mpi *r)
+{
+    if (ctx->mu == NULL) {
+	mpi_mod(a, m, r);
+    } else if (mpi_cmp(a, m) < 0) {
+	mpi_set_mpi(r, a);
+    } else {
+	MPI_MIN_ALLOC(r, m->size);
+	mp_barrett_mod(a->digits, a->size, ctx, r->digits);
+	r->size = mp_rsize(r->digits, m->size);
+	r->sign = 0;
+    }
+}
+
+/* R = A mod M, for a modulus used only once. */
+static void
+node_mod(const mpi *a, const mpi *m, mpi *r)
+{
+    mp_barrett_ctx ctx = MP_BARRETT_CTX_INITIALIZER;
+    if (m->size >= BARRETT_NEWTON_THRESHOLD && mpi_cmp(a, m) >= 0)
+	mp_barrett_ctx_init(&ctx, m->digits, m->size);
+    mpi_barrett_mod(a, m, &ctx, r);
+    if (ctx.mu != NULL)
+	mp_barrett_ctx_free(&ctx);
+}
+
+/* Set up the contexts of the nodes large enough to need them. */
+static void
+build_contexts(mpi_prodtree *tree)
+{
+    tree->ctx = MALLOC(tree->levels * sizeof(mp_barrett_ctx *));
+    for (unsigned l = 0; l < tree->levels; l++) {
+	tree->ctx[l] = MALLOC(tree->count[l] * sizeof(mp_barrett_ctx));
+	for (unsigned i = 0; i < tree->count[l]; i++) {
+	    const mpi *m = &tree->node[l][i];
+	    const mp_barrett_ctx init = MP_BARRETT_CTX_INITIALIZER;
+	    tree->ctx[l][i] = init;
+	    if (m->size >= BARRETT_NEWTON_THRESHOLD && !CARRIED(tree, l, i))
+		mp_barrett_ctx_init(&tree->ctx[l][i], m->digits, m->size);
+	}
+    }
+}
+
+/* Reduce X modulo the root, then each remainder modulo the children of its
+ * node, down to the leaves; with SQR, modulo the squares of the nodes. */
+static void
+remtree(mpi_prodtree *tree, const mpi *x, mpi *const *rems, bool sqr)
+{
+    ASSERT(tree != NULL);
+    ASSERT(tree->node != NULL);
+    ASSERT(x != NULL);
+    ASSERT(!mpi_is_neg(x));
+    ASSERT(rems != NULL);
+
+    if (!sqr && tree->ctx == NULL)
+	build_contexts(tree);
+
+    mpi_t sq;
+    mpi_init(sq);
+    const mpi *parent = x;
+    mpi *cur = NULL;
+    for (unsigned l = tree->levels; l-- > 0; ) {
+	const unsigned count = tree->count[l];
+	mpi *next = NULL;
+	if (l != 0) {
+	    next = MALLOC(count * sizeof(mpi));
+	    for (unsigned i = 0; i < count; i++)
+		mpi_init(&next[i]);
+	}
+	for (unsigned i = 0; i < count; i++) {
+	    mpi *r = l != 0 ? &next[i] : rems[i];
+	    if (cur != NULL)
+		parent = &cur[i / 2];
+	    const mpi *m = &tree->node[l][i];
+	    if (CARRIED(tree, l, i)) {
+		mpi_set_mpi(r, parent);
+	    } else if (sqr) {
+		mpi_sqr(m, sq);
+		node_mod(parent, sq, r);
+	    } else {
+		mpi_barrett_mod(parent, m, &tree->ctx[l][i], r);
+	    }
+	}
+	if (cur != NULL) {
+	    for (unsigned i = 0; i < tree->count[l + 1]; i++)
+		mpi_free(&cur[i]);
+	    FREE(cur);
+	}
+	cur = next;
+    }
+    mpi_free(sq);
+}
+
+void
+mpi_remtree(mpi_prodtree *tree, const mpi *x, mpi *const *rems)
+{
+    remtree(tree, x, rems, false);
+}
+
+void
+mpi_remtree_sqr(mpi_prodtree *tree, const mpi *x, mpi *const *rems)
+{
+    remtree(tree, x, rems, true);
+}
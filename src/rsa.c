@@ -3,8 +3,6 @@
 
 #include <string.h>
 
-static const unsigned kCompositeTestRounds = 10;
-
 bool
 rsa_init_keygen(rsa_ctx *rsa, unsigned bits, mt64_context *rand_ctx)
 {
@@ -16,8 +14,7 @@ rsa_init_keygen(rsa_ctx *rsa, unsigned bits, mt64_context *rand_ctx)
     mpi_t p = MPI_INITIALIZER;
     mpi_rand_ctx(p, bits/2, rand_ctx);
     p->digits[0] |= 1;
-    while (mp_sieve(p->digits, p->size) ||
-	   mp_composite(p->digits, p->size, kCompositeTestRounds))
+    while (mp_sieve(p->digits, p->size) || !mp_bpsw(p->digits, p->size))
 	mpi_add_u32(p, 2, p);
 
     /* Generate Q. */
@@ -25,8 +22,7 @@ rsa_init_keygen(rsa_ctx *rsa, unsigned bits, mt64_context *rand_ctx)
     mpi_rand_ctx(q, bits-bits/2, rand_ctx);
     q->digits[0] |= 1;
     while (mpi_cmp(p, q) == 0 ||
-	   mp_sieve(q->digits, q->size) ||
-	   mp_composite(q->digits, q->size, kCompositeTestRounds))
+	   mp_sieve(q->digits, q->size) || !mp_bpsw(q->digits, q->size))
 	mpi_add_u32(q, 2, q);
 
     /* Set N = PQ */
@@ -0,0 +1,109 @@
+/* tune_powm.c
+ * Copyright (C) 2002-2012 Farooq Mela. All rights reserved.
+ *
+ * Measures the crossovers between binary exponentiation with division
+ * (mp_modexp) and windowed Montgomery exponentiation (mp_mexp) used by
+ * mp_powm(), and prints them as the tables in mp_config.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "weecrypt.h"
+
+#define SIZE_CLASSES	8	/* Moduli of 1, 2, 4, ..., 128 digits. */
+#define MAX_EXP_BITS	4096
+
+/* Return the time in seconds per call of mp_modexp (if MONT is false) or mp_mexp
+ * (if MONT is true), taking the best of several runs. */
+static double
+time_powm(bool mont, const mp_digit *u, mp_size usize,
+	  const mp_digit *p, mp_size psize,
+	  const mp_digit *m, mp_size msize, mp_digit *w)
+{
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+	unsigned iters = 0;
+	const clock_t start = clock();
+	clock_t end;
+	do {
+	    if (mont)
+		mp_mexp(u, usize, p, psize, m, msize, w);
+	    else
+		mp_modexp(u, usize, p, psize, m, msize, w);
+	    iters++;
+	} while ((end = clock()) - start < CLOCKS_PER_SEC / 50);
+	const double t = (double)(end - start) / CLOCKS_PER_SEC / iters;
+	if (run == 0 || t < best)
+	    best = t;
+    }
+    return best;
+}
+
+/* Return true if mp_mexp is faster than mp_modexp for an exponent of BITS
+ * bits. */
+static bool
+mont_wins(unsigned bits, const mp_digit *u, mp_size usize,
+	  const mp_digit *m, mp_size msize, mp_digit *p, mp_digit *w)
+{
+    const mp_size psize = (bits + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS;
+    mp_rand(p, psize);
+    if (bits % MP_DIGIT_BITS)
+	p[psize - 1] &= ((mp_digit)1 << (bits % MP_DIGIT_BITS)) - 1;
+    p[psize - 1] |= (mp_digit)1 << ((bits - 1) % MP_DIGIT_BITS);
+    return time_powm(true, u, usize, p, psize, m, msize, w) <
+	   time_powm(false, u, usize, p, psize, m, msize, w);
+}
+
+/* Return the least exponent length from which on mp_mexp is faster, trying
+ * lengths that grow by about half each step. The timings are too noisy, and the
+ * window size steps too uneven, for a bisection to be reliable. */
+static unsigned
+crossover(const mp_digit *u, mp_size usize,
+	  const mp_digit *m, mp_size msize, mp_digit *p, mp_digit *w)
+{
+    unsigned threshold = 1;
+    for (unsigned bits = 2; bits <= MAX_EXP_BITS; bits += (bits + 1) / 2) {
+	if (!mont_wins(bits, u, usize, m, msize, p, w))
+	    threshold = bits + 1;
+    }
+    return threshold;
+}
+
+int
+main(void)
+{
+    const mp_size max_size = (mp_size)1 << (SIZE_CLASSES - 1);
+    mp_digit *m = mp_new(max_size);
+    mp_digit *u = mp_new(max_size);
+    mp_digit *w = mp_new(max_size);
+    mp_digit *p = mp_new(MAX_EXP_BITS / MP_DIGIT_BITS);
+    unsigned full[SIZE_CLASSES], small[SIZE_CLASSES];
+
+    for (unsigned i = 0; i < SIZE_CLASSES; i++) {
+	const mp_size n = (mp_size)1 << i;
+	mp_rand(m, n);
+	m[0] |= 1;
+	m[n - 1] |= MP_DIGIT_MSB;
+	mp_rand(u, n);
+	mp_modi(u, n, m, n);
+	full[i] = crossover(u, n, m, n, p, w);
+	u[0] = 3;
+	small[i] = crossover(u, 1, m, n, p, w);
+	fprintf(stderr, "%4u digits: %4u bits, %4u bits for a one-digit base\n",
+		n, full[i], small[i]);
+    }
+
+    printf("# define POWM_EXP_BITS_TABLE\t\t{");
+    for (unsigned i = 0; i < SIZE_CLASSES; i++)
+	printf(" %u%s", full[i], i + 1 < SIZE_CLASSES ? "," : " }\n");
+    printf("# define POWM_SMALL_BASE_EXP_BITS_TABLE\t{");
+    for (unsigned i = 0; i < SIZE_CLASSES; i++)
+	printf(" %u%s", small[i], i + 1 < SIZE_CLASSES ? "," : " }\n");
+
+    mp_free(m);
+    mp_free(u);
+    mp_free(w);
+    mp_free(p);
+    return 0;
+}
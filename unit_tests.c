@@ -49,7 +49,27 @@ void test_mp_div();
 void test_mp_lshift();
 void test_mp_rshift();
 void test_mp_sieve();
+void test_mp_bpsw();
+void test_mp_composite();
 void test_mp_gcd_bug();
+void test_mp_hgcd();
+void test_mp_lehmer();
+void test_mp_jacobi();
+void test_mp_sqrtrem();
+void test_mp_perfsqr();
+void test_mp_rootrem();
+void test_mp_perfect_power();
+void test_mp_mod_2k();
+void test_mp_ddivi_preinv();
+void test_mp_mont();
+void test_mp_mont_mul_kernels();
+void test_mp_barrett();
+void test_mp_modexp_u64();
+void test_mp_fixedbase();
+void test_mp_multi_exp();
+void test_mp_powm();
+void test_mp_mod_ctx();
+void test_mp_special();
 
 CU_TestInfo mp_basic_tests[] = {
     TEST_FUNC(test_mp_rand),
@@ -63,7 +83,27 @@ CU_TestInfo mp_basic_tests[] = {
     TEST_FUNC(test_mp_lshift),
     TEST_FUNC(test_mp_rshift),
     TEST_FUNC(test_mp_sieve),
+    TEST_FUNC(test_mp_bpsw),
+    TEST_FUNC(test_mp_composite),
     TEST_FUNC(test_mp_gcd_bug),
+    TEST_FUNC(test_mp_hgcd),
+    TEST_FUNC(test_mp_lehmer),
+    TEST_FUNC(test_mp_jacobi),
+    TEST_FUNC(test_mp_sqrtrem),
+    TEST_FUNC(test_mp_perfsqr),
+    TEST_FUNC(test_mp_rootrem),
+    TEST_FUNC(test_mp_perfect_power),
+    TEST_FUNC(test_mp_mod_2k),
+    TEST_FUNC(test_mp_ddivi_preinv),
+    TEST_FUNC(test_mp_mont),
+    TEST_FUNC(test_mp_mont_mul_kernels),
+    TEST_FUNC(test_mp_barrett),
+    TEST_FUNC(test_mp_modexp_u64),
+    TEST_FUNC(test_mp_fixedbase),
+    TEST_FUNC(test_mp_multi_exp),
+    TEST_FUNC(test_mp_powm),
+    TEST_FUNC(test_mp_mod_ctx),
+    TEST_FUNC(test_mp_special),
     CU_TEST_INFO_NULL
 };
 
@@ -73,6 +113,14 @@ void test_mpi_cmp();
 void test_mpi_fibonacci();
 void test_mpi_factorial();
 void test_mpi_binomial();
+void test_mpi_divrem_u32();
+void test_mpi_modexp();
+void test_mpi_modinv_batch();
+void test_mpi_modsqrt();
+void test_mpi_gcdext();
+void test_mpi_batch_gcd();
+void test_mpi_prodtree();
+void test_mpi_crt_plan();
 
 CU_TestInfo mpi_basic_tests[] = {
     TEST_FUNC(test_mpi_rand),
@@ -81,6 +129,14 @@ CU_TestInfo mpi_basic_tests[] = {
     TEST_FUNC(test_mpi_fibonacci),
     TEST_FUNC(test_mpi_factorial),
     TEST_FUNC(test_mpi_binomial),
+    TEST_FUNC(test_mpi_divrem_u32),
+    TEST_FUNC(test_mpi_modexp),
+    TEST_FUNC(test_mpi_modinv_batch),
+    TEST_FUNC(test_mpi_modsqrt),
+    TEST_FUNC(test_mpi_gcdext),
+    TEST_FUNC(test_mpi_batch_gcd),
+    TEST_FUNC(test_mpi_prodtree),
+    TEST_FUNC(test_mpi_crt_plan),
     CU_TEST_INFO_NULL
 };
 
@@ -477,6 +533,21 @@ void test_mp_mul()
 	}
     }
 
+    /* Zero times nonzero overwrites every digit of the product. */
+    B[0] = 1;
+    for (mp_size i = 1; i < N; ++i) {
+	for (mp_size j = 0; j < i*2; ++j)
+	    C[j] = MP_DIGIT_MAX;
+	mp_mul_n(A, B, i, C);
+	for (mp_size j = 0; j < i*2; ++j)
+	    CU_ASSERT_EQUAL(C[j], 0);
+	for (mp_size j = 0; j < i*2; ++j)
+	    C[j] = MP_DIGIT_MAX;
+	mp_mul_n(B, A, i, C);
+	for (mp_size j = 0; j < i*2; ++j)
+	    CU_ASSERT_EQUAL(C[j], 0);
+    }
+
     /* Initialize to maximum value. */
     for (mp_size i = 0; i < N; ++i) {
 	A[i] = B[i] = MP_DIGIT_MAX;
@@ -641,6 +712,20 @@ void test_mp_sieve()
 	}
 	CU_ASSERT_TRUE(smallest_factor(v) == 0);
     }
+
+    /* Longer numbers are reduced modulo each product of primes in turn; a
+     * power of a single prime must give that prime back. */
+    for (unsigned p = 3; p <= max_n; p += 2) {
+	if (smallest_factor(p) != 0)
+	    continue;
+	mp_digit v[3] = { p };
+	mp_size vsize = 1;
+	while (vsize < 2) {
+	    v[vsize] = mp_dmuli(v, vsize, p);
+	    vsize += v[vsize] != 0;
+	}
+	CU_ASSERT_EQUAL(mp_sieve(v, vsize), p);
+    }
 }
 
 void test_mpi_rand() {
@@ -1186,6 +1271,1626 @@ void test_mp_gcd_bug()
     mp_free(g);
 }
 
+/* Reference GCD by Euclid's algorithm; U and V are destroyed. */
+static mp_size euclid_gcd(mp_digit *u, mp_size usize,
+			  mp_digit *v, mp_size vsize, mp_digit *g)
+{
+    MP_NORMALIZE(u, usize);
+    MP_NORMALIZE(v, vsize);
+    while (vsize != 0) {
+	mp_modi(u, usize, v, vsize);
+	usize = mp_rsize(u, vsize);
+	SWAP(u, v, mp_digit *);
+	SWAP(usize, vsize, mp_size);
+    }
+    mp_copy(u, usize, g);
+    return usize;
+}
+
+void test_mp_hgcd()
+{
+    const mp_size N = MAX(HGCD_THRESHOLD * 4, GCD_HGCD_THRESHOLD + 1);
+    mp_digit *a = mp_new(N), *b = mp_new(N), *c = mp_new(N), *d = mp_new(N);
+    mp_digit *g = mp_new(N), *t = mp_new(N * 2 + 1), *p = mp_new(N * 2);
+
+    /* A = M (C D)' with C >= B^K > D, for balanced and unbalanced operands. */
+    const mp_size H = HGCD_THRESHOLD * 4;
+    for (mp_size n = HGCD_THRESHOLD; n <= H; n += H / 7) {
+	for (mp_size bn = n / 2; bn <= n; bn += n / 4) {
+	    mp_rand(a, n);
+	    a[n - 1] |= 1;
+	    mp_rand(b, bn);
+	    if (bn == n)
+		b[n - 1] = a[n - 1] - 1;
+	    const mp_size k = n / 2;
+	    mp_size cn = n, dn = bn;
+	    mp_copy(a, n, c);
+	    mp_copy(b, bn, d);
+
+	    mp_hgcd_matrix m = MP_HGCD_MATRIX_INITIALIZER;
+	    mp_hgcd_matrix_init(&m, n);
+	    mp_hgcd(c, &cn, d, &dn, k, &m);
+	    CU_ASSERT(cn > k);
+	    CU_ASSERT(dn <= k);
+	    CU_ASSERT(mp_cmp(c, cn, d, dn) > 0);
+
+	    const mp_size ms = m.size;
+	    for (unsigned i = 0; i < 2; ++i) {
+		mp_zero(t, N * 2 + 1);
+		mp_mul(m.m[i][0], ms, c, cn, t);
+		mp_mul(m.m[i][1], ms, d, dn, p);
+		mp_addi(t, N * 2 + 1, p, ms + dn);
+		CU_ASSERT_EQUAL(mp_cmp(t, N * 2 + 1, i ? b : a, i ? bn : n), 0);
+	    }
+	    /* m00 m11 - m01 m10 = det */
+	    mp_zero(t, N * 2 + 1);
+	    mp_mul(m.m[0][0], ms, m.m[1][1], ms, t);
+	    mp_mul(m.m[0][1], ms, m.m[1][0], ms, p);
+	    if (m.det > 0) {
+		CU_ASSERT_EQUAL(mp_subi(t, ms * 2, p, ms * 2), 0);
+	    } else {
+		CU_ASSERT_EQUAL(mp_subi(p, ms * 2, t, ms * 2), 0);
+		mp_copy(p, ms * 2, t);
+	    }
+	    CU_ASSERT(mp_is_one(t, ms * 2));
+	    mp_hgcd_matrix_free(&m);
+	}
+    }
+
+    /* mp_gcd() above GCD_HGCD_THRESHOLD digits, against mp_lehmer(), with a
+     * common factor of varying size. */
+    const mp_size n = N;
+    for (mp_size gn = 1; gn < n - 1; gn += n / 3) {
+	mp_rand(g, gn);
+	g[0] |= 1;
+	mp_rand(c, n - gn);
+	mp_rand(d, n - gn - 1);
+	mp_mul(g, gn, c, n - gn, a);
+	mp_mul(g, gn, d, n - gn - 1, b);
+	mp_gcd(a, n, b, n - 1, g);
+	mp_lehmer(a, n, b, n - 1, p);
+	CU_ASSERT_EQUAL(mp_cmp_n(g, p, n - 1), 0);
+	mp_size gsize = n - 1;
+	MP_NORMALIZE(g, gsize);
+	CU_ASSERT(gsize >= gn);
+    }
+
+    mp_free(a);
+    mp_free(b);
+    mp_free(c);
+    mp_free(d);
+    mp_free(g);
+    mp_free(t);
+    mp_free(p);
+}
+
+void test_mp_lehmer()
+{
+    const mp_size N = 40;
+    mp_digit a[N * 2], b[N * 2], c[N * 2], d[N * 2], f[N], g[N * 2], r[N * 2];
+    mp_digit t[N * 2 + 1], p[N * 2];
+
+    /* mp_lehmer() and mp_gcd() against Euclid, for unbalanced operands,
+     * operands sharing their leading digits, and common factors. */
+    for (mp_size n = 1; n <= N; ++n) {
+	for (mp_size fn = 0; fn < n; fn += n / 3 + 1) {
+	    for (int k = 0; k < 3; ++k) {
+		const mp_size bn = k == 0 ? n / 2 + 1 : n;
+		mp_rand(c, n);
+		mp_rand(d, bn);
+		if (k == 2)
+		    mp_copy(c + 1, n - 1, d + 1);
+		mp_size an = n, cn = bn;
+		if (fn != 0) {
+		    mp_rand(f, fn);
+		    mp_mul(c, n, f, fn, a);
+		    mp_mul(d, bn, f, fn, b);
+		    an += fn;
+		    cn += fn;
+		} else {
+		    mp_copy(c, n, a);
+		    mp_copy(d, bn, b);
+		}
+		const mp_size gn = MIN(an, cn);
+		mp_lehmer(a, an, b, cn, g);
+		mp_gcd(a, an, b, cn, p);
+		CU_ASSERT_EQUAL(mp_cmp_n(g, p, gn), 0);
+		mp_copy(a, an, c);
+		mp_copy(b, cn, d);
+		const mp_size rn = euclid_gcd(c, an, d, cn, r);
+		mp_zero(r + rn, gn - rn);
+		CU_ASSERT_EQUAL(mp_cmp_n(g, r, gn), 0);
+	    }
+	}
+    }
+
+    /* Steps keep (A B)' = M (C D)' with C > D. */
+    unsigned steps = 0;
+    for (mp_size n = 2; n <= N; ++n) {
+	mp_rand(a, n);
+	a[n - 1] |= MP_DIGIT_MSB;
+	mp_rand(b, n);
+	b[n - 1] >>= 1;
+	mp_size cn = n, dn = n;
+	mp_copy(a, n, c);
+	mp_copy(b, n, d);
+
+	mp_hgcd_matrix m = MP_HGCD_MATRIX_INITIALIZER;
+	mp_hgcd_matrix_init(&m, n);
+	while (mp_lehmer_step(c, &cn, d, &dn, 0, &m)) {
+	    CU_ASSERT(mp_cmp(c, cn, d, dn) > 0);
+	    ++steps;
+	}
+
+	const mp_size ms = m.size;
+	for (unsigned i = 0; i < 2; ++i) {
+	    mp_zero(t, N * 2 + 1);
+	    mp_mul(m.m[i][0], ms, c, cn, t);
+	    if (dn != 0) {
+		mp_mul(m.m[i][1], ms, d, dn, p);
+		mp_addi(t, N * 2 + 1, p, ms + dn);
+	    }
+	    CU_ASSERT_EQUAL(mp_cmp(t, N * 2 + 1, i ? b : a, n), 0);
+	}
+	mp_hgcd_matrix_free(&m);
+    }
+    /* Most of the reduction is done by Lehmer steps. */
+    CU_ASSERT(steps >= N);
+}
+
+/* The Kronecker symbol A over P by the textbook algorithm. */
+static int kronecker(const mp_digit *a, mp_size asize,
+		     const mp_digit *p, mp_size psize)
+{
+    mpi_t x, y;
+    mpi_init_size(x, asize + 1);
+    mpi_init_size(y, psize + 1);
+    mp_copy(a, asize, x->digits);
+    x->size = mp_rsize(a, asize);
+    mp_copy(p, psize, y->digits);
+    y->size = mp_rsize(p, psize);
+
+    int k = 1;
+    if (mpi_is_zero(x)) {
+	k = mpi_is_one(y);
+    } else if (((x->digits[0] | y->digits[0]) & 1) == 0) {
+	k = 0;
+    } else {
+	for (; (y->digits[0] & 1) == 0; mpi_rshift(y, 1, y)) {
+	    if ((x->digits[0] & 7) == 3 || (x->digits[0] & 7) == 5)
+		k = -k;
+	}
+	mpi_mod(x, y, x);
+	while (!mpi_is_zero(x)) {
+	    for (; (x->digits[0] & 1) == 0; mpi_rshift(x, 1, x)) {
+		if ((y->digits[0] & 7) == 3 || (y->digits[0] & 7) == 5)
+		    k = -k;
+	    }
+	    mpi_swap(x, y);
+	    if (x->digits[0] & y->digits[0] & 2)
+		k = -k;
+	    mpi_mod(x, y, x);
+	}
+	if (!mpi_is_one(y))
+	    k = 0;
+    }
+    mpi_free(x);
+    mpi_free(y);
+    return k;
+}
+
+void test_mp_jacobi()
+{
+    const mp_size N = HGCD_THRESHOLD * 3;
+    mp_digit *a = mp_new(N * 2), *p = mp_new(N * 2), *f = mp_new(N);
+    mp_digit *t = mp_new(N * 2 + 4);
+
+    /* Only X that fit in one digit. */
+    const unsigned limit = (MP_DIGIT_MAX < 300) ? MP_DIGIT_MAX + 1 : 300;
+    for (unsigned j = 1; j < 200; ++j) {
+	const mp_digit y = j;
+	for (unsigned i = 0; i < limit; ++i) {
+	    const mp_digit x = i;
+	    CU_ASSERT_EQUAL(mp_jacobi(&x, 1, &y, 1), kronecker(&x, 1, &y, 1));
+	}
+    }
+
+    /* Single digit, Lehmer and half-GCD sizes, odd and even P, and common
+     * factors. */
+    int seen[3] = { 0, 0, 0 };
+    for (mp_size n = 1; n <= N; n += n < 12 ? 1 : n / 2) {
+	for (int k = 0; k < 12; ++k) {
+	    const mp_size an = k % 3 == 0 ? n + 2 : n, pn = n;
+	    mp_rand(a, an);
+	    mp_rand(p, pn);
+	    if (k % 4 != 3)
+		p[0] |= 1;
+	    mp_size sa = an, sp = pn;
+	    if (k % 5 == 4) {
+		const mp_size fn = n / 2 + 1;
+		mp_rand(f, fn);
+		mp_mul(a, an, f, fn, t);
+		mp_copy(t, an + fn, a);
+		mp_mul(p, pn, f, fn, t);
+		mp_copy(t, pn + fn, p);
+		sa += fn;
+		sp += fn;
+	    }
+	    const int j = mp_jacobi(a, sa, p, sp);
+	    CU_ASSERT_EQUAL(j, kronecker(a, sa, p, sp));
+	    seen[j + 1]++;
+	}
+    }
+    CU_ASSERT(seen[0] != 0 && seen[1] != 0 && seen[2] != 0);
+
+    /* The quotients mp_hgcd() records are those of Euclid. */
+    mp_digit *c = mp_new(N), *d = mp_new(N), *q = mp_new(N + 1);
+    mp_rand(c, N);
+    c[N - 1] |= MP_DIGIT_MSB;
+    mp_rand(d, N);
+    d[N - 1] >>= 1;
+    mp_copy(c, N, a);
+    mp_copy(d, N, p);
+    mp_hgcd_matrix m = MP_HGCD_MATRIX_INITIALIZER;
+    mp_hgcd_matrix_init(&m, 0);
+    mp_hgcd_matrix_log(&m);
+    mp_size an = N, pn = N;
+    mp_hgcd(a, &an, p, &pn, 0, &m);
+    CU_ASSERT_EQUAL(pn, 0);
+    mp_size cn = N, dn = N, i = 0;
+    while (dn != 0 && i < m.qcount) {
+	mp_divrem(c, cn, d, dn, q, f);
+	CU_ASSERT_EQUAL(q[0] & 7, m.q[i]);
+	++i;
+	mp_copy(d, dn, c);
+	cn = dn;
+	mp_copy(f, dn, d);
+	dn = mp_rsize(d, dn);
+    }
+    CU_ASSERT_EQUAL(dn, 0);
+    CU_ASSERT_EQUAL(i, m.qcount);
+    mp_hgcd_matrix_free(&m);
+
+    mp_free(a);
+    mp_free(p);
+    mp_free(f);
+    mp_free(t);
+    mp_free(c);
+    mp_free(d);
+    mp_free(q);
+}
+
+void test_mp_bpsw()
+{
+    /* All N below 2^16, against a sieve. These include the strong base 2
+     * pseudoprimes 2047, 3277, ... and the strong Lucas pseudoprimes 5459,
+     * 5777, ..., each of which one half of the test must catch. */
+    enum { N = 1 << 16 };
+    static bool composite[N];
+    composite[0] = composite[1] = true;
+    for (unsigned i = 2; i * i < N; ++i) {
+	if (!composite[i]) {
+	    for (unsigned j = i * i; j < N; j += i)
+		composite[j] = true;
+	}
+    }
+    /* Only those that fit in one digit. */
+    const uint32_t limit = (MP_DIGIT_MAX < N) ? (uint32_t)MP_DIGIT_MAX + 1 : N;
+    for (uint32_t i = 0; i < limit; ++i) {
+	const mp_digit n = i;
+	CU_ASSERT_EQUAL(mp_bpsw(&n, 1), !composite[i]);
+    }
+
+    /* Carmichael numbers, strong pseudoprimes to the bases up to 7 and up to
+     * 37, and larger strong Lucas pseudoprimes. */
+    static const uint64_t pseudo[] = {
+	41041, 825265, 321197185, 3215031751, 3825123056546413051ULL,
+	155819, 158399, 161027, 162133, 176399, 176471, 189419, 192509,
+    };
+    mpi_t m = MPI_INITIALIZER, t = MPI_INITIALIZER;
+    for (unsigned i = 0; i < sizeof(pseudo) / sizeof(pseudo[0]); ++i) {
+	mpi_set_u64(m, pseudo[i]);
+	CU_ASSERT_FALSE(mp_bpsw(m->digits, m->size));
+    }
+
+    /* Mersenne numbers, their products, and a square. */
+    static const unsigned mersenne[] = { 61, 89, 107, 127, 521, 607 };
+    static const unsigned composite_exp[] = { 67, 101, 257, 1277 };
+    for (unsigned i = 0; i < sizeof(mersenne) / sizeof(mersenne[0]); ++i) {
+	mpi_set_u32(m, 1);
+	mpi_lshift(m, mersenne[i], m);
+	mpi_dec(m);
+	CU_ASSERT_TRUE(mp_bpsw(m->digits, m->size));
+	if (i != 0) {
+	    mpi_mul(m, t, t);
+	    CU_ASSERT_FALSE(mp_bpsw(t->digits, t->size));
+	    mpi_sqr(m, t);
+	    CU_ASSERT_FALSE(mp_bpsw(t->digits, t->size));
+	}
+	mpi_set_mpi(t, m);
+    }
+    for (unsigned i = 0;
+	 i < sizeof(composite_exp) / sizeof(composite_exp[0]); ++i) {
+	mpi_set_u32(m, 1);
+	mpi_lshift(m, composite_exp[i], m);
+	mpi_dec(m);
+	CU_ASSERT_FALSE(mp_bpsw(m->digits, m->size));
+    }
+    mpi_free(m);
+    mpi_free(t);
+}
+
+void test_mp_composite()
+{
+    enum { N = 1 << 20 };
+    bool *composite = calloc(N, sizeof(bool));
+    composite[0] = composite[1] = true;
+    for (unsigned i = 2; i * i < N; ++i) {
+	if (!composite[i]) {
+	    for (unsigned j = i * i; j < N; j += i)
+		composite[j] = true;
+	}
+    }
+    /* Only those that fit in one digit. */
+    const uint32_t limit = (MP_DIGIT_MAX < N) ? (uint32_t)MP_DIGIT_MAX + 1 : N;
+    for (uint32_t i = 0; i < limit; ++i) {
+	const mp_digit n = i;
+	CU_ASSERT_EQUAL(mp_digit_is_prime(n), !composite[i]);
+	if (n > 3)
+	    CU_ASSERT_EQUAL(mp_composite(&n, 1, 1), composite[i]);
+    }
+    free(composite);
+
+    /* Random digits, against Baillie-PSW. */
+    for (int i = 0; i < 100000; ++i) {
+	mp_digit n;
+	mp_rand(&n, 1);
+	n |= 1;
+	CU_ASSERT_EQUAL(mp_digit_is_prime(n), mp_bpsw(&n, 1));
+    }
+
+    /* The least strong pseudoprimes to the first 4, 5, 6, 7, 9, 12 and 13
+     * prime bases, each past the range of the bases before; psi_13, the last,
+     * is where random rounds take over. Then primes in the range of 12 or 13
+     * bases. */
+    static const char *const composites[] = {
+	"3215031751", "2152302898747", "3474749660383", "341550071728321",
+	"3825123056546413051", "318665857834031151167461",
+	"3317044064679887385961981",
+    };
+    static const char *const primes[] = {
+	"18446744073709551629", "1208925819614629174706111",
+	"3317044064679887385961813",
+    };
+    mpi_t m = MPI_INITIALIZER;
+    for (unsigned i = 0; i < sizeof(composites) / sizeof(composites[0]); ++i) {
+	CU_ASSERT_TRUE(mpi_set_str(m, composites[i], 10));
+	CU_ASSERT_TRUE(mp_composite(m->digits, m->size, 20));
+    }
+    for (unsigned i = 0; i < sizeof(primes) / sizeof(primes[0]); ++i) {
+	CU_ASSERT_TRUE(mpi_set_str(m, primes[i], 10));
+	CU_ASSERT_FALSE(mp_composite(m->digits, m->size, 1));
+    }
+
+    /* Random rounds from a context of the caller's. */
+    mt64_context ctx = MT64_INITIALIZER;
+    mt64_init_u64(&ctx, 0x2545f4914f6cdd1dULL);
+    mpi_t p = MPI_INITIALIZER;
+    static const unsigned mersenne[] = { 89, 107, 127, 521 };
+    for (unsigned i = 0; i < sizeof(mersenne) / sizeof(mersenne[0]); ++i) {
+	mpi_set_u32(p, 1);
+	mpi_lshift(p, mersenne[i], p);
+	mpi_dec(p);
+	CU_ASSERT_FALSE(mp_composite_ctx(p->digits, p->size, 10, &ctx));
+	if (i != 0) {
+	    mpi_mul(m, p, m);
+	    CU_ASSERT_TRUE(mp_composite_ctx(m->digits, m->size, 10, &ctx));
+	}
+	mpi_set_mpi(m, p);
+    }
+    mpi_free(p);
+    mpi_free(m);
+}
+
+void test_mp_sqrtrem()
+{
+    const mp_size N = 64;
+    mp_digit U[N], V[N/2], R[N], V2[N/2], R2[N], T[N];
+
+    for (mp_size n = 1; n <= N; ++n) {
+	const mp_size vsize = (n + 1) / 2;
+	for (int k = 0; k < 3; ++k) {
+	    mp_rand(U, n);
+	    if (k == 1)
+		U[n - 1] >>= n % MP_DIGIT_BITS;	/* Unnormalized. */
+	    else if (k == 2)
+		mp_fill(U, n, MP_DIGIT_MAX);
+
+	    mp_sqrtrem(U, n, V, R);
+	    /* U = V^2 + R with 0 <= R <= 2V. */
+	    mp_sqr(V, vsize, T);
+	    CU_ASSERT_EQUAL(mp_addi(T, n, R, n), 0);
+	    CU_ASSERT_TRUE(mp_cmp_n(T, U, n) == 0);
+	    mp_copy(V, vsize, T);
+	    T[vsize] = mp_lshifti(T, vsize, 1);
+	    CU_ASSERT_TRUE(mp_cmp(R, n, T, vsize + 1) <= 0);
+
+	    /* Either output may be omitted. */
+	    mp_sqrtrem(U, n, V2, NULL);
+	    CU_ASSERT_TRUE(mp_cmp_n(V, V2, vsize) == 0);
+	    mp_sqrtrem(U, n, NULL, R2);
+	    CU_ASSERT_TRUE(mp_cmp_n(R, R2, n) == 0);
+
+	    /* A perfect square has zero remainder. */
+	    mp_sqr(V, vsize, T);
+	    CU_ASSERT_TRUE(mp_perfsqr(T, 2 * vsize));
+	}
+    }
+}
+
+void test_mp_perfsqr()
+{
+    const mp_size N = 16;
+    mp_digit V[N], U[2 * N], R[2 * N];
+
+    for (mp_size n = 1; n <= N; ++n) {
+	for (int i = 0; i < 200; ++i) {
+	    mp_rand(V, n);
+	    mp_sqr(V, n, U);
+	    CU_ASSERT_TRUE(mp_perfsqr(U, 2 * n));
+	    /* Nearby numbers agree with the square root remainder. */
+	    if (i % 2)
+		mp_dsubi(U, 2 * n, (mp_digit)i);
+	    else
+		mp_daddi(U, 2 * n, (mp_digit)i);
+	    mp_sqrtrem(U, 2 * n, NULL, R);
+	    CU_ASSERT_EQUAL(mp_perfsqr(U, 2 * n), mp_is_zero(R, 2 * n));
+	}
+    }
+}
+
+void test_mp_rootrem()
+{
+    const mp_size N = 48, K = 200;
+    mp_digit U[N], V[N], R[N], T[N + 1], P[2 * N + K];
+
+    for (unsigned k = 1; k <= K; k += (k < 10) ? 1 : 17) {
+	for (mp_size n = 1; n <= N; n += 3) {
+	    const mp_size vsize = (n + k - 1) / k;
+	    mp_rand(U, n);
+	    U[n - 1] >>= (n * k) % MP_DIGIT_BITS;
+	    U[0] |= 1;
+	    mp_rootrem(U, n, k, V, R);
+	    const mp_size vlen = mp_rsize(V, vsize);
+	    CU_ASSERT_NOT_EQUAL(vlen, 0);
+
+	    /* U = V^k + R. */
+	    mp_zero(P, n);
+	    mp_exp(V, vlen, k, P);
+	    CU_ASSERT_TRUE(mp_rsize(P, vlen * k) <= n);
+	    CU_ASSERT_EQUAL(mp_addi(P, n, R, n), 0);
+	    CU_ASSERT_TRUE(mp_cmp_n(P, U, n) == 0);
+
+	    /* (V + 1)^k > U. */
+	    mp_copy(V, vlen, T);
+	    T[vlen] = mp_inc(T, vlen);
+	    const mp_size tsize = vlen + (T[vlen] != 0);
+	    mp_exp(T, tsize, k, P);
+	    CU_ASSERT_TRUE(mp_cmp(P, tsize * k, U, n) > 0);
+	}
+    }
+}
+
+void test_mp_perfect_power()
+{
+    mp_digit U[32], X[16];
+
+    U[0] = 1;
+    CU_ASSERT_EQUAL(mp_perfect_power(U, 1, X), 0);
+    U[0] = 2;
+    CU_ASSERT_EQUAL(mp_perfect_power(U, 1, X), 0);
+    /* 12^10 = 2^20 * 3^10 = 144^5 = 248832^2. */
+    U[0] = 12;
+    mp_exp(U, 1, 10, X);
+    mp_copy(X, 10, U);
+    CU_ASSERT_EQUAL(mp_perfect_power(U, 10, X), 10);
+    CU_ASSERT_EQUAL(mp_rsize(X, 5), 1);
+    CU_ASSERT_EQUAL(X[0], 12);
+
+    for (unsigned k = 2; k <= 30; k++) {
+	/* A random odd X is almost certainly not a perfect power itself. */
+	mp_digit x[2];
+	mp_size xsize = (k <= 15) ? 2 : 1;
+	mp_rand(x, xsize);
+	x[0] |= 1;
+	mp_exp(x, xsize, k, U);
+	const mp_size usize = mp_rsize(U, xsize * k);
+	CU_ASSERT_EQUAL(mp_perfect_power(U, usize, X), k);
+	CU_ASSERT_TRUE(mp_cmp(X, (usize + 1) / 2, x, xsize) == 0);
+
+	/* Nor is X^k + 2. */
+	CU_ASSERT_EQUAL(mp_daddi(U, usize, 2), 0);
+	CU_ASSERT_EQUAL(mp_perfect_power(U, usize, NULL), 0);
+    }
+}
+
+void test_mp_mod_2k()
+{
+    const mp_size N = 6;
+    mp_digit U[2 * N], P[2], O[2], M[N + 3], Q[2 * N], R[N + 1], T[2 * N + 1];
+    mp_digit W1[N + 3], W2[N + 3], W3[N + 3];
+
+    for (unsigned k = 1; k <= N * MP_DIGIT_BITS; k += (k % 7) + 1) {
+	const mp_size ksize = (k + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS;
+	const mp_size msize = k / MP_DIGIT_BITS + 1;
+	const mp_digit mask = (k % MP_DIGIT_BITS) ?
+	    ((mp_digit)1 << (k % MP_DIGIT_BITS)) - 1 : MP_DIGIT_MAX;
+	for (int i = 0; i < 8; ++i) {
+	    mp_rand(U, 2 * N);
+	    if (i & 1)
+		U[0] -= U[0] & 7;	/* Divisible by 8. */
+	    mp_rand(P, 2);
+	    if (i & 2)
+		P[1] = 0;
+	    if (i & 4)
+		P[0] &= 0xff;
+
+	    /* Division by 2^K is a shift. */
+	    mp_zero(M, msize);
+	    mp_setbit(M, msize, k);
+	    mp_divrem(U, 2 * N, M, msize, Q, R);
+	    mp_mul(Q, 2 * N - msize + 1, M, msize, T);
+	    CU_ASSERT_EQUAL(mp_addi(T, 2 * N + 1, R, msize), 0);
+	    CU_ASSERT_TRUE(mp_cmp_n(T, U, 2 * N) == 0 && T[2 * N] == 0);
+	    CU_ASSERT_TRUE(mp_cmp_n(R, M, msize) < 0);
+
+	    /* U^P mod 2^K agrees with U^P mod 3 * 2^K reduced mod 2^K. */
+	    mp_modexp(U, 2 * N, P, 2, M, msize, W1);
+	    mp_mexp(U, 2 * N, P, 2, M, msize, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, msize) == 0);
+	    M[msize] = mp_dmuli(M, msize, 3);
+	    mp_modexp(U, 2 * N, P, 2, M, msize + 1, W3);
+	    W3[ksize - 1] &= mask;
+	    CU_ASSERT_TRUE(mp_cmp(W1, msize, W3, ksize) == 0);
+
+	    /* Even moduli which are not powers of two split into 2^K times an
+	     * odd part. */
+	    mp_rand(O, 2);
+	    O[0] |= 1;
+	    O[1] |= 1;
+	    mp_zero(T, msize);
+	    mp_setbit(T, msize, k);
+	    mp_mul(T, msize, O, 2, M);
+	    mp_modexp(U, 2 * N, P, 2, M, msize + 2, W1);
+	    mp_mexp(U, 2 * N, P, 2, M, msize + 2, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, msize + 2) == 0);
+
+	    /* U * U^-1 = 1 (mod 2^K). */
+	    U[0] |= 1;
+	    mp_invert_2k(U, 2 * N, k, W1);
+	    mp_mul_mod_powb(U, 2 * N, W1, ksize, W2, ksize);
+	    W2[ksize - 1] &= mask;
+	    CU_ASSERT_TRUE(mp_is_one(W2, ksize));
+	}
+    }
+}
+
+void test_mp_ddivi_preinv()
+{
+    const mp_size N = 12;
+    mp_digit U[N], Q1[N], Q2[N];
+
+    for (int i = 0; i < 2000; ++i) {
+	mp_digit d;
+	mp_rand(&d, 1);
+	switch (i % 4) {
+	    case 0: d >>= i % MP_DIGIT_BITS; break;
+	    case 1: d |= MP_DIGIT_MSB; break;
+	    case 2: d = (mp_digit)1 << (i % MP_DIGIT_BITS); break;
+	    case 3: d = MP_DIGIT_MAX - (mp_digit)(i % 3); break;
+	}
+	if (d == 0)
+	    d = 1;
+	const mp_size n = 1 + i % N;
+	mp_rand(U, n);
+
+	mp_dinv_ctx ctx;
+	mp_dinv_ctx_init(&ctx, d);
+	mp_copy(U, n, Q1);
+	mp_copy(U, n, Q2);
+	const mp_digit r1 = mp_ddivi(Q1, n, d);
+	const mp_digit r2 = mp_ddivi_preinv(Q2, n, &ctx);
+	CU_ASSERT_EQUAL(r1, r2);
+	CU_ASSERT_TRUE(mp_cmp_n(Q1, Q2, n) == 0);
+	CU_ASSERT_EQUAL(mp_dmod_preinv(U, n, &ctx), r1);
+    }
+}
+
+void test_mp_mont()
+{
+    const mp_size N = 10;
+    mp_digit M[N], U[2 * N], V[N], P[2], T[3 * N];
+    mp_digit UM[N], VM[N], W1[N], W2[N];
+
+    for (mp_size n = 1; n <= N; ++n) {
+	for (int i = 0; i < 20; ++i) {
+	    mp_rand(M, n);
+	    M[0] |= 1;
+	    if (M[n - 1] == 0)
+		M[n - 1] = 1;
+	    mp_rand(U, 2 * n);
+	    mp_rand(V, n);
+	    mp_rand(P, 2);
+
+	    mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+	    mp_mont_ctx_init(&ctx, M, n);
+	    CU_ASSERT_EQUAL(ctx.k, n);
+
+	    /* Conversion round trip reduces modulo M. */
+	    mp_mont_to(U, 2 * n, &ctx, UM);
+	    mp_mont_from(UM, &ctx, W1);
+	    mp_mod(U, 2 * n, M, n, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    /* Products agree with mp_mul followed by mp_mod. */
+	    mp_mod(V, n, M, n, W2);
+	    mp_mont_to(V, n, &ctx, VM);
+	    mp_mont_mul(UM, VM, &ctx, W1);
+	    mp_mont_from(W1, &ctx, W1);
+	    mp_mod(U, 2 * n, M, n, T);
+	    mp_mul_n(T, W2, n, T + n);
+	    mp_mod(T + n, 2 * n, M, n, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    mp_mont_sqr(VM, &ctx, W1);
+	    mp_mont_mul(VM, VM, &ctx, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    /* Exponentiation agrees with mp_modexp. */
+	    mp_mont_exp(UM, P, 2, &ctx, W1);
+	    mp_mont_from(W1, &ctx, W1);
+	    mp_modexp(U, 2 * n, P, 2, M, n, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    mp_mont_ctx_free(&ctx);
+	}
+    }
+}
+
+void test_mp_mont_mul_kernels()
+{
+    const mp_size N = 40;
+    mp_digit M[N], U[N], V[N], T[2 * N], W1[N + 2], W2[N + 2], R[N + 1];
+
+    for (mp_size n = 1; n <= N; ++n) {
+	for (int i = 0; i < 20; ++i) {
+	    mp_rand(M, n);
+	    if (i == 0)
+		mp_fill(M, n, MP_DIGIT_MAX);	/* Maximal carries. */
+	    M[0] |= 1;
+	    if (M[n - 1] == 0)
+		M[n - 1] = 1;
+	    mp_rand(U, n);
+	    mp_rand(V, n);
+	    mp_modi(U, n, M, n);
+	    mp_modi(V, n, M, n);
+	    if (i == 1) {
+		/* U = V = M - 1. */
+		mp_copy(M, n, U);
+		ASSERT(mp_dec(U, n) == 0);
+		mp_copy(U, n, V);
+	    }
+
+	    mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+	    mp_mont_ctx_init(&ctx, M, n);
+	    mp_mul_n(U, V, n, T);
+	    mp_mont_redc(T, &ctx, R);
+
+	    /* Both kernels leave U V / R mod M, plus possibly M. */
+	    mp_mont_mul_cios(U, V, M, n, ctx.m0_inv, W1);
+	    mp_mont_mul_fios(U, V, M, n, ctx.m0_inv, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n + 1) == 0);
+	    if (W1[n] || mp_cmp_n(W1, M, n) >= 0)
+		CU_ASSERT_EQUAL(mp_subi_n(W1, M, n), W1[n]);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, R, n) == 0);
+
+	    mp_mont_ctx_free(&ctx);
+	}
+    }
+}
+
+void test_mp_barrett()
+{
+    const mp_size N = 12, P = 24;
+    mp_digit M[N], U[2 * N], E[P], W1[N], W2[N];
+
+    for (mp_size n = 1; n <= N; ++n) {
+	for (int i = 0; i < 10; ++i) {
+	    mp_rand(M, n);
+	    if (M[n - 1] == 0)
+		M[n - 1] = 1;
+	    mp_rand(U, 2 * n);
+	    if (i == 0) {
+		/* U = M + 3 reduces to a single digit base. */
+		mp_zero(U, 2 * n);
+		mp_copy(M, n, U);
+		mp_daddi(U, 2 * n, 3);
+	    }
+
+	    mp_barrett_ctx ctx = MP_BARRETT_CTX_INITIALIZER;
+	    mp_barrett_ctx_init(&ctx, M, n);
+	    /* Exponents of increasing size with the same base extend the cached
+	     * powers; decreasing sizes reuse them. */
+	    for (mp_size p = 1; p <= P; p += 5) {
+		mp_rand(E, p);
+		mp_barrett(U, 2 * n, E, p, &ctx, W1);
+		mp_modexp(U, 2 * n, E, p, M, n, W2);
+		CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+	    }
+	    mp_rand(E, 1);
+	    mp_barrett(U, 2 * n, E, 1, &ctx, W1);
+	    mp_modexp(U, 2 * n, E, 1, M, n, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    const uint64_t e = ((uint64_t)E[0] << 17) ^ 0x123456789abcdefULL;
+	    mp_barrett_u64(U, 2 * n, e, &ctx, W1);
+	    mp_modexp_u64(U, 2 * n, e, M, n, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    /* A base divisible by M, and a zero exponent. */
+	    mp_barrett(M, n, E, 1, &ctx, W1);
+	    CU_ASSERT_TRUE(mp_is_zero(W1, n));
+	    mp_barrett_u64(U, 2 * n, 0, &ctx, W1);
+	    mp_modexp_u64(U, 2 * n, 0, M, n, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    mp_barrett_ctx_free(&ctx);
+	}
+    }
+}
+
+void test_mp_modexp_u64()
+{
+    const mp_size N = 20, B = 5;
+    const mp_size P = (64 + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS;
+    mp_digit M[N], U[B][2 * N], E[P], W1[N], W2[N], W[B][N];
+    const mp_digit *bases[B];
+    mp_size usizes[B];
+    mp_digit *results[B];
+
+    for (mp_size n = 1; n <= N; ++n) {
+	for (int odd = 0; odd <= 1; ++odd) {
+	    mp_rand(M, n);
+	    M[0] = odd ? (M[0] | 1) : (M[0] & ~(mp_digit)1);
+	    if (M[n - 1] == 0)
+		M[n - 1] = 1;
+	    for (mp_size b = 0; b < B; ++b) {
+		usizes[b] = (b * 2 * n) / (B - 1);	/* 0 .. 2n digits */
+		mp_rand(U[b], 2 * N);
+		bases[b] = U[b];
+		results[b] = W[b];
+	    }
+
+	    mp_barrett_ctx bctx = MP_BARRETT_CTX_INITIALIZER;
+	    mp_barrett_ctx_init(&bctx, M, n);
+	    mp_rand(E, P);
+	    uint64_t exps[] = { 3, 17, 65537, ((uint64_t)1 << 32) + 1, 0 };
+	    for (mp_size j = P; j-- > 0; )
+		exps[4] = (exps[4] << (MP_DIGIT_BITS - 1) << 1) | E[j];
+	    for (unsigned j = 0; j < sizeof(exps) / sizeof(exps[0]); ++j) {
+		const uint64_t e = exps[j];
+		uint64_t t = e;
+		for (mp_size d = 0; d < P; ++d) {
+		    E[d] = (mp_digit)t;
+		    t = t >> (MP_DIGIT_BITS - 1) >> 1;
+		}
+		mp_modexp(U[B - 1], 2 * n, E, P, M, n, W1);
+		mp_modexp_u64(U[B - 1], 2 * n, e, M, n, W2);
+		CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+		mp_barrett_u64(U[B - 1], 2 * n, e, &bctx, W2);
+		CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+		if (odd) {
+		    mp_mont_ctx ctx = MP_MONT_CTX_INITIALIZER;
+		    mp_mont_ctx_init(&ctx, M, n);
+		    mp_mont_to(U[B - 1], 2 * n, &ctx, W1);
+		    mp_mont_exp_u64(W1, e, &ctx, W2);
+		    mp_mont_exp(W1, E, P, &ctx, W1);
+		    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+		    mp_mont_ctx_free(&ctx);
+		}
+
+		mp_modexp_u64_batch(bases, usizes, B, e, M, n, results);
+		for (mp_size b = 0; b < B; ++b) {
+		    mp_modexp_u64(U[b], usizes[b], e, M, n, W1);
+		    CU_ASSERT_TRUE(mp_cmp_n(W1, W[b], n) == 0);
+		}
+	    }
+	    mp_barrett_ctx_free(&bctx);
+	}
+    }
+}
+
+void test_mp_fixedbase()
+{
+    const mp_size N = 8, X = (512 + 40 + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS;
+    mp_digit M[N], G[N + 1], E[X], W1[N], W2[N];
+    const unsigned max_bits[] = { 1, 7, 33, 200, 512 };
+
+    for (mp_size n = 1; n <= N; ++n) {
+	for (unsigned b = 0; b < sizeof(max_bits) / sizeof(max_bits[0]); ++b) {
+	    mp_rand(M, n);
+	    M[0] |= 1;
+	    if (M[n - 1] == 0)
+		M[n - 1] = 1;
+	    mp_rand(G, n + 1);
+
+	    mp_fixedbase_ctx ctx = MP_FIXEDBASE_CTX_INITIALIZER;
+	    mp_fixedbase_ctx_init(&ctx, G, n + 1, M, n, max_bits[b]);
+	    for (int i = 0; i < 10; ++i) {
+		/* Exponents that fit the table, and some that do not. */
+		const unsigned bits = (i < 8) ? max_bits[b] : max_bits[b] + 40;
+		const mp_size xsize = (bits + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS;
+		mp_rand(E, xsize);
+		if (bits % MP_DIGIT_BITS)
+		    E[xsize - 1] &= ((mp_digit)1 << (bits % MP_DIGIT_BITS)) - 1;
+		if (i == 0)
+		    mp_zero(E, xsize);
+		mp_fixedbase_exp(E, xsize, &ctx, W1);
+		mp_modexp(G, n + 1, E, xsize, M, n, W2);
+		CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+	    }
+	    mp_fixedbase_ctx_free(&ctx);
+	}
+    }
+}
+
+void test_mp_multi_exp()
+{
+    const mp_size N = 8, K = 5;
+    mp_digit M[N], B[K][N + 1], E[K][N], W1[N], W2[N], P[N], T[2 * N];
+    const mp_digit *bases[K], *exps[K];
+    mp_size bsizes[K], esizes[K];
+
+    for (mp_size n = 1; n <= N; ++n) {
+	for (unsigned k = 0; k <= K; ++k) {
+	    mp_rand(M, n);
+	    if (k & 1) {
+		M[0] |= 1;
+	    } else if (k == 2) {
+		M[0] = 0;		/* Even, by a whole digit if n > 1. */
+	    } else if (k == 4) {
+		mp_zero(M, n);		/* Power of two. */
+		M[n - 1] = MP_DIGIT_MSB >> (n % 3);
+	    }
+	    if (M[n - 1] == 0)
+		M[n - 1] = 1;
+	    for (unsigned i = 0; i < k; ++i) {
+		mp_rand(B[i], n + 1);
+		B[i][n] |= 1;
+		bsizes[i] = n + 1;
+		esizes[i] = 1 + (i * 3 + n) % n;
+		mp_rand(E[i], esizes[i]);
+		if (i == 2)
+		    mp_zero(E[i], esizes[i]);
+		bases[i] = B[i];
+		exps[i] = E[i];
+	    }
+	    mp_multi_exp(bases, bsizes, exps, esizes, k, M, n, W1);
+
+	    /* Compare with the product of separate powers. */
+	    mp_zero(W2, n);
+	    W2[0] = 1;
+	    if (n == 1 && M[0] == 1)
+		W2[0] = 0;
+	    for (unsigned i = 0; i < k; ++i) {
+		mp_modexp(B[i], n + 1, E[i], esizes[i], M, n, P);
+		mp_mul_n(W2, P, n, T);
+		mp_mod(T, 2 * n, M, n, W2);
+	    }
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+	}
+    }
+}
+
+void test_mp_powm()
+{
+    const mp_size N = 20, P = (2000 + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS;
+    mp_digit M[N], U[N], E[P], W1[N], W2[N];
+    const unsigned exp_bits[] = { 1, 2, 5, 17, 64, 300, 2000 };
+
+    for (mp_size n = 1; n <= N; n += 3) {
+	for (int i = 0; i < 6; ++i) {
+	    mp_rand(M, n);
+	    if (i & 1)
+		M[0] |= 1;
+	    if (i == 4) {
+		mp_zero(M, n);
+		M[n - 1] = MP_DIGIT_MSB;	/* Power of two. */
+	    }
+	    if (M[n - 1] == 0)
+		M[n - 1] = 1;
+	    mp_rand(U, n);
+	    const mp_size usize = (i < 2) ? 1 : n;
+	    for (unsigned j = 0; j < sizeof(exp_bits) / sizeof(exp_bits[0]); ++j) {
+		const mp_size psize = (exp_bits[j] + MP_DIGIT_BITS - 1) /
+				      MP_DIGIT_BITS;
+		mp_rand(E, psize);
+		const unsigned top = (exp_bits[j] - 1) % MP_DIGIT_BITS;
+		E[psize - 1] &= ((mp_digit)2 << top) - 1;
+		E[psize - 1] |= (mp_digit)1 << top;
+		mp_powm(U, usize, E, psize, M, n, W1);
+		mp_modexp(U, usize, E, psize, M, n, W2);
+		CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+	    }
+	}
+    }
+}
+
+void test_mpi_modexp()
+{
+    mpi_t a = MPI_INITIALIZER, p = MPI_INITIALIZER, m = MPI_INITIALIZER;
+    mpi_t r = MPI_INITIALIZER, s = MPI_INITIALIZER;
+
+    for (unsigned bits = 2; bits <= 400; bits += 23) {
+	mpi_rand(m, bits);
+	mpi_rand(a, bits + 10);
+	if (bits & 2)
+	    mpi_neg(a);
+	/* Compare with repeated multiplication. */
+	for (uint32_t e = 0; e < 12; ++e) {
+	    mpi_modexp_u32(a, e, m, r);
+	    CU_ASSERT_TRUE(mpi_cmp(r, m) < 0);
+	    CU_ASSERT_FALSE(r->sign);
+	    mpi_set_u32(s, 1);
+	    for (uint32_t k = 0; k < e; ++k)
+		mpi_mul(s, a, s);
+	    if (s->sign) {
+		/* The residue of a negative power is M minus that of |A|^e. */
+		s->sign = 0;
+		mpi_mod(s, m, s);
+		if (!mpi_is_zero(s))
+		    mpi_sub(m, s, s);
+	    } else {
+		mpi_mod(s, m, s);
+	    }
+	    if (mpi_is_one(m) || (e == 0 && mpi_is_zero(a)))
+		mpi_zero(s);
+	    CU_ASSERT_EQUAL(mpi_cmp(r, s), 0);
+	}
+	/* Large exponents, with R aliasing A. */
+	mpi_rand(p, 3 * bits);
+	a->sign = 0;
+	mpi_modexp(a, p, m, r);
+	mpi_modexp(a, p, m, a);
+	CU_ASSERT_EQUAL(mpi_cmp(r, a), 0);
+    }
+    mpi_free(a);
+    mpi_free(p);
+    mpi_free(m);
+    mpi_free(r);
+    mpi_free(s);
+}
+
+void test_mp_mod_ctx()
+{
+    const mp_size N = 12, C = 8;
+    mp_digit M[N], X[N], A[C][N], E[2], W1[N], W2[N], T[N], Y[N];
+
+    for (mp_size n = 1; n <= N; ++n) {
+	for (int i = 0; i < 6; ++i) {
+	    mp_rand(M, n);
+	    if (i & 1)
+		M[0] |= 1;
+	    if (M[n - 1] == 0)
+		M[n - 1] = 1;
+	    mp_rand(X, n);
+	    mp_modi(X, n, M, n);
+	    for (mp_size j = 0; j < C; ++j) {
+		mp_rand(A[j], n);
+		mp_modi(A[j], n, M, n);
+	    }
+
+	    mp_mod_ctx ctx = MP_MOD_CTX_INITIALIZER;
+	    mp_mod_ctx_init(&ctx, M, n);
+	    CU_ASSERT_EQUAL(ctx.kind, (M[0] & 1) ? MP_MOD_CTX_MONT
+						 : MP_MOD_CTX_BARRETT);
+
+	    /* Horner evaluation of sum A[j] X^j, with and without a context. */
+	    mp_copy(A[C - 1], n, W1);
+	    mp_mod_ctx_to(X, n, &ctx, Y);
+	    mp_mod_ctx_to(A[C - 1], n, &ctx, W2);
+	    for (mp_size j = C - 1; j-- > 0; ) {
+		mp_modmul(W1, X, M, n, T);
+		mp_modadd(T, A[j], M, n, W1);
+		mp_modmul_ctx(W2, Y, &ctx, W2);
+		mp_mod_ctx_to(A[j], n, &ctx, T);
+		mp_modadd(W2, T, M, n, W2);
+	    }
+	    mp_mod_ctx_from(W2, &ctx, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    mp_modsqr(X, M, n, W1);
+	    mp_modsqr_ctx(Y, &ctx, W2);
+	    mp_mod_ctx_from(W2, &ctx, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    mp_rand(E, 2);
+	    mp_modexp(X, n, E, 2, M, n, W1);
+	    mp_modexp_ctx(Y, E, 2, &ctx, W2);
+	    mp_mod_ctx_from(W2, &ctx, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+
+	    mp_mod_ctx_free(&ctx);
+	}
+    }
+}
+
+void test_mp_special()
+{
+    /* M = 2^bits - C, C = sum of sign(t) * 2^(|t| - 1) over the terms T. */
+    static const struct { unsigned bits; int terms[5]; } forms[] = {
+	{ 127, { 1 } },				/* Mersenne */
+	{ 130, { 3, 1 } },			/* Poly1305 */
+	{ 255, { 5, 2, 1 } },			/* Curve25519 */
+	{ 192, { 65, 1 } },			/* NIST P-192 */
+	{ 224, { 97, -1 } },			/* NIST P-224 */
+	{ 256, { 33, 11, -7, 5, 1 } },		/* secp256k1 */
+	{ 384, { 129, 97, -33, 1 } },		/* NIST P-384 */
+	{ 521, { 1 } },				/* NIST P-521 */
+    };
+    const mp_size N = 576 / MP_DIGIT_BITS;
+    mp_digit M[N + 1], X[3 * N], E[2], U[N], W1[N], W2[N], T[2 * N];
+
+    for (unsigned f = 0; f < 2 * sizeof(forms) / sizeof(forms[0]); ++f) {
+	mp_size n;
+	if (f < sizeof(forms) / sizeof(forms[0])) {
+	    const unsigned bits = forms[f].bits;
+	    n = (bits + MP_DIGIT_BITS - 1) / MP_DIGIT_BITS;
+	    mp_zero(M, N + 1);
+	    M[bits / MP_DIGIT_BITS] = (mp_digit)1 << (bits % MP_DIGIT_BITS);
+	    for (unsigned j = 0; j < 5 && forms[f].terms[j] != 0; ++j) {
+		const int t = forms[f].terms[j];
+		const unsigned e = (unsigned)(t > 0 ? t : -t) - 1;
+		const mp_digit bit = (mp_digit)1 << (e % MP_DIGIT_BITS);
+		if (t > 0)
+		    mp_dsubi(M + e / MP_DIGIT_BITS, N + 1 - e / MP_DIGIT_BITS, bit);
+		else
+		    mp_daddi(M + e / MP_DIGIT_BITS, N + 1 - e / MP_DIGIT_BITS, bit);
+	    }
+	} else {
+	    /* B^n - c for a random digit c, odd or even. */
+	    n = 2 + f % (N - 1);
+	    mp_zero(M, n);
+	    mp_digit c;
+	    mp_rand(&c, 1);
+	    mp_dsubi(M, n, (f & 1) ? (c | 1) : ((c | 2) & ~(mp_digit)1));
+	}
+
+	mp_special_mod_ctx sctx = MP_SPECIAL_MOD_CTX_INITIALIZER;
+	CU_ASSERT_TRUE(mp_special_mod_ctx_init(&sctx, M, n));
+	CU_ASSERT_EQUAL(sctx.k, n);
+
+	for (mp_size xsize = 1; xsize <= 3 * n; ++xsize) {
+	    mp_rand(X, xsize);
+	    mp_mod(X, xsize, M, n, W1);
+	    mp_special_reduce(X, xsize, &sctx, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+	}
+	/* M itself, and (M - 1)^2, the largest product of two residues. */
+	mp_special_reduce(M, n, &sctx, W2);
+	CU_ASSERT_TRUE(mp_is_zero(W2, n));
+	mp_copy(M, n, U);
+	mp_dec(U, n);
+	mp_sqr(U, n, T);
+	mp_mod(T, 2 * n, M, n, W1);
+	mp_special_reduce(T, 2 * n, &sctx, T);
+	CU_ASSERT_TRUE(mp_cmp_n(W1, T, n) == 0);
+
+	for (int i = 0; i < 4; ++i) {
+	    mp_size usize = n;
+	    mp_rand(U, n);
+	    if (i == 0) {
+		U[0] = 2;
+		usize = 1;
+	    }
+	    mp_rand(E, 2);
+	    mp_modexp(U, usize, E, 2, M, n, W1);
+	    mp_special_exp(U, usize, E, 2, &sctx, W2);
+	    CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+	}
+	mp_special_mod_ctx_free(&sctx);
+
+	mp_mod_ctx ctx = MP_MOD_CTX_INITIALIZER;
+	mp_mod_ctx_init(&ctx, M, n);
+	CU_ASSERT_EQUAL(ctx.kind == MP_MOD_CTX_SPECIAL,
+			(M[0] & 1) == 0 || n >= SPECIAL_MOD_THRESHOLD);
+	mp_rand(U, n);
+	mp_modi(U, n, M, n);
+	mp_rand(X, n);
+	mp_modi(X, n, M, n);
+	mp_modmul(U, X, M, n, W1);
+	mp_mod_ctx_to(U, n, &ctx, T);
+	mp_mod_ctx_to(X, n, &ctx, W2);
+	mp_modmul_ctx(T, W2, &ctx, W2);
+	mp_mod_ctx_from(W2, &ctx, W2);
+	CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+	mp_powm(U, n, E, 2, M, n, W2);
+	mp_modexp(U, n, E, 2, M, n, W1);
+	CU_ASSERT_TRUE(mp_cmp_n(W1, W2, n) == 0);
+	mp_mod_ctx_free(&ctx);
+    }
+
+    /* Random moduli have no such form. */
+    mp_special_mod_ctx sctx = MP_SPECIAL_MOD_CTX_INITIALIZER;
+    mp_rand(M, N);
+    M[N - 1] |= MP_DIGIT_MSB;
+    CU_ASSERT_FALSE(mp_special_mod_ctx_init(&sctx, M, N));
+    M[0] = 7;
+    CU_ASSERT_FALSE(mp_special_mod_ctx_init(&sctx, M, 1));
+}
+
+void test_mpi_modinv_batch()
+{
+    enum { N = 17 };
+    mpi_t m = MPI_INITIALIZER, t = MPI_INITIALIZER, a[N], b[N];
+    const mpi *in[N];
+    mpi *out[N];
+
+    for (unsigned i = 0; i < N; ++i) {
+	mpi_init(a[i]);
+	mpi_init(b[i]);
+	in[i] = a[i];
+	out[i] = b[i];
+    }
+    /* Odd moduli use Montgomery products, even ones Barrett reduction, and
+     * 2^521 - 1 the special-form reduction. */
+    for (unsigned bits = 8; bits <= 640; bits += 79) {
+	for (int kind = 0; kind < 3; ++kind) {
+	    if (kind == 2) {
+		mpi_set_u32(m, 1);
+		mpi_lshift(m, 521, m);
+		mpi_dec(m);
+	    } else {
+		mpi_rand(m, bits);
+		m->digits[0] = kind ? (m->digits[0] | 1)
+				    : (m->digits[0] & ~(mp_digit)1);
+		MPI_NORMALIZE(m);
+	    }
+	    for (unsigned n = 1; n <= N; n += 4) {
+		/* Inputs coprime to M, so the batch takes the fast path. */
+		for (unsigned i = 0; i < n; ++i) {
+		    do {
+			mpi_rand(a[i], bits);
+			mpi_mod(a[i], m, a[i]);
+			mpi_gcd(a[i], m, t);
+		    } while (!mpi_is_one(t));
+		}
+		CU_ASSERT_EQUAL(mpi_modinv_batch(m, in, out, n), 1);
+		for (unsigned i = 0; i < n; ++i) {
+		    mpi_mul(a[i], b[i], t);
+		    mpi_mod(t, m, t);
+		    CU_ASSERT_TRUE(mpi_is_one(t));
+		}
+		/* In place: inverting again gives back the inputs. */
+		CU_ASSERT_EQUAL(mpi_modinv_batch(m, (const mpi *const *)out, out,
+						 n), 1);
+		for (unsigned i = 0; i < n; ++i)
+		    CU_ASSERT_EQUAL(mpi_cmp(a[i], b[i]), 0);
+	    }
+	    /* A zero among the inputs: the others are still inverted. */
+	    mpi_zero(a[N / 2]);
+	    CU_ASSERT_EQUAL(mpi_modinv_batch(m, in, out, N), 0);
+	    CU_ASSERT_TRUE(mpi_is_zero(b[N / 2]));
+	    for (unsigned i = 0; i < N; ++i) {
+		if (i == N / 2)
+		    continue;
+		mpi_mul(a[i], b[i], t);
+		mpi_mod(t, m, t);
+		CU_ASSERT_TRUE(mpi_is_one(t));
+	    }
+	}
+    }
+    for (unsigned i = 0; i < N; ++i) {
+	mpi_free(a[i]);
+	mpi_free(b[i]);
+    }
+    mpi_free(m);
+    mpi_free(t);
+}
+
+void test_mpi_gcdext()
+{
+    mpi_t a, b, g, u, v, t, t2;
+    mpi_init(a);
+    mpi_init(b);
+    mpi_init(g);
+    mpi_init(u);
+    mpi_init(v);
+    mpi_init(t);
+    mpi_init(t2);
+
+    /* Bezout certificates, below and above GCDEXT_LEHMER_THRESHOLD digits, and
+     * the bounds |U| <= B/G and |V| <= A/G of the Euclidean cofactors. */
+    const unsigned max_bits = GCDEXT_LEHMER_THRESHOLD * 4 * MP_DIGIT_BITS;
+    for (unsigned bits = 64; bits <= max_bits; bits += max_bits / 9) {
+	for (unsigned gbits = 1; gbits < bits; gbits += bits / 3 + 1) {
+	    mpi_rand(g, gbits);
+	    mpi_rand(a, bits);
+	    mpi_rand(b, bits - bits / 5);
+	    mpi_mul(a, g, a);
+	    mpi_mul(b, g, b);
+	    for (int swap = 0; swap < 2; ++swap) {
+		mpi_gcdext(a, b, u, v, g);
+		mpi_mul(a, u, t);
+		mpi_mul(b, v, t2);
+		mpi_add(t, t2, t);
+		CU_ASSERT(mpi_cmp_eq(t, g));
+		mpi_mod(a, g, t);
+		CU_ASSERT(mpi_is_zero(t));
+		mpi_mod(b, g, t);
+		CU_ASSERT(mpi_is_zero(t));
+		mpi_div(b, g, t);
+		mpi_abs(u);
+		CU_ASSERT(mpi_cmp_le(u, t));
+		mpi_div(a, g, t);
+		mpi_abs(v);
+		CU_ASSERT(mpi_cmp_le(v, t));
+		mpi_gcd(a, b, t);
+		CU_ASSERT(mpi_cmp_eq(t, g));
+		mpi_swap(a, b);
+	    }
+	}
+    }
+    /* GCD(A, A) = A */
+    mpi_gcdext(a, a, u, v, g);
+    CU_ASSERT(mpi_cmp_eq(g, a));
+
+    mpi_free(a);
+    mpi_free(b);
+    mpi_free(g);
+    mpi_free(u);
+    mpi_free(v);
+    mpi_free(t);
+    mpi_free(t2);
+}
+
+void test_mpi_batch_gcd()
+{
+    enum { N = 23, NPRIMES = 40 };
+    mpi_t primes[NPRIMES], moduli[N], gcds[N], t, g;
+    const mpi *in[N];
+    mpi *out[N];
+
+    for (unsigned i = 0; i < NPRIMES; ++i) {
+	mpi_init(primes[i]);
+	mpi_rand(primes[i], 64 + 7 * i);
+	primes[i]->digits[0] |= 1;
+    }
+    mpi_init(t);
+    mpi_init(g);
+    for (unsigned i = 0; i < N; ++i) {
+	mpi_init(moduli[i]);
+	mpi_init(gcds[i]);
+	in[i] = moduli[i];
+	out[i] = gcds[i];
+    }
+
+    for (unsigned n = 0; n <= N; ++n) {
+	/* Moduli made of two random factors each, some of them shared, and
+	 * for the last one a repeat of the first. */
+	for (unsigned i = 0; i < n; ++i) {
+	    const unsigned p = (i * 7) % NPRIMES, q = (i * 11 + 3) % NPRIMES;
+	    if (i > 0 && i + 1 == n && n > 3)
+		mpi_set_mpi(moduli[i], moduli[0]);
+	    else
+		mpi_mul(primes[p], primes[q], moduli[i]);
+	}
+
+	/* The whole tree, then batches of 1, 2 and 5 moduli. */
+	for (unsigned batch = 0; batch <= 5; batch += batch + 1) {
+	    if (batch == 0)
+		mpi_batch_gcd(in, n, out);
+	    else
+		mpi_batch_gcd_chunked(in, n, batch, out);
+
+	    for (unsigned i = 0; i < n; ++i) {
+		mpi_set_u32(t, 1);
+		for (unsigned j = 0; j < n; ++j) {
+		    if (j != i)
+			mpi_mul(t, moduli[j], t);
+		}
+		mpi_gcd(moduli[i], t, g);
+		CU_ASSERT(mpi_cmp_eq(gcds[i], g));
+	    }
+	}
+    }
+
+    for (unsigned i = 0; i < NPRIMES; ++i)
+	mpi_free(primes[i]);
+    for (unsigned i = 0; i < N; ++i) {
+	mpi_free(moduli[i]);
+	mpi_free(gcds[i]);
+    }
+    mpi_free(t);
+    mpi_free(g);
+}
+
+void test_mpi_prodtree()
+{
+    enum { N = 37 };
+    mpi_t leaves[N], rems[N], x, t, r;
+    const mpi *in[N];
+    mpi *out[N];
+
+    for (unsigned i = 0; i < N; ++i) {
+	mpi_init(leaves[i]);
+	mpi_init(rems[i]);
+	/* Leaves from a word up to well past BARRETT_NEWTON_THRESHOLD. */
+	mpi_rand(leaves[i], 1 + (i * 997) % (MP_DIGIT_BITS * 60));
+	if (mpi_is_zero(leaves[i]))
+	    mpi_set_u32(leaves[i], 1);
+	in[i] = leaves[i];
+	out[i] = rems[i];
+    }
+    mpi_init(x);
+    mpi_init(t);
+    mpi_init(r);
+
+    for (unsigned n = 1; n <= N; ++n) {
+	mpi_prodtree tree = MPI_PRODTREE_INITIALIZER;
+	mpi_prodtree_init(&tree, in, n);
+	mpi_set_u32(t, 1);
+	for (unsigned i = 0; i < n; ++i)
+	    mpi_mul(t, leaves[i], t);
+	CU_ASSERT(mpi_cmp_eq(mpi_prodtree_root(&tree), t));
+	mpi_product(in, n, x);
+	CU_ASSERT(mpi_cmp_eq(x, t));
+
+	/* Below the root, past it, and past its square; the second and third
+	 * pass reuse the contexts of the first. */
+	for (unsigned k = 0; k < 3; ++k) {
+	    mpi_rand(x, mpi_significant_bits(t) * (2 * k + 1) / 2 + 1);
+	    mpi_remtree(&tree, x, out);
+	    for (unsigned i = 0; i < n; ++i) {
+		mpi_mod(x, leaves[i], r);
+		CU_ASSERT(mpi_cmp_eq(rems[i], r));
+	    }
+	    mpi_remtree_sqr(&tree, x, out);
+	    for (unsigned i = 0; i < n; ++i) {
+		mpi_sqr(leaves[i], t);
+		mpi_mod(x, t, r);
+		CU_ASSERT(mpi_cmp_eq(rems[i], r));
+	    }
+	    mpi_set_mpi(t, mpi_prodtree_root(&tree));
+	}
+	mpi_prodtree_free(&tree);
+    }
+
+    mpi_product(in, 0, x);
+    CU_ASSERT(mpi_is_one(x));
+    for (uint64_t lo = 0; lo < 40; lo += 7) {
+	for (uint64_t hi = 0; hi < 400; hi += 37) {
+	    mpi_set_u32(t, 1);
+	    for (uint64_t i = lo; i <= hi; ++i)
+		mpi_mul_u64(t, i, t);
+	    mpi_product_range(lo, hi, x);
+	    CU_ASSERT(mpi_cmp_eq(x, t));
+	}
+    }
+    mpi_product_range(UINT64_MAX - 2, UINT64_MAX, x);
+    mpi_set_u64(t, UINT64_MAX);
+    mpi_mul_u64(t, UINT64_MAX - 1, t);
+    mpi_mul_u64(t, UINT64_MAX - 2, t);
+    CU_ASSERT(mpi_cmp_eq(x, t));
+
+    for (unsigned i = 0; i < N; ++i) {
+	mpi_free(leaves[i]);
+	mpi_free(rems[i]);
+    }
+    mpi_free(x);
+    mpi_free(t);
+    mpi_free(r);
+}
+
+void test_mpi_crt_plan()
+{
+    enum { N = 29 };
+    mpi_t moduli[N], residues[N], x, y, r;
+    const mpi *in[N], *res[N];
+
+    /* Pairwise coprime, of up to a dozen digits. */
+    for (unsigned i = 0; i < N; ++i) {
+	mpi_init(moduli[i]);
+	mpi_init(residues[i]);
+	for (bool coprime = false; !coprime; ) {
+	    mpi_rand(moduli[i], 8 + (i * 1237) % (MP_DIGIT_BITS * 12));
+	    moduli[i]->digits[0] |= 1;
+	    coprime = true;
+	    for (unsigned j = 0; j < i && coprime; ++j)
+		coprime = mpi_coprime(moduli[i], moduli[j]);
+	}
+	in[i] = moduli[i];
+	res[i] = residues[i];
+    }
+    mpi_init(x);
+    mpi_init(y);
+    mpi_init(r);
+
+    for (unsigned n = 1; n <= N; ++n) {
+	mpi_crt_plan plan = MPI_CRT_PLAN_INITIALIZER;
+	CU_ASSERT_EQUAL(mpi_crt_plan_init(&plan, in, n), 0);
+	/* Residues below the moduli, checked against mpi_crt_step(). */
+	for (unsigned k = 0; k < 3; ++k) {
+	    mpi_crt_ctx ctx;
+	    mpi_crt_init(&ctx);
+	    for (unsigned i = 0; i < n; ++i) {
+		mpi_rand(residues[i], mpi_significant_bits(moduli[i]));
+		mpi_mod(residues[i], moduli[i], residues[i]);
+		CU_ASSERT_EQUAL(mpi_crt_step(&ctx, residues[i], moduli[i]), 0);
+	    }
+	    CU_ASSERT_EQUAL(mpi_crt_finish(&ctx, y), 0);
+	    mpi_crt_plan_solve(&plan, res, x);
+	    CU_ASSERT(mpi_cmp_eq(x, y));
+	}
+
+	/* Residues of either sign and past the moduli. */
+	for (unsigned i = 0; i < n; ++i) {
+	    mpi_rand(residues[i], mpi_significant_bits(moduli[i]) + 4);
+	    if (i % 2)
+		mpi_neg(residues[i]);
+	}
+	mpi_crt_plan_solve(&plan, res, x);
+	CU_ASSERT(!mpi_is_neg(x));
+	CU_ASSERT(mpi_cmp(x, mpi_prodtree_root(&plan.tree)) < 0);
+	for (unsigned i = 0; i < n; ++i) {
+	    mpi_sub(x, residues[i], r);
+	    mpi_abs(r);
+	    mpi_mod(r, moduli[i], r);
+	    CU_ASSERT(mpi_is_zero(r));
+	}
+	mpi_crt_plan_free(&plan);
+    }
+
+    /* A repeated modulus. */
+    mpi_crt_plan plan = MPI_CRT_PLAN_INITIALIZER;
+    in[N - 1] = moduli[0];
+    CU_ASSERT_EQUAL(mpi_crt_plan_init(&plan, in, N), -1);
+
+    for (unsigned i = 0; i < N; ++i) {
+	mpi_free(moduli[i]);
+	mpi_free(residues[i]);
+    }
+    mpi_free(x);
+    mpi_free(y);
+    mpi_free(r);
+}
+
+void test_mpi_modsqrt()
+{
+    /* Every residue modulo the small primes that fit in one digit, squares or
+     * not. */
+    const unsigned limit = (MP_DIGIT_MAX < 400) ? MP_DIGIT_MAX + 1 : 400;
+    for (unsigned q = 3; q < limit; q += 2) {
+	unsigned d = 3;
+	while (q % d != 0)
+	    d += 2;
+	if (d != q)
+	    continue;
+	const mp_digit p = q;
+	bool square[400] = { true };
+	for (unsigned x = 1; x < q; ++x)
+	    square[x * x % q] = true;
+	for (unsigned i = 0; i < q; ++i) {
+	    const mp_digit a = i;
+	    mp_digit r = p;
+	    CU_ASSERT_EQUAL(mp_modsqrt(&a, 1, &p, 1, &r), square[i]);
+	    if (square[i])
+		CU_ASSERT_EQUAL((unsigned)r * r % q, i);
+	}
+    }
+
+    /* Random primes of each class mod 8, and 1 mod 2^40 for long runs of
+     * Tonelli-Shanks. */
+    mpi_t p = MPI_INITIALIZER, a = MPI_INITIALIZER, r = MPI_INITIALIZER;
+    mpi_t t = MPI_INITIALIZER;
+    for (unsigned bits = 48; bits <= 600; bits += 138) {
+	for (unsigned c = 1; c <= 9; c += 2) {
+	    do {
+		mpi_rand(p, bits);
+		if (c == 9) {
+		    mpi_rshift(p, 40, p);
+		    mpi_lshift(p, 40, p);
+		    mpi_inc(p);
+		} else {
+		    p->digits[0] = (p->digits[0] & ~(mp_digit)7) | c;
+		}
+	    } while (mpi_is_one(p) || mp_composite(p->digits, p->size, 20));
+
+	    int seen = 0;
+	    for (int i = 0; i < 40; ++i) {
+		mpi_rand(a, bits + 7);
+		if (i < 8) {
+		    /* A square. */
+		    mpi_sqr(a, t);
+		    mpi_mod(t, p, a);
+		}
+		if (i % 4 == 3)
+		    mpi_neg(a);
+		const int ok = mpi_modsqrt(a, p, r);
+		seen |= 1 << ok;
+		if (i < 8 && i % 4 != 3)
+		    CU_ASSERT_EQUAL(ok, 1);
+		/* R^2 - A = 0 (mod P), for A of either sign. */
+		if (ok) {
+		    CU_ASSERT(!mpi_is_neg(r) && mpi_cmp(r, p) < 0);
+		    mpi_sqr(r, t);
+		    mpi_sub(t, a, t);
+		    mpi_abs(t);
+		    mpi_mod(t, p, t);
+		    CU_ASSERT(mpi_is_zero(t));
+		}
+	    }
+	    CU_ASSERT_EQUAL(seen, 3);
+	}
+    }
+
+    /* P = 2^255 + 1073 = 1 (mod 8), a whole number of digits long for every
+     * digit size. */
+    mpi_set_u32(p, 1);
+    mpi_lshift(p, 255, p);
+    mpi_add_u32(p, 1073, p);
+    for (uint32_t x = 2; x < 20; ++x) {
+	mpi_set_u32(a, x * x);
+	CU_ASSERT_EQUAL(mpi_modsqrt(a, p, r), 1);
+	mpi_sqr(r, t);
+	mpi_mod(t, p, t);
+	CU_ASSERT_EQUAL(mpi_cmp(t, a), 0);
+    }
+
+    mpi_zero(a);
+    CU_ASSERT_EQUAL(mpi_modsqrt(a, p, r), 1);
+    CU_ASSERT(mpi_is_zero(r));
+    mpi_free(p);
+    mpi_free(a);
+    mpi_free(r);
+    mpi_free(t);
+}
+
+void test_mpi_divrem_u32()
+{
+    mpi_t a = MPI_INITIALIZER, q = MPI_INITIALIZER, r = MPI_INITIALIZER;
+    mpi_t b = MPI_INITIALIZER, t = MPI_INITIALIZER;
+    const uint32_t divisors[] = { 1, 2, 3, 10, 255, 65536, 1000000007,
+				  0x80000000U, 0xffffffffU };
+
+    for (unsigned i = 0; i < sizeof(divisors) / sizeof(divisors[0]); ++i) {
+	for (unsigned bits = 1; bits <= 600; bits += 37) {
+	    mpi_rand(a, bits);
+	    if (bits & 2)
+		mpi_neg(a);
+	    mpi_divrem_u32(a, divisors[i], q, r);
+	    /* A = Q * B + R, with |R| < B and R having the sign of A. */
+	    mpi_set_u32(b, divisors[i]);
+	    CU_ASSERT_TRUE(mpi_cmp_u32(r, divisors[i]) < 0);
+	    CU_ASSERT_TRUE(mpi_is_zero(r) || r->sign == a->sign);
+	    mpi_mul(q, b, t);
+	    mpi_add(t, r, t);
+	    CU_ASSERT_EQUAL(mpi_cmp(t, a), 0);
+
+	    mpi_div_u32(a, divisors[i], t);
+	    CU_ASSERT_EQUAL(mpi_cmp(t, q), 0);
+	    mpi_divrem_u32(a, divisors[i], NULL, t);
+	    CU_ASSERT_EQUAL(mpi_cmp(t, r), 0);
+	}
+    }
+    mpi_free(a);
+    mpi_free(b);
+    mpi_free(q);
+    mpi_free(r);
+    mpi_free(t);
+}
+
 void test_base64_encode()
 {
     char *base64;